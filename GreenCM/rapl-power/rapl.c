@@ -1686,8 +1686,14 @@ void endEnergy() {
 
 /* Thread Mapping */
 
+/* Placement planned by the STM from the CPU topology (if linked in) */
+extern int stm_bind_thread(long id) __attribute__((weak));
+
 void bindThread(long threadId) {
     cpu_set_t my_set;
+
+    if (stm_bind_thread != NULL && stm_bind_thread(threadId) >= 0)
+        return;
     CPU_ZERO(&my_set);
 
 //    long t = threadId * 2;
@@ -1,20 +1,23 @@
-import os,sys
+import os,re,sys
 import numpy
 
+# Reads the "== Average frequency" section printed by trace_analyzer
+# (runs traced with TRACE_FILE, analyzer output saved as <run>.freq)
+avgline = re.compile(r"^cpu\s+(\d+)\s+([0-9.]+) MHz \(")
+
 resultsDir = sys.argv[1]
 benchmark = sys.argv[2]
 outputsDir = sys.argv[3]
 
 avail_threads = [32,48,64]
 
-freqs = [1.4,1.6,1.8,2.0,2.2,2.4,3.0]
 configs = ["adpt","asym-adpt","dasym-adpt"]
 
 runs = {}
 
 for config in configs:
     runName = benchmark+"-"+config
-    files = [f for f in os.listdir(resultsDir) if f.startswith(runName) and f.endswith("err")] 
+    files = [f for f in os.listdir(resultsDir) if f.startswith(runName) and f.endswith("freq")] 
     for f in files:
 	threads = int(f.split(runName)[1].split("-")[1])
 	if threads not in runs:
@@ -24,17 +27,14 @@ for config in configs:
 	data = open(os.path.join(resultsDir,f)).readlines()
 	i = 0
 	for line in data:
-		if line.startswith("cpu "):
+		m = avgline.match(line)
+		if m:
 			if i >= threads:
 				break
 			i += 1
-			line = line.strip().split("\t")
-			freqdist = []
-			for j in range(1,len(line)):
-				freqdist.append(int(line[j]))
 			if i not in runs[threads][config]["freq"]:
 				runs[threads][config]["freq"][i] = []
-			runs[threads][config]["freq"][i].append(numpy.dot(freqdist,freqs)/numpy.sum(freqdist))
+			runs[threads][config]["freq"][i].append(float(m.group(2))/1000)
 
 runs = [(k,v) for (k,v) in runs.items()]
 runs.sort()
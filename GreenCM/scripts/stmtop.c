@@ -0,0 +1,277 @@
+/*
+ * File:
+ *   stmtop.c
+ * Description:
+ *   Live view of the statistics published by tinySTM when STATS_SHM is
+ *   set (see tinystm/src/stats_format.h).
+ *
+ * Build:
+ *   gcc -O2 -I../tinystm/src -o stmtop stmtop.c
+ *
+ * Usage:
+ *   stmtop <pid> [-d <seconds>] [-n <count>] [-t]
+ *     -d  refresh period (default 1)
+ *     -n  number of refreshes (default: until the process exits)
+ *     -t  also print one line per thread
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation, version 2
+ * of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#include <errno.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "stats_format.h"
+
+#define LOAD(a)                         __atomic_load_n(a, __ATOMIC_RELAXED)
+#define LOAD_ACQ(a)                     __atomic_load_n(a, __ATOMIC_ACQUIRE)
+#define FENCE_ACQ                       __atomic_thread_fence(__ATOMIC_ACQUIRE)
+
+typedef struct snap {                   /* Copy of a counter slot */
+  uintptr_t used;
+  uintptr_t cpu;
+  uintptr_t commits;
+  uintptr_t aborts;
+  uintptr_t aborts_r[STATS_REASONS];
+  uintptr_t wait[STATS_WAIT_BUCKETS];
+  uintptr_t spun;
+  uintptr_t slept;
+  uintptr_t escalations;
+} snap_t;
+
+typedef struct params {                 /* Copy of the tuning parameters */
+  char policy[16];
+  uint64_t ferraris, max_ferraris, backoff_threshold, asym_threshold;
+  uint64_t max_backoff, thresh_index, spintosleep, beta, adm_cap, starve_threshold;
+} params_t;
+
+/* Same indexes as stat_aborts_r (explicit aborts land in 0 and 1) */
+static const char *reason_names[STATS_REASONS] = {
+  "explicit", "rr-conflict", "rw-conflict", "wr-conflict", "ww-conflict", "val-read",
+  "val-write", "validate", "?", "irrevocable", "killed", "signal", "extend-ws", "?", "?", "other"
+};
+
+static void
+read_slot(const tx_stats_t *st, snap_t *s)
+{
+  uintptr_t seq;
+  int i;
+
+  do {
+    seq = LOAD_ACQ(&st->seq);
+    s->commits = LOAD(&st->commits);
+    s->aborts = LOAD(&st->aborts);
+    for (i = 0; i < STATS_REASONS; i++)
+      s->aborts_r[i] = LOAD(&st->aborts_r[i]);
+    FENCE_ACQ;
+  } while ((seq & 1) != 0 || LOAD(&st->seq) != seq);
+  s->used = LOAD(&st->used);
+  s->cpu = LOAD(&st->cpu);
+  for (i = 0; i < STATS_WAIT_BUCKETS; i++)
+    s->wait[i] = LOAD(&st->wait[i]);
+  s->spun = LOAD(&st->spun);
+  s->slept = LOAD(&st->slept);
+  s->escalations = LOAD(&st->escalations);
+}
+
+static void
+read_params(const stats_shm_t *h, params_t *p)
+{
+  uint64_t seq;
+
+  do {
+    seq = LOAD_ACQ(&h->seq);
+    memcpy(p->policy, (const char *)h->policy, sizeof(p->policy));
+    p->ferraris = LOAD(&h->ferraris);
+    p->max_ferraris = LOAD(&h->max_ferraris);
+    p->backoff_threshold = LOAD(&h->backoff_threshold);
+    p->asym_threshold = LOAD(&h->asym_threshold);
+    p->max_backoff = LOAD(&h->max_backoff);
+    p->thresh_index = LOAD(&h->thresh_index);
+    p->spintosleep = LOAD(&h->spintosleep);
+    p->beta = LOAD(&h->beta);
+    p->adm_cap = LOAD(&h->adm_cap);
+    p->starve_threshold = LOAD(&h->starve_threshold);
+    FENCE_ACQ;
+  } while ((seq & 1) != 0 || LOAD(&h->seq) != seq);
+  p->policy[sizeof(p->policy) - 1] = '\0';
+}
+
+static double
+now(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void
+usage(const char *name)
+{
+  fprintf(stderr, "Usage: %s <pid> [-d <seconds>] [-n <count>] [-t]\n", name);
+  exit(1);
+}
+
+int
+main(int argc, char **argv)
+{
+  const stats_shm_t *h;
+  const stats_slab_t *slabs;
+  snap_t *prev, *cur, tp, tc;
+  params_t p;
+  struct stat sb;
+  char path[64], wait_label[32];
+  double delay = 1, last, t, dt;
+  long count = 0, iter;
+  int pid = 0, threads = 0, fd, n, i, j, c;
+  unsigned long da;
+
+  for (i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "-d") == 0 && i + 1 < argc)
+      delay = atof(argv[++i]);
+    else if (strcmp(argv[i], "-n") == 0 && i + 1 < argc)
+      count = atol(argv[++i]);
+    else if (strcmp(argv[i], "-t") == 0)
+      threads = 1;
+    else if (argv[i][0] != '-' && pid == 0)
+      pid = atoi(argv[i]);
+    else
+      usage(argv[0]);
+  }
+  if (pid <= 0 || delay <= 0)
+    usage(argv[0]);
+
+  snprintf(path, sizeof(path), "/dev/shm/tinystm.%d", pid);
+  if ((fd = open(path, O_RDONLY)) < 0 || fstat(fd, &sb) != 0) {
+    perror(path);
+    return 1;
+  }
+  h = (const stats_shm_t *)mmap(NULL, sb.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (h == MAP_FAILED) {
+    perror("mmap");
+    return 1;
+  }
+  if ((size_t)sb.st_size < sizeof(stats_shm_t) || LOAD_ACQ(&h->magic) != STATS_MAGIC) {
+    fprintf(stderr, "%s: not a statistics segment (or not initialized yet)\n", path);
+    return 1;
+  }
+  if (h->version != STATS_VERSION || h->header_size != sizeof(stats_shm_t) || h->slab_size != sizeof(stats_slab_t)
+      || (size_t)sb.st_size < h->header_size + (size_t)h->nb_slabs * h->slab_size) {
+    fprintf(stderr, "%s: unsupported layout (version %u)\n", path, h->version);
+    return 1;
+  }
+  slabs = (const stats_slab_t *)((const char *)h + h->header_size);
+  n = h->nb_slabs * STATS_SLAB_SLOTS;
+  prev = calloc(n, sizeof(snap_t));
+  cur = calloc(n, sizeof(snap_t));
+  for (i = 0; i < n; i++)
+    read_slot(&slabs[i / STATS_SLAB_SLOTS].slots[i % STATS_SLAB_SLOTS], &prev[i]);
+  last = now();
+
+  for (iter = 0; count == 0 || iter < count; iter++) {
+    usleep((useconds_t)(delay * 1e6));
+    for (i = 0; i < n; i++)
+      read_slot(&slabs[i / STATS_SLAB_SLOTS].slots[i % STATS_SLAB_SLOTS], &cur[i]);
+    read_params(h, &p);
+    t = now();
+    dt = t - last;
+    last = t;
+
+    /* Totals over all slots (counters are kept when a slot is reused) */
+    memset(&tp, 0, sizeof(tp));
+    memset(&tc, 0, sizeof(tc));
+    for (i = c = 0; i < n; i++) {
+      c += (cur[i].used != 0);
+      tp.commits += prev[i].commits;
+      tc.commits += cur[i].commits;
+      tp.aborts += prev[i].aborts;
+      tc.aborts += cur[i].aborts;
+      tp.spun += prev[i].spun;
+      tc.spun += cur[i].spun;
+      tp.slept += prev[i].slept;
+      tc.slept += cur[i].slept;
+      tp.escalations += prev[i].escalations;
+      tc.escalations += cur[i].escalations;
+      for (j = 0; j < STATS_REASONS; j++) {
+        tp.aborts_r[j] += prev[i].aborts_r[j];
+        tc.aborts_r[j] += cur[i].aborts_r[j];
+      }
+      for (j = 0; j < STATS_WAIT_BUCKETS; j++) {
+        tp.wait[j] += prev[i].wait[j];
+        tc.wait[j] += cur[i].wait[j];
+      }
+    }
+    da = tc.aborts - tp.aborts;
+
+    printf("\n== pid %d  %s/%s  up %.0fs  threads %d\n", pid, h->cm, p.policy,
+           (time(NULL) * 1e9 - h->start) / 1e9, c);
+    printf("   ferraris %lu/%lu  threshold %lu (index %lu)  asym %lu  max_backoff %lu  spintosleep %lu  beta %lu  starve %lu  admission ",
+           (unsigned long)p.ferraris, (unsigned long)p.max_ferraris, (unsigned long)p.backoff_threshold,
+           (unsigned long)p.thresh_index, (unsigned long)p.asym_threshold, (unsigned long)p.max_backoff,
+           (unsigned long)p.spintosleep, (unsigned long)p.beta, (unsigned long)p.starve_threshold);
+    if (p.adm_cap == ~0ULL)
+      printf("open\n");
+    else
+      printf("%lu\n", (unsigned long)p.adm_cap);
+    printf("   commits/s %12.0f  aborts/s %12.0f  abort ratio %5.1f%%  spin it/s %12.0f  sleep ms/s %8.1f  escalations/s %8.1f\n",
+           (tc.commits - tp.commits) / dt, da / dt,
+           (tc.commits - tp.commits) + da > 0 ? 100.0 * da / ((tc.commits - tp.commits) + da) : 0.0,
+           (tc.spun - tp.spun) / dt, (tc.slept - tp.slept) / dt / 1000, (tc.escalations - tp.escalations) / dt);
+
+    if (da > 0) {
+      printf("   aborts:");
+      for (j = 0; j < STATS_REASONS; j++) {
+        if (tc.aborts_r[j] != tp.aborts_r[j])
+          printf("  %s %.1f%%", reason_names[j], 100.0 * (tc.aborts_r[j] - tp.aborts_r[j]) / da);
+      }
+      printf("\n   waits: ");
+      for (j = 0; j < STATS_WAIT_BUCKETS; j++) {
+        if (tc.wait[j] == tp.wait[j])
+          continue;
+        if (j == 0)
+          snprintf(wait_label, sizeof(wait_label), "<4");
+        else
+          snprintf(wait_label, sizeof(wait_label), "<4^%d", j + 1);
+        printf("  %s %lu", wait_label, (unsigned long)(tc.wait[j] - tp.wait[j]));
+      }
+      printf("\n");
+    }
+
+    if (threads) {
+      printf("   %6s %5s %12s %12s %12s %10s\n", "slot", "cpu", "commits/s", "aborts/s", "spin it/s", "sleep ms/s");
+      for (i = 0; i < n; i++) {
+        if (cur[i].used == 0 && cur[i].commits == prev[i].commits && cur[i].aborts == prev[i].aborts)
+          continue;
+        printf("   %6d %5lu %12.0f %12.0f %12.0f %10.1f\n", i, (unsigned long)cur[i].cpu,
+               (cur[i].commits - prev[i].commits) / dt, (cur[i].aborts - prev[i].aborts) / dt,
+               (cur[i].spun - prev[i].spun) / dt, (cur[i].slept - prev[i].slept) / dt / 1000);
+      }
+    }
+    fflush(stdout);
+
+    memcpy(prev, cur, n * sizeof(snap_t));
+    if (kill(pid, 0) != 0 && errno == ESRCH) {
+      printf("\nProcess %d exited.\n", pid);
+      break;
+    }
+  }
+  return 0;
+}
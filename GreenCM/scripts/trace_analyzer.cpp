@@ -0,0 +1,357 @@
+/*
+ * File:
+ *   trace_analyzer.cpp
+ * Description:
+ *   Offline analyzer of the binary traces written by tinySTM when built
+ *   with -DTM_TRACE (see tinystm/src/trace_format.h).
+ *
+ * Build:
+ *   g++ -O2 -std=c++11 -I../tinystm/src -o trace_analyzer trace_analyzer.cpp
+ *
+ * Usage:
+ *   trace_analyzer <trace file> [-t <thread>] [-n <chains>]
+ *     -t  also print the timeline of a thread
+ *     -n  number of longest abort chains to print (default 10)
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation, version 2
+ * of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "trace_format.h"
+
+using namespace std;
+
+/* Same order as tn_params[] in tuner.h */
+static const char *param_names[] = { "ferraris", "threshold", "asym_threshold", "max_backoff", "starve_threshold" };
+static const char *wait_names[] = { "spin", "sleep", "park" };
+static const char *kind_names[] = { "tx", "tuner", "freq" };
+
+struct chain {                          /* Execution of an atomic block, from begin to commit */
+  unsigned int thread;
+  unsigned int id;                      /* Attribute id */
+  uint64_t begin;
+  uint64_t end;
+  unsigned int aborts;
+  uint64_t waited[3];                   /* Backoff ticks per mode */
+};
+
+struct thread_info {                    /* Timeline and totals of a thread */
+  int kind;
+  int cpu;
+  vector<trace_rec_t> recs;
+  unsigned long commits;
+  unsigned long aborts;
+  map<unsigned int, unsigned long> reasons;
+  uint64_t in_tx;                       /* Ticks from begin to commit */
+  uint64_t waited[3];                   /* Backoff ticks per mode */
+  unsigned long waits[3];
+  uint64_t admission;                   /* Ticks parked at the admission gate */
+  thread_info() : kind(-1), cpu(-1), commits(0), aborts(0), in_tx(0), admission(0) {
+    memset(waited, 0, sizeof(waited));
+    memset(waits, 0, sizeof(waits));
+  }
+};
+
+static double tsc_khz = 0;
+
+/*
+ * Ticks to microseconds (ticks if the TSC frequency is unknown).
+ */
+static double
+us(uint64_t ticks)
+{
+  return (tsc_khz > 0 ? ticks * 1000.0 / tsc_khz : (double)ticks);
+}
+
+static const char *
+reason_name(unsigned int reason)
+{
+  static const char *names[] = {
+    "explicit", "rr-conflict", "rw-conflict", "wr-conflict", "ww-conflict", "val-read",
+    "val-write", "validate", "?", "irrevocable", "killed", "signal", "extend-ws", "?", "?", "other"
+  };
+
+  if ((reason & (1 << 5)) != 0)
+    return ((reason >> 8) & 0x0F) == 1 ? "no-retry" : "explicit";
+  return names[(reason >> 8) & 0x0F];
+}
+
+static uint64_t
+percentile(vector<uint64_t> &v, double p)
+{
+  size_t i;
+
+  if (v.empty())
+    return 0;
+  i = (size_t)(p * (v.size() - 1));
+  nth_element(v.begin(), v.begin() + i, v.end());
+  return v[i];
+}
+
+/*
+ * Gather the chunks of each thread in order.
+ */
+static int
+load(const char *path, map<unsigned int, thread_info> &threads, bool &full)
+{
+  const trace_header_t *h;
+  const trace_chunk_t *c;
+  map<unsigned int, map<unsigned int, const trace_chunk_t *> > chunks;
+  struct stat st;
+  uint64_t i, used;
+  void *p;
+  int fd;
+
+  if ((fd = open(path, O_RDONLY)) < 0 || fstat(fd, &st) != 0) {
+    perror(path);
+    return 0;
+  }
+  if ((size_t)st.st_size < sizeof(trace_header_t)) {
+    fprintf(stderr, "%s: not a trace\n", path);
+    return 0;
+  }
+  p = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (p == MAP_FAILED) {
+    perror("mmap");
+    return 0;
+  }
+  h = (const trace_header_t *)p;
+  if (h->magic != TRACE_MAGIC || h->version != TRACE_VERSION || h->chunk_size != TRACE_CHUNK_SIZE) {
+    fprintf(stderr, "%s: not a trace or unsupported version\n", path);
+    return 0;
+  }
+  tsc_khz = (double)h->tsc_khz;
+  used = 0;
+  for (i = 0; i < h->nb_chunks && (i + 2) * TRACE_CHUNK_SIZE <= (uint64_t)st.st_size; i++) {
+    c = (const trace_chunk_t *)((const char *)p + TRACE_CHUNK_SIZE * (i + 1));
+    if (c->magic != TRACE_CHUNK_MAGIC)
+      continue;
+    chunks[c->thread][c->seq] = c;
+    used++;
+  }
+  /* Threads stop recording once all chunks are claimed */
+  full = (used == h->nb_chunks);
+  for (map<unsigned int, map<unsigned int, const trace_chunk_t *> >::iterator t = chunks.begin(); t != chunks.end(); ++t) {
+    thread_info &ti = threads[t->first];
+    for (map<unsigned int, const trace_chunk_t *>::iterator s = t->second.begin(); s != t->second.end(); ++s)
+      ti.recs.insert(ti.recs.end(), s->second->recs, s->second->recs + min<uint32_t>(s->second->count, TRACE_CHUNK_RECS));
+  }
+  return 1;
+}
+
+int
+main(int argc, char **argv)
+{
+  map<unsigned int, thread_info> threads;
+  vector<chain> chains;
+  vector<uint64_t> latencies;
+  map<unsigned int, unsigned long> chain_lengths;
+  map<int, pair<double, unsigned long> > freqs;
+  const char *path = NULL;
+  bool full;
+  uint64_t start = ~0ULL, total_waited[3] = { 0, 0, 0 };
+  unsigned long total_commits = 0, total_aborts = 0;
+  unsigned int show = 0, nb_chains = 10;
+  int i;
+
+  for (i = 1; i < argc; i++) {
+    if (strcmp(argv[i], "-t") == 0 && i + 1 < argc)
+      show = atoi(argv[++i]);
+    else if (strcmp(argv[i], "-n") == 0 && i + 1 < argc)
+      nb_chains = atoi(argv[++i]);
+    else
+      path = argv[i];
+  }
+  if (path == NULL) {
+    fprintf(stderr, "Usage: %s <trace file> [-t <thread>] [-n <chains>]\n", argv[0]);
+    return 1;
+  }
+  if (!load(path, threads, full))
+    return 1;
+  for (map<unsigned int, thread_info>::iterator t = threads.begin(); t != threads.end(); ++t) {
+    if (!t->second.recs.empty())
+      start = min(start, t->second.recs[0].tsc);
+  }
+
+  /* Rebuild timelines */
+  printf("TSC: %.0f kHz (%s)%s\n", tsc_khz, tsc_khz > 0 ? "times in us" : "times in ticks",
+         full ? ", file was full: some events were dropped" : "");
+  for (map<unsigned int, thread_info>::iterator t = threads.begin(); t != threads.end(); ++t) {
+    thread_info &ti = t->second;
+    chain cur;
+    uint64_t wait_start = 0;
+    bool in_tx = false;
+
+    memset(&cur, 0, sizeof(cur));
+    if (t->first == show)
+      printf("\n== Timeline of thread %u\n", t->first);
+    for (vector<trace_rec_t>::iterator r = ti.recs.begin(); r != ti.recs.end(); ++r) {
+      switch (r->type) {
+       case TR_THREAD:
+        ti.kind = r->a8;
+        ti.cpu = (r->a16 == 0xffff ? -1 : r->a16);
+        break;
+       case TR_BEGIN:
+        cur.thread = t->first;
+        cur.id = r->a16;
+        cur.begin = r->tsc;
+        cur.aborts = 0;
+        memset(cur.waited, 0, sizeof(cur.waited));
+        in_tx = true;
+        break;
+       case TR_ABORT:
+        ti.aborts++;
+        ti.reasons[r->a32]++;
+        cur.aborts++;
+        break;
+       case TR_COMMIT:
+        ti.commits++;
+        if (in_tx) {
+          cur.end = r->tsc;
+          ti.in_tx += cur.end - cur.begin;
+          latencies.push_back(cur.end - cur.begin);
+          chain_lengths[cur.aborts]++;
+          if (cur.aborts > 0)
+            chains.push_back(cur);
+          in_tx = false;
+        }
+        break;
+       case TR_BACKOFF_START:
+        wait_start = r->tsc;
+        break;
+       case TR_BACKOFF_END:
+        if (wait_start != 0 && r->a8 < 3) {
+          ti.waited[r->a8] += r->tsc - wait_start;
+          ti.waits[r->a8]++;
+          cur.waited[r->a8] += r->tsc - wait_start;
+        }
+        wait_start = 0;
+        break;
+       case TR_ADMIT:
+        ti.admission += r->a32;
+        break;
+       case TR_FREQ:
+        freqs[r->a16].first += r->a32;
+        freqs[r->a16].second++;
+        break;
+      }
+      if (t->first != show)
+        continue;
+      printf("%14.3f  ", us(r->tsc - start));
+      switch (r->type) {
+       case TR_THREAD: printf("thread kind=%s cpu=%d\n", r->a8 < 3 ? kind_names[r->a8] : "?", ti.cpu); break;
+       case TR_BEGIN: printf("begin id=%u\n", r->a16); break;
+       case TR_COMMIT: printf("commit id=%u retries=%u\n", r->a16, r->a32); break;
+       case TR_ABORT: printf("abort id=%u reason=%s\n", r->a16, reason_name(r->a32)); break;
+       case TR_BACKOFF_START: printf("backoff %s wait=%u\n", r->a8 < 3 ? wait_names[r->a8] : "?", r->a32); break;
+       case TR_BACKOFF_END: printf("backoff end\n"); break;
+       case TR_ADMIT: printf("parked at gate %.3f\n", us(r->a32)); break;
+       case TR_TUNER: printf("tuner %s=%u\n", r->a8 < 5 ? param_names[r->a8] : "?", r->a32); break;
+       case TR_SCORE: { float f; memcpy(&f, &r->a32, sizeof(f)); printf("tuner score=%g\n", f); break; }
+       case TR_FREQ: printf("cpu %u: %u MHz, C0 %u%%\n", r->a16, r->a32, r->a8); break;
+       case TR_ESCALATE: printf("escalate id=%u retries=%u\n", r->a16, r->a32); break;
+       case TR_QUEUE: printf("queue id=%u votes=%u\n", r->a16, r->a32); break;
+       default: printf("unknown record %u\n", r->type); break;
+      }
+    }
+  }
+
+  /* Per-thread totals */
+  printf("\n== Threads\n");
+  printf("%6s %5s %4s %10s %10s %12s %12s %12s %12s %12s\n",
+         "thread", "kind", "cpu", "commits", "aborts", "in-tx", "spin", "sleep", "park", "gate");
+  for (map<unsigned int, thread_info>::iterator t = threads.begin(); t != threads.end(); ++t) {
+    thread_info &ti = t->second;
+    printf("%6u %5s %4d %10lu %10lu %12.0f %12.0f %12.0f %12.0f %12.0f\n", t->first,
+           ti.kind >= 0 && ti.kind < 3 ? kind_names[ti.kind] : "?", ti.cpu, ti.commits, ti.aborts,
+           us(ti.in_tx), us(ti.waited[0]), us(ti.waited[1]), us(ti.waited[2]), us(ti.admission));
+    total_commits += ti.commits;
+    total_aborts += ti.aborts;
+    for (i = 0; i < 3; i++)
+      total_waited[i] += ti.waited[i];
+  }
+
+  /* Abort reasons */
+  {
+    map<string, unsigned long> reasons;
+    printf("\n== Abort reasons (%lu aborts, %lu commits)\n", total_aborts, total_commits);
+    for (map<unsigned int, thread_info>::iterator t = threads.begin(); t != threads.end(); ++t) {
+      for (map<unsigned int, unsigned long>::iterator r = t->second.reasons.begin(); r != t->second.reasons.end(); ++r)
+        reasons[reason_name(r->first)] += r->second;
+    }
+    for (map<string, unsigned long>::iterator r = reasons.begin(); r != reasons.end(); ++r)
+      printf("%-12s %10lu\n", r->first.c_str(), r->second);
+  }
+
+  /* Spin versus sleep */
+  {
+    uint64_t all = total_waited[0] + total_waited[1] + total_waited[2];
+    printf("\n== Backoff time\n");
+    for (i = 0; i < 3; i++)
+      printf("%-6s %14.0f (%5.1f%%)\n", wait_names[i], us(total_waited[i]), all ? 100.0 * total_waited[i] / all : 0.0);
+  }
+
+  /* Latency and abort chains */
+  printf("\n== Begin-to-commit latency\n");
+  printf("p50 %.3f  p90 %.3f  p99 %.3f  p99.9 %.3f  max %.3f\n",
+         us(percentile(latencies, 0.5)), us(percentile(latencies, 0.9)), us(percentile(latencies, 0.99)),
+         us(percentile(latencies, 0.999)), us(percentile(latencies, 1.0)));
+  printf("\n== Aborts before commit\n");
+  for (map<unsigned int, unsigned long>::iterator c = chain_lengths.begin(); c != chain_lengths.end(); ++c)
+    printf("%6u %10lu\n", c->first, c->second);
+  sort(chains.begin(), chains.end(), [](const chain &a, const chain &b) { return a.end - a.begin > b.end - b.begin; });
+  printf("\n== Longest abort chains\n");
+  printf("%6s %6s %14s %12s %7s %12s %12s %12s\n", "thread", "id", "begin", "duration", "aborts", "spin", "sleep", "park");
+  for (size_t j = 0; j < chains.size() && j < nb_chains; j++) {
+    chain &c = chains[j];
+    printf("%6u %6u %14.3f %12.3f %7u %12.3f %12.3f %12.3f\n", c.thread, c.id, us(c.begin - start), us(c.end - c.begin),
+           c.aborts, us(c.waited[0]), us(c.waited[1]), us(c.waited[2]));
+  }
+
+  /* Tuner decisions */
+  printf("\n== Tuner decisions\n");
+  for (map<unsigned int, thread_info>::iterator t = threads.begin(); t != threads.end(); ++t) {
+    if (t->second.kind != TR_KIND_TUNER)
+      continue;
+    for (vector<trace_rec_t>::iterator r = t->second.recs.begin(); r != t->second.recs.end(); ++r) {
+      if (r->type == TR_SCORE) {
+        float f;
+        memcpy(&f, &r->a32, sizeof(f));
+        printf("\n%14.3f score=%g", us(r->tsc - start), f);
+      } else if (r->type == TR_TUNER) {
+        printf(" %s=%u", r->a8 < 5 ? param_names[r->a8] : "?", r->a32);
+      }
+    }
+  }
+  printf("\n");
+
+  /* Frequencies */
+  if (!freqs.empty()) {
+    printf("\n== Average frequency\n");
+    for (map<int, pair<double, unsigned long> >::iterator f = freqs.begin(); f != freqs.end(); ++f)
+      printf("cpu %3d %8.0f MHz (%lu samples)\n", f->first, f->second.first / f->second.second, f->second.second);
+  }
+
+  return 0;
+}
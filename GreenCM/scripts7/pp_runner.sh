@@ -37,6 +37,8 @@ backend[15]="timestamp"
 backend[16]="aggressive"
 backend[17]="modsuicide"
 backend[18]="adpt-thresh-stab-jmp1"
+backend[19]="karma-asym-adpt"
+backend[20]="timestamp-asym-adpt-park"
 
 
 config[1]="MOD_CM_POLICY=karma BO_POLICY=adpt CM_POLICY=backoff"
@@ -57,6 +59,8 @@ config[15]="MOD_CM_POLICY=timestamp BO_POLICY=spin CM_POLICY=modular"
 config[16]="MOD_CM_POLICY=aggressive BO_POLICY=spin CM_POLICY=modular"
 config[17]="MOD_CM_POLICY=suicide BO_POLICY=spin CM_POLICY=modular"
 config[18]="MOD_CM_POLICY=karma BO_POLICY=adpt_thresh CM_POLICY=backoff"
+config[19]="MOD_CM_POLICY=karma BO_POLICY=asym_adpt CM_POLICY=hybrid"
+config[20]="MOD_CM_POLICY=timestamp BO_POLICY=asym_adpt_park CM_POLICY=hybrid"
 
 
 benchmarks[1]="redblacktree"
@@ -117,6 +117,11 @@ void stm_free2_tx(struct stm_tx *tx, void *addr, size_t idx, size_t size);
  * main thread, after initializing the STM library and before
  * performing any transactional operation.
  *
+ * If the environment variable MEM_SLABS is set to 1, blocks of up to
+ * 2 KB are allocated from per-thread slabs and recycled by the module
+ * instead of going through malloc() and free().  Such blocks must only
+ * be released with stm_free() (never with free()).
+ *
  * @param gc
  *   True (non-zero) to enable epoch-based garbage collector when
  *   freeing memory in transactions.
@@ -281,6 +281,20 @@ void stm_init(void) _CALLCONV;
  */
 void stm_exit(void) _CALLCONV;
 
+/**
+ * Bind the current thread to the CPU planned for it by the placement
+ * policy (THREAD_PLACEMENT environment variable).  This function should
+ * be called before stm_init_thread() so that the fast cores of
+ * asymmetric backoff policies match the CPUs of the first threads.
+ *
+ * @param id
+ *   Application thread identifier (0 for the first thread).
+ * @return
+ *   The CPU of the thread, or -1 if threads are not placed by the STM
+ *   (the caller then keeps its own binding).
+ */
+int stm_bind_thread(long id) _CALLCONV;
+
 /**
  * Initialize a transactional thread.  This function must be called once
  * from each thread that performs transactional operations, before the
@@ -480,6 +494,68 @@ int stm_get_stats(const char *name, void *val) _CALLCONV;
 int stm_get_stats_tx(struct stm_tx *tx, const char *name, void *val) _CALLCONV;
 //@}
 
+/**
+ * Commit and abort counters of all threads.
+ */
+typedef struct stm_counters {
+  unsigned long commits;                /**< Total number of commits */
+  unsigned long aborts;                 /**< Total number of aborts */
+} stm_counters_t;
+
+/**
+ * Get the number of commits and aborts of all threads since the
+ * initialization of the library, including threads that have exited.
+ * Counters are maintained even if the library is compiled without
+ * statistics, and can be polled concurrently with transactions: the
+ * two counters of each thread are read consistently.
+ *
+ * @param counters
+ *   Pointer to the structure that should hold the counters.
+ */
+void stm_get_counters(stm_counters_t *counters) _CALLCONV;
+
+/**
+ * Number of sub-buckets per power of 2 (log2) in histograms.  Values
+ * are exact below 2^(STM_HIST_SUB_BITS + 1) and recorded with a
+ * relative error below 2^-STM_HIST_SUB_BITS above.
+ */
+#define STM_HIST_SUB_BITS               4
+#define STM_HIST_BUCKETS                ((64 - STM_HIST_SUB_BITS + 1) << STM_HIST_SUB_BITS)
+
+/**
+ * Log-linear histogram of 64-bit values.  Histograms of different
+ * threads can be merged with stm_hist_merge().
+ */
+typedef struct stm_hist {
+  unsigned long long count;             /**< Number of values */
+  unsigned long long sum;               /**< Sum of values */
+  unsigned long long max;               /**< Largest value */
+  unsigned long long buckets[STM_HIST_BUCKETS];
+} stm_hist_t;
+
+/**
+ * Add the values of a histogram to another one.
+ *
+ * @param dst
+ *   Histogram to add to.
+ * @param src
+ *   Histogram to add.
+ */
+void stm_hist_merge(stm_hist_t *dst, const stm_hist_t *src) _CALLCONV;
+
+/**
+ * Get a percentile of a histogram.
+ *
+ * @param hist
+ *   Histogram.
+ * @param percentile
+ *   Percentile between 0 and 100 (e.g., 99.9).
+ * @return
+ *   Largest value recorded in the same bucket as the percentile (0 if
+ *   the histogram is empty).
+ */
+unsigned long long stm_hist_percentile(const stm_hist_t *hist, double percentile) _CALLCONV;
+
 /**
  * Get various parameters of the STM library.  See the source code
  * (stm.c) for a list of supported parameters.
@@ -0,0 +1,142 @@
+/*
+ * File:
+ *   admission.h
+ * Description:
+ *   Abort-rate driven admission control of concurrent transactions.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation, version 2
+ * of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#ifndef _ADMISSION_H_
+#define _ADMISSION_H_
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "stm_internal.h"
+#include "stats_shm.h"
+
+/*
+ * The controller thread samples the commit and abort counters once per
+ * period and adjusts the number of transactions allowed to run
+ * concurrently: the cap shrinks by a quarter while the abort ratio is
+ * above the target, and grows by one while it is below half of it.
+ * The gate is open (no counting in stm_start) when the cap reaches the
+ * number of threads.
+ */
+
+#define ADM_PERIOD_DEFAULT              10000               /* Microseconds */
+#define ADM_MIN_SAMPLES                 30                  /* Commits + aborts per period */
+
+static double adm_target;
+static volatile stm_word_t adm_started = 0;
+
+/*
+ * Publish a new cap (wake up parked threads if it grows).
+ */
+static void
+admission_set(unsigned long cap, unsigned long n)
+{
+  stm_word_t old, cur;
+
+  cur = (cap >= n ? ADM_OPEN : (stm_word_t)cap);
+  old = ATOMIC_LOAD(&_tinystm.adm_cap);
+  if (cur == old)
+    return;
+  ATOMIC_STORE(&_tinystm.adm_cap, cur);
+  stats_shm_publish();
+  if (cur > old && ATOMIC_LOAD(&_tinystm.adm_waiters) != 0) {
+    ATOMIC_FETCH_INC_FULL(&_tinystm.adm_seq);
+    syscall(SYS_futex, (int *)&_tinystm.adm_seq, FUTEX_WAKE_PRIVATE, INT_MAX, NULL, NULL, 0);
+  }
+  PRINT_DEBUG("==> admission: cap=%lu/%lu\n", cap, n);
+}
+
+static void *
+admission_proc(void *arg)
+{
+  struct timespec period;
+  stm_counters_t c;
+  unsigned long commits, aborts, dc, da, n, cap;
+  char *e;
+  long usec;
+
+  usec = ((e = getenv(ADMISSION_PERIOD)) != NULL ? atol(e) : ADM_PERIOD_DEFAULT);
+  if (usec <= 0)
+    usec = ADM_PERIOD_DEFAULT;
+  period.tv_sec = usec / 1000000;
+  period.tv_nsec = (usec % 1000000) * 1000;
+
+  stm_get_counters(&c);
+  commits = c.commits;
+  aborts = c.aborts;
+  cap = ~0UL;
+  while (running) {
+    nanosleep(&period, NULL);
+    stm_get_counters(&c);
+    dc = c.commits - commits;
+    da = c.aborts - aborts;
+    commits = c.commits;
+    aborts = c.aborts;
+    if (dc + da < ADM_MIN_SAMPLES)
+      continue;
+    if ((n = ATOMIC_LOAD(&_tinystm.threads_nb)) == 0)
+      continue;
+    if (cap > n)
+      cap = n;
+    if (da > adm_target * (dc + da)) {
+      if (cap > 1)
+        cap -= (cap >= 4 ? cap / 4 : 1);
+    } else if (da < adm_target / 2 * (dc + da)) {
+      if (cap < n)
+        cap++;
+    }
+    admission_set(cap, n);
+  }
+  admission_set(~0UL, 0);
+  ATOMIC_STORE(&adm_started, 0);
+  return NULL;
+}
+
+/*
+ * Start the controller if a target abort ratio is set in the
+ * environment.  At most one controller runs at a time: it stops by
+ * itself once stm_exit clears running.
+ */
+static void
+admission_start(void)
+{
+  pthread_t thread;
+  char *s;
+
+  if (ATOMIC_LOAD(&adm_started) != 0)
+    return;
+  ATOMIC_STORE(&_tinystm.adm_cap, ADM_OPEN);
+  if ((s = getenv(ADMISSION)) == NULL)
+    return;
+  adm_target = atof(s);
+  if (adm_target <= 0 || adm_target >= 1) {
+    fprintf(stderr, "Error: invalid admission abort ratio %s\n", s);
+    exit(1);
+  }
+  if (ATOMIC_CAS_FULL(&adm_started, 0, 1) == 0)
+    return;
+  PRINT_DEBUG("\tADMISSION=%f\n", adm_target);
+  if (pthread_create(&thread, NULL, admission_proc, NULL) != 0) {
+    ATOMIC_STORE(&adm_started, 0);
+    return;
+  }
+  pthread_detach(thread);
+}
+
+#endif /* _ADMISSION_H_ */
@@ -8,6 +8,11 @@
 #include <errno.h>
 #include <fcntl.h>
 #include <string.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#if defined(__x86_64__) || defined(__i386__)
+# include <cpuid.h>
+#endif /* defined(__x86_64__) || defined(__i386__) */
 
 #include "cpufreq.h"
 #include "cpuid.h"
@@ -19,14 +24,41 @@
 #define MSR_IA32_APERF 0x000000E8
 #define MSR_IA32_MPERF 0x000000E7
 
+/* Reference frequency (P1) when neither cpufreq nor CPUID report it */
+#define FREQ_REF_KHZ 2100000
+
+/*
+ * The counters of a CPU are opened once: MSRs are read with pread() on
+ * /dev/cpu/N/msr, and if that is not permitted the perf_event cycles
+ * and ref-cycles counters (same semantics as APERF and MPERF: they only
+ * tick in C0) are read as a group.
+ */
 struct avg_perf_cpu_info
 {
         unsigned long max_freq;
         uint64_t saved_aperf;
         uint64_t saved_mperf;
+        int msr_fd;
+        int perf_fd;
+        int perf_ref_fd;
         uint32_t is_valid:1;
 };
 
+typedef struct freq_sample {            /* Telemetry of a CPU over the last period */
+	unsigned long khz;              /* Effective frequency */
+	unsigned int c0;                /* C0 residency (percent) */
+	unsigned long stamp;            /* Period of the sample (0 if never sampled) */
+} freq_sample_t;
+
+/* Written by the sampler only: readers retry while seq is odd or has
+ * changed. */
+static struct {
+	volatile stm_word_t seq;
+	freq_sample_t cpus[MAX_CPUS];
+} freq_snapshot;
+
+static const char *freq_source_name = NULL;
+
 
 static int cpu_has_effective_freq()
 {
@@ -38,51 +70,121 @@ static int cpu_has_effective_freq()
 }
 
 /*
- * read_msr
+ * open_msr
  *
- * Will return 0 on success and -1 on failure.
- * Possible errno values could be:
- * EFAULT -If the read/write did not fully complete
- * EIO    -If the CPU does not support MSRs
- * ENXIO  -If the CPU does not exist
+ * Returns a descriptor on the MSRs of cpu if they can be read, -1
+ * otherwise (no msr driver or no permission).
  */
-
-static int read_msr(int cpu, unsigned int idx, unsigned long long *val)
+static int open_msr(int cpu)
 {
-	int fd;
 	char msr_file_name[64];
+	uint64_t val;
+	int fd;
 
 	sprintf(msr_file_name, "/dev/cpu/%d/msr", cpu);
 	fd = open(msr_file_name, O_RDONLY);
 	if (fd < 0)
 		return -1;
-	if (lseek(fd, idx, SEEK_CUR) == -1)
-		goto err;
-	if (read(fd, val, sizeof val) != sizeof *val)
-		goto err;
-	close(fd);
-	return 0;
- err:
-	close(fd);
-	return -1;
+	if (pread(fd, &val, sizeof(val), MSR_IA32_APERF) != sizeof(val)) {
+		close(fd);
+		return -1;
+	}
+	return fd;
+}
+
+/*
+ * open_perf
+ *
+ * Returns the leader of a group counting the cycles and ref-cycles of
+ * cpu, -1 if not available (see perf_event_paranoid).
+ */
+static int open_perf(int cpu, int *ref_fd)
+{
+	struct perf_event_attr attr;
+	int leader, fd;
+
+	memset(&attr, 0, sizeof(attr));
+	attr.size = sizeof(attr);
+	attr.type = PERF_TYPE_HARDWARE;
+	attr.config = PERF_COUNT_HW_CPU_CYCLES;
+	attr.read_format = PERF_FORMAT_GROUP;
+	leader = syscall(__NR_perf_event_open, &attr, -1, cpu, -1, 0);
+	if (leader < 0)
+		return -1;
+	attr.config = PERF_COUNT_HW_REF_CPU_CYCLES;
+	fd = syscall(__NR_perf_event_open, &attr, -1, cpu, leader, 0);
+	if (fd < 0) {
+		close(leader);
+		return -1;
+	}
+	*ref_fd = fd;
+	return leader;
 }
 
 /*
  * get_aperf_mperf()
  *
- * Returns the current aperf/mperf MSR values of cpu
+ * Returns the current aperf/mperf values of cpu
  */
-static int get_aperf_mperf(unsigned int cpu, uint64_t *aperf, uint64_t *mperf)
+static int get_aperf_mperf(struct avg_perf_cpu_info *cpu_info, uint64_t *aperf, uint64_t *mperf)
 {
-	int retval;
-	retval = read_msr(cpu, MSR_IA32_APERF, (unsigned long long*)aperf);
-	if (retval < 0)
-		return retval;
-
-	retval = read_msr(cpu, MSR_IA32_MPERF, (unsigned long long*)mperf);
-	if (retval < 0)
-		return retval;
-	return 0;
+	uint64_t group[3];
+
+	if (cpu_info->msr_fd >= 0) {
+		if (pread(cpu_info->msr_fd, aperf, sizeof(*aperf), MSR_IA32_APERF) != sizeof(*aperf))
+			return -1;
+		if (pread(cpu_info->msr_fd, mperf, sizeof(*mperf), MSR_IA32_MPERF) != sizeof(*mperf))
+			return -1;
+		return 0;
+	}
+	if (cpu_info->perf_fd >= 0) {
+		/* nr, cycles, ref-cycles */
+		if (read(cpu_info->perf_fd, group, sizeof(group)) != sizeof(group))
+			return -1;
+		*aperf = group[1];
+		*mperf = group[2];
+		return 0;
+	}
+	return -1;
+}
+
+/*
+ * get_ref_freq()
+ *
+ * Returns the frequency at which MPERF ticks (base frequency, in kHz)
+ */
+static unsigned long get_ref_freq(int cpu)
+{
+	char path[128];
+	unsigned long khz = 0;
+	FILE *f;
+#if defined(__x86_64__) || defined(__i386__)
+	unsigned int eax, ebx, ecx, edx;
+#endif /* defined(__x86_64__) || defined(__i386__) */
+
+	/* intel_pstate and amd-pstate report it */
+	snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d/cpufreq/base_frequency", cpu);
+	if ((f = fopen(path, "r")) != NULL) {
+		if (fscanf(f, "%lu", &khz) != 1)
+			khz = 0;
+		fclose(f);
+	}
+#if defined(__x86_64__) || defined(__i386__)
+	/* Processor frequency information leaf (MHz) */
+	if (khz == 0 && __get_cpuid_max(0, NULL) >= 0x16) {
+		__cpuid(0x16, eax, ebx, ecx, edx);
+		khz = (eax & 0xffff) * 1000UL;
+	}
+#endif /* defined(__x86_64__) || defined(__i386__) */
+	if (khz == 0) {
+		snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%d/cpufreq/cpuinfo_max_freq", cpu);
+		if ((f = fopen(path, "r")) != NULL) {
+			if (fscanf(f, "%lu", &khz) != 1)
+				khz = 0;
+			fclose(f);
+		}
+	}
+	return (khz != 0 ? khz : FREQ_REF_KHZ);
 }
 
 /*
@@ -155,19 +257,21 @@ static int get_C_state_time(struct timeval time_diff, uint64_t mperf_diff,
 }
 
 static int get_measure_start_info(unsigned int cpu,
-				  struct avg_perf_cpu_info *cpu_info)
+				  struct avg_perf_cpu_info *cpu_info,
+				  const char *source)
 {
-	unsigned long min, max;
 	uint64_t aperf, mperf;
 	int ret;
 
 	cpu_info->is_valid = 0;
-
-	//if (cpufreq_get_hardware_limits(cpu, &min, &max))
-	//	return -EINVAL;
-
-	cpu_info->max_freq = 2100000;
-	ret = get_aperf_mperf(cpu, &aperf, &mperf);
+	cpu_info->msr_fd = cpu_info->perf_fd = cpu_info->perf_ref_fd = -1;
+
+	if (strcasecmp(source, "perf") != 0)
+		cpu_info->msr_fd = open_msr(cpu);
+	if (cpu_info->msr_fd < 0 && strcasecmp(source, "msr") != 0)
+		cpu_info->perf_fd = open_perf(cpu, &cpu_info->perf_ref_fd);
+	cpu_info->max_freq = get_ref_freq(cpu);
+	ret = get_aperf_mperf(cpu_info, &aperf, &mperf);
 	if (ret < 0)
 		return -EINVAL;
 
@@ -195,7 +299,7 @@ static int do_measuring_on_cpu(int sleep_time, int once, int cpu)
 	struct timeval start_time, current_time, diff_time, C0_time, CX_time;
 	uint64_t current_aperf, current_mperf, mperf_diff, aperf_diff;
 	struct avg_perf_cpu_info cpu_info;
-	ret = get_measure_start_info(cpu, &cpu_info);
+	ret = get_measure_start_info(cpu, &cpu_info, "auto");
 	if (ret)
 		return ret;
 	while(running) {
@@ -212,12 +316,11 @@ static int do_measuring_on_cpu(int sleep_time, int once, int cpu)
 
 		//printf("%.3u\t", cpu);
 
-		ret = get_aperf_mperf(cpu, &current_aperf, &current_mperf);
+		ret = get_aperf_mperf(&cpu_info, &current_aperf, &current_mperf);
 		if (ret < 0) {
 			printf("[offline]\n");
 			continue;
 		}
-		cpu_info.max_freq = 2100000;
 		mperf_diff = current_mperf - cpu_info.saved_mperf;
 		aperf_diff = current_aperf - cpu_info.saved_aperf;
 		get_C_state_time(diff_time, mperf_diff,
@@ -244,62 +347,94 @@ static int do_measuring_on_cpu(int sleep_time, int once, int cpu)
 struct x86_energy_source *source;
 int nr_packages;
 
+#ifdef TM_TRACE
+static trace_buf_t freq_trace;
+#endif /* TM_TRACE */
+
+/*
+ * freq_read()
+ *
+ * Copies the last sample of cpu (returns 0 if it was never sampled)
+ */
+static int freq_read(int cpu, freq_sample_t *sample)
+{
+	stm_word_t seq;
+
+	do {
+		seq = ATOMIC_LOAD_ACQ(&freq_snapshot.seq);
+		*sample = freq_snapshot.cpus[cpu];
+		ATOMIC_MB_READ;
+	} while ((seq & 1) != 0 || ATOMIC_LOAD(&freq_snapshot.seq) != seq);
+	return sample->stamp != 0;
+}
+
 static int do_measure_all_cpus(int sleep_time, int once)
 {
 	int ret;
-	unsigned long average;
+	unsigned long average, stamp;
 	unsigned int c0_percent, cpus, cpu;
 	struct timeval start_time, current_time, diff_time, C0_time, CX_time;
 	uint64_t current_aperf, current_mperf, mperf_diff, aperf_diff;
 	struct avg_perf_cpu_info *cpu_list;
+	freq_sample_t *samples;
+	const char *source;
+	char *s;
 
 	cpus = sysconf(_SC_NPROCESSORS_CONF);
+	if (cpus > MAX_CPUS)
+		cpus = MAX_CPUS;
+	/* At least a millisecond (C0 residency is computed in ms) */
+	if ((s = getenv(FREQ_PERIOD)) != NULL && atoi(s) >= 1000)
+		sleep_time = atoi(s);
+	if ((source = getenv(FREQ_SOURCE)) == NULL)
+		source = "auto";
+	if (strcasecmp(source, "auto") != 0 && strcasecmp(source, "msr") != 0
+	    && strcasecmp(source, "perf") != 0) {
+		fprintf(stderr, "Error: invalid frequency source %s\n", source);
+		exit(1);
+	}
 
 	cpu_list = (struct avg_perf_cpu_info*)
 		malloc(cpus * sizeof (struct avg_perf_cpu_info));
+	samples = (freq_sample_t*)
+		calloc(cpus, sizeof (freq_sample_t));
 
 	for (cpu = 0; cpu < cpus; cpu++) {
-		ret = get_measure_start_info(cpu, &cpu_list[cpu]);
-		if   (ret)
-		continue;
+		ret = get_measure_start_info(cpu, &cpu_list[cpu], source);
+		if (ret)
+			continue;
+		if (freq_source_name == NULL)
+			freq_source_name = (cpu_list[cpu].msr_fd >= 0 ? "msr" : "perf");
 	}
+	PRINT_DEBUG("\tFREQ_SOURCE=%s FREQ_PERIOD=%d\n", (freq_source_name != NULL ? freq_source_name : "none"), sleep_time);
 
-	int x,y;
-        for (x=0;x<64;x++){
-                for (y=0;y<7;y++){
-                        freqmonitor[x][y] = 0;
-                }
-        }
-
-
-	while(running) {
-		gettimeofday(&start_time, NULL);
+#ifdef TM_TRACE
+	trace_thread(&freq_trace, TR_KIND_FREQ, 0xffff);
+#endif /* TM_TRACE */
+	gettimeofday(&start_time, NULL);
+	for (stamp = 1; running; stamp++) {
 		usleep(sleep_time);
-		/* ToDo: Just add a second on the timeval struct?
-		         Would save one gettimeofday, but would not
-			 be that accurate anymore
-		*/
 		gettimeofday(&current_time, NULL);
 		timersub(&current_time, &start_time, &diff_time);
 		memcpy(&start_time, &current_time,
 		       sizeof(struct timeval));
 
 		for (cpu = 0; cpu < cpus; cpu++) {
-			if(thread_status[cpu]!=1)
+			/* Only CPUs running threads, nothing to read on the others */
+			if(thread_status[cpu]!=1 || !cpu_list[cpu].is_valid)
 				continue;
-			
-			//printf("%.3u\t", cpu);
 
-			ret = get_aperf_mperf(cpu, &current_aperf,
+			ret = get_aperf_mperf(&cpu_list[cpu], &current_aperf,
 					      &current_mperf);
-
-			if ((ret < 0) || !cpu_list[cpu].is_valid) {
-				printf("[offline]\n");
+			if (ret < 0)
 				continue;
-			}
 
 			mperf_diff = current_mperf - cpu_list[cpu].saved_mperf;
 			aperf_diff = current_aperf - cpu_list[cpu].saved_aperf;
+			cpu_list[cpu].saved_mperf = current_mperf;
+			cpu_list[cpu].saved_aperf = current_aperf;
+			if (mperf_diff == 0)
+				continue;
 
 			get_C_state_time(diff_time, mperf_diff,
 					 cpu_list[cpu].max_freq,
@@ -307,39 +442,30 @@ static int do_measure_all_cpus(int sleep_time, int once)
 					 &c0_percent);
 			average = get_average_perf(cpu_list[cpu].max_freq,
 						   aperf_diff, mperf_diff);
-			cpu_list[cpu].saved_mperf = current_mperf;
-			cpu_list[cpu].saved_aperf = current_aperf;
-			if (average < 1500000){
-				freqmonitor[cpu][0] += 1;
-			}
-			else if(average < 1700000){
-				freqmonitor[cpu][1] += 1;
-			}
-			else if(average < 1900000){
-				freqmonitor[cpu][2] += 1;
-			}
-			else if(average < 2100000){
-				freqmonitor[cpu][3] += 1;
-			}
-			else if(average < 2400000){
-				freqmonitor[cpu][4] += 1;
-			}
-			else if(average < 2600000){
-				freqmonitor[cpu][5] += 1;
-			}
-			else{
-				freqmonitor[cpu][6] += 1;
-			}
-			//if(cpu == 0)
-				//print_cpu_stats(average, C0_time, CX_time, c0_percent);
-			//printf("\n");
+			samples[cpu].khz = average;
+			samples[cpu].c0 = c0_percent;
+			samples[cpu].stamp = stamp;
+#ifdef TM_TRACE
+			trace_event(&freq_trace, TR_FREQ, c0_percent, cpu, average / 1000);
+#endif /* TM_TRACE */
 		}
-		//if (once)
-		//	break;
-		//printf("\n");
+		/* Publish outside of the reads so that readers barely retry */
+		ATOMIC_STORE(&freq_snapshot.seq, freq_snapshot.seq + 1);
+		ATOMIC_MB_WRITE;
+		memcpy(freq_snapshot.cpus, samples, cpus * sizeof (freq_sample_t));
+		ATOMIC_STORE_REL(&freq_snapshot.seq, freq_snapshot.seq + 1);
 	}
 
-
+	for (cpu = 0; cpu < cpus; cpu++) {
+		if (cpu_list[cpu].msr_fd >= 0)
+			close(cpu_list[cpu].msr_fd);
+		if (cpu_list[cpu].perf_fd >= 0) {
+			close(cpu_list[cpu].perf_ref_fd);
+			close(cpu_list[cpu].perf_fd);
+		}
+	}
+	free(samples);
+	free(cpu_list);
 	return 0;
 }
 
@@ -0,0 +1,261 @@
+/*
+ * File:
+ *   calibrate.h
+ * Description:
+ *   Calibration of the spin/sleep costs used by the adaptive backoff.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation, version 2
+ * of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#ifndef _CALIBRATE_H_
+#define _CALIBRATE_H_
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "stm_internal.h"
+
+#define CALIB_SPIN_ITERATIONS           (1UL << 22)
+#define CALIB_SAMPLES                   5
+#define CALIB_VERSION                   1
+#define CALIB_MAX_SPIN                  1000000             /* Bounds of cached values */
+#define CALIB_MAX_WAKEUP                100000
+#define CALIB_MIN_TSC_KHZ               100000
+#define CALIB_MAX_TSC_KHZ               100000000
+
+typedef struct calibration {            /* Machine-specific backoff constants */
+  int spintosleep;                      /* spin() iterations per microsecond */
+  int beta;                             /* Wake-up latency of nanosleep (microseconds) */
+  int park_beta;                        /* Wake-up latency of a futex timeout (microseconds) */
+  unsigned long tsc_khz;                /* TSC frequency */
+} calibration_t;
+
+/*
+ * Monotonic time in nanoseconds.
+ */
+static unsigned long long
+calib_now(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (unsigned long long)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/*
+ * Best of several runs of spin() (in iterations per microsecond).
+ */
+static int
+calib_spin(void)
+{
+  unsigned long long t, best = ~0ULL;
+  int i;
+
+  for (i = 0; i < CALIB_SAMPLES; i++) {
+    t = calib_now();
+    spin(CALIB_SPIN_ITERATIONS);
+    t = calib_now() - t;
+    if (t < best)
+      best = t;
+  }
+  if (best == 0)
+    return 1;
+  i = (int)((CALIB_SPIN_ITERATIONS * 1000ULL) / best);
+  return (i > 0 ? i : 1);
+}
+
+/*
+ * TSC ticks per millisecond (measured against the monotonic clock).
+ */
+static unsigned long
+calib_tsc(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+  unsigned long long t, c;
+  struct timespec ts = { 0, 20000000 };
+
+  t = calib_now();
+  c = __builtin_ia32_rdtsc();
+  nanosleep(&ts, NULL);
+  c = __builtin_ia32_rdtsc() - c;
+  t = calib_now() - t;
+  return (unsigned long)(c * 1000000ULL / t);
+#else /* ! (defined(__x86_64__) || defined(__i386__)) */
+  return 0;
+#endif /* ! (defined(__x86_64__) || defined(__i386__)) */
+}
+
+/*
+ * Median wake-up latency (in microseconds, rounded up) of nanosleep or
+ * of a futex timeout, over several requested durations.
+ */
+static int
+calib_wakeup(int futex)
+{
+  static const long durations[] = { 1, 10, 100, 1000 };
+  long lat[CALIB_SAMPLES * (sizeof(durations) / sizeof(durations[0]))], tmp;
+  unsigned long long t;
+  struct timespec ts;
+  int n, i, j, word = 0;
+
+  n = 0;
+  for (i = 0; i < sizeof(durations) / sizeof(durations[0]); i++) {
+    for (j = 0; j < CALIB_SAMPLES; j++) {
+      ts.tv_sec = 0;
+      ts.tv_nsec = durations[i] * 1000;
+      t = calib_now();
+      if (futex)
+        syscall(SYS_futex, &word, FUTEX_WAIT_PRIVATE, 0, &ts, NULL, 0);
+      else
+        nanosleep(&ts, NULL);
+      t = calib_now() - t;
+      lat[n++] = (long)(t / 1000) - durations[i];
+    }
+  }
+  /* Insertion sort (few samples) */
+  for (i = 1; i < n; i++) {
+    tmp = lat[i];
+    for (j = i; j > 0 && lat[j - 1] > tmp; j--)
+      lat[j] = lat[j - 1];
+    lat[j] = tmp;
+  }
+  return (lat[n / 2] > 0 ? (int)lat[n / 2] + 1 : 1);
+}
+
+/*
+ * Default location of the per-host cache file, in the cache directory
+ * of the user (return 0 if there is none).
+ */
+static int
+calib_path(char *path, size_t size)
+{
+  char host[64];
+  const char *s;
+  int n;
+
+  if ((s = getenv(CALIBRATION_FILE)) != NULL) {
+    snprintf(path, size, "%s", s);
+    return 1;
+  }
+  if (gethostname(host, sizeof(host)) != 0)
+    strcpy(host, "localhost");
+  host[sizeof(host) - 1] = '\0';
+  if ((s = getenv("XDG_CACHE_HOME")) != NULL && s[0] == '/') {
+    n = snprintf(path, size, "%s", s);
+  } else if ((s = getenv("HOME")) != NULL && s[0] == '/') {
+    n = snprintf(path, size, "%s/.cache", s);
+  } else {
+    return 0;
+  }
+  if (n < 0 || (size_t)n >= size)
+    return 0;
+  /* Private to the user if created here */
+  if (mkdir(path, 0700) != 0 && errno != EEXIST)
+    return 0;
+  n = snprintf(path + n, size - n, "/tinystm-calibration.%s", host);
+  return (n > 0 && (size_t)n < size);
+}
+
+/*
+ * Check that cached values are in the range of what calibration can
+ * measure (the file may have been edited or damaged).
+ */
+static int
+calib_valid(const calibration_t *c)
+{
+  return (c->spintosleep >= 1 && c->spintosleep <= CALIB_MAX_SPIN &&
+          c->beta >= 1 && c->beta <= CALIB_MAX_WAKEUP &&
+          c->park_beta >= 1 && c->park_beta <= CALIB_MAX_WAKEUP &&
+          (c->tsc_khz == 0 || (c->tsc_khz >= CALIB_MIN_TSC_KHZ && c->tsc_khz <= CALIB_MAX_TSC_KHZ)));
+}
+
+/*
+ * Load calibration from cache file (return 0 if missing, stale or not
+ * a regular file owned by the user).
+ */
+static int
+calib_load(const char *path, calibration_t *c)
+{
+  struct stat st;
+  FILE *f;
+  int fd, v, n;
+
+  if ((fd = open(path, O_RDONLY | O_NOFOLLOW)) < 0)
+    return 0;
+  if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode) || st.st_uid != getuid() ||
+      (st.st_mode & (S_IWGRP | S_IWOTH)) != 0 || (f = fdopen(fd, "r")) == NULL) {
+    close(fd);
+    return 0;
+  }
+  n = fscanf(f, "version=%d\nspintosleep=%d\nbeta=%d\npark_beta=%d\ntsc_khz=%lu\n",
+             &v, &c->spintosleep, &c->beta, &c->park_beta, &c->tsc_khz);
+  fclose(f);
+  return (n == 5 && v == CALIB_VERSION && calib_valid(c));
+}
+
+/*
+ * Save calibration to cache file (best effort).
+ */
+static void
+calib_save(const char *path, const calibration_t *c)
+{
+  char tmp[288];
+  FILE *f;
+  int fd;
+
+  /* Write a new file and rename it so that concurrent processes never see a partial file */
+  if (snprintf(tmp, sizeof(tmp), "%s.XXXXXX", path) >= (int)sizeof(tmp))
+    return;
+  if ((fd = mkstemp(tmp)) < 0)
+    return;
+  if ((f = fdopen(fd, "w")) == NULL) {
+    close(fd);
+    unlink(tmp);
+    return;
+  }
+  fprintf(f, "version=%d\nspintosleep=%d\nbeta=%d\npark_beta=%d\ntsc_khz=%lu\n",
+          CALIB_VERSION, c->spintosleep, c->beta, c->park_beta, c->tsc_khz);
+  if (fclose(f) != 0 || rename(tmp, path) != 0)
+    unlink(tmp);
+}
+
+/*
+ * Measure the costs of spinning and sleeping, or reuse the values
+ * cached by a previous run on the same host.
+ */
+static void
+calibrate(calibration_t *c)
+{
+  char path[256];
+
+  if (!calib_path(path, sizeof(path)))
+    path[0] = '\0';
+  if (path[0] != '\0' && calib_load(path, c)) {
+    PRINT_DEBUG("\tCalibration loaded from %s\n", path);
+    return;
+  }
+  c->spintosleep = calib_spin();
+  c->beta = calib_wakeup(0);
+  c->park_beta = calib_wakeup(1);
+  c->tsc_khz = calib_tsc();
+  if (path[0] != '\0') {
+    calib_save(path, c);
+    PRINT_DEBUG("\tCalibration saved to %s\n", path);
+  }
+}
+
+#endif /* _CALIBRATE_H_ */
@@ -0,0 +1,378 @@
+/*
+ * File:
+ *   dvfs.h
+ * Description:
+ *   Per-core DVFS actuation for asymmetric backoff (cpufreq sysfs).
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation, version 2
+ * of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#ifndef _DVFS_H_
+#define _DVFS_H_
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+
+#include "stm_internal.h"
+#include "topology.h"
+
+#ifndef CPUFREQ_SYSFS
+# define CPUFREQ_SYSFS                  "/sys/devices/system/cpu"
+#endif /* ! CPUFREQ_SYSFS */
+/* Used when cpufreq does not report the limits of a CPU (dry run) */
+#define DVFS_SLOW_KHZ                   1200000
+#define DVFS_FAST_KHZ                   2100000
+#define DVFS_EPP_SIZE                   32
+
+/* Fast cores are up-clocked and the other ones, whose threads back off
+ * exponentially (or that do not run any thread), are down-clocked.  The
+ * previous settings are restored by dvfs_close(). */
+typedef struct dvfs_backend {           /* DVFS actuation backend */
+  const char *name;
+  int (*open)(void);                    /* Save settings (0 if not available) */
+  int (*set_freq)(int cpu, unsigned long khz);
+  int (*set_epp)(int cpu, const char *epp);
+  void (*close)(void);                  /* Restore settings */
+} dvfs_backend_t;
+
+typedef struct dvfs_cpu {               /* Actuation state of a CPU */
+  unsigned long khz[2];                 /* Slow and fast frequencies */
+  unsigned long saved;                  /* Frequency setting to restore */
+  char saved_gov[DVFS_EPP_SIZE];        /* Governor to restore (setspeed) */
+  char saved_epp[DVFS_EPP_SIZE];        /* EPP to restore ("" if none) */
+  int fast;                             /* Current level (-1 if not set) */
+  unsigned long requested;              /* Last requested frequency (kHz) */
+  const char *requested_epp;            /* Last requested EPP */
+  unsigned long nb_requests;            /* Number of level changes */
+} dvfs_cpu_t;
+
+static const dvfs_backend_t *dvfs = NULL;
+static dvfs_cpu_t dvfs_cpus[MAX_CPUS];
+/* Energy performance preferences of slow and fast cores (if set) */
+static char dvfs_epp[2][DVFS_EPP_SIZE];
+static int dvfs_set_epp = 0;
+static pthread_mutex_t dvfs_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/*
+ * Read a string from a cpufreq file of a CPU (0 if not available).
+ */
+static int
+dvfs_read(int cpu, const char *file, char *buf, int size)
+{
+  char path[128];
+  FILE *f;
+  int ok;
+
+  snprintf(path, sizeof(path), CPUFREQ_SYSFS "/cpu%d/cpufreq/%s", cpu, file);
+  if ((f = fopen(path, "r")) == NULL)
+    return 0;
+  ok = (fgets(buf, size, f) != NULL);
+  fclose(f);
+  if (ok)
+    buf[strcspn(buf, "\n")] = '\0';
+  return ok;
+}
+
+/*
+ * Write a string to a cpufreq file of a CPU (0 if not permitted).
+ */
+static int
+dvfs_write(int cpu, const char *file, const char *val)
+{
+  char path[128];
+  FILE *f;
+  int ok;
+
+  snprintf(path, sizeof(path), CPUFREQ_SYSFS "/cpu%d/cpufreq/%s", cpu, file);
+  if ((f = fopen(path, "w")) == NULL)
+    return 0;
+  ok = (fputs(val, f) >= 0);
+  /* Sysfs reports invalid values when the buffer is flushed */
+  ok = (fclose(f) == 0 && ok);
+  return ok;
+}
+
+static unsigned long
+dvfs_read_khz(int cpu, const char *file)
+{
+  char buf[DVFS_EPP_SIZE];
+
+  return (dvfs_read(cpu, file, buf, sizeof(buf)) ? strtoul(buf, NULL, 10) : 0);
+}
+
+static int
+dvfs_write_khz(int cpu, const char *file, unsigned long khz)
+{
+  char buf[DVFS_EPP_SIZE];
+
+  snprintf(buf, sizeof(buf), "%lu", khz);
+  return dvfs_write(cpu, file, buf);
+}
+
+static int
+dvfs_sysfs_epp(int cpu, const char *epp)
+{
+  return dvfs_write(cpu, "energy_performance_preference", epp);
+}
+
+/* ################################################################### *
+ * SETSPEED (userspace governor)
+ * ################################################################### */
+
+static int
+dvfs_setspeed_freq(int cpu, unsigned long khz)
+{
+  return dvfs_write_khz(cpu, "scaling_setspeed", khz);
+}
+
+static void
+dvfs_setspeed_close(void)
+{
+  dvfs_cpu_t *c;
+  int i;
+
+  for (i = 0; i < topo_nb_cpus; i++) {
+    c = &dvfs_cpus[topo_cpus[i].cpu];
+    if (c->saved_gov[0] != '\0')
+      dvfs_write(topo_cpus[i].cpu, "scaling_governor", c->saved_gov);
+  }
+}
+
+static int
+dvfs_setspeed_open(void)
+{
+  dvfs_cpu_t *c;
+  int i, cpu;
+
+  for (i = 0; i < topo_nb_cpus; i++) {
+    cpu = topo_cpus[i].cpu;
+    c = &dvfs_cpus[cpu];
+    if (!dvfs_read(cpu, "scaling_governor", c->saved_gov, sizeof(c->saved_gov))
+        || !dvfs_write(cpu, "scaling_governor", "userspace")) {
+      c->saved_gov[0] = '\0';
+      dvfs_setspeed_close();
+      return 0;
+    }
+  }
+  return 1;
+}
+
+/* ################################################################### *
+ * MAXFREQ (cap of the current governor)
+ * ################################################################### */
+
+static int
+dvfs_maxfreq_freq(int cpu, unsigned long khz)
+{
+  return dvfs_write_khz(cpu, "scaling_max_freq", khz);
+}
+
+static void
+dvfs_maxfreq_close(void)
+{
+  dvfs_cpu_t *c;
+  int i;
+
+  for (i = 0; i < topo_nb_cpus; i++) {
+    c = &dvfs_cpus[topo_cpus[i].cpu];
+    if (c->saved != 0)
+      dvfs_write_khz(topo_cpus[i].cpu, "scaling_max_freq", c->saved);
+  }
+}
+
+static int
+dvfs_maxfreq_open(void)
+{
+  dvfs_cpu_t *c;
+  int i, cpu;
+
+  for (i = 0; i < topo_nb_cpus; i++) {
+    cpu = topo_cpus[i].cpu;
+    c = &dvfs_cpus[cpu];
+    /* Rewriting the current cap checks that we are permitted to */
+    if ((c->saved = dvfs_read_khz(cpu, "scaling_max_freq")) == 0
+        || !dvfs_write_khz(cpu, "scaling_max_freq", c->saved)) {
+      c->saved = 0;
+      dvfs_maxfreq_close();
+      return 0;
+    }
+  }
+  return 1;
+}
+
+/* ################################################################### *
+ * DRYRUN (only records the requests)
+ * ################################################################### */
+
+static int
+dvfs_dryrun_open(void)
+{
+  return 1;
+}
+
+static int
+dvfs_dryrun_freq(int cpu, unsigned long khz)
+{
+  return 1;
+}
+
+static int
+dvfs_dryrun_epp(int cpu, const char *epp)
+{
+  return 1;
+}
+
+static void
+dvfs_dryrun_close(void)
+{
+}
+
+static const dvfs_backend_t dvfs_backends[] = {
+  { "setspeed", dvfs_setspeed_open, dvfs_setspeed_freq, dvfs_sysfs_epp, dvfs_setspeed_close },
+  { "maxfreq", dvfs_maxfreq_open, dvfs_maxfreq_freq, dvfs_sysfs_epp, dvfs_maxfreq_close },
+  { "dryrun", dvfs_dryrun_open, dvfs_dryrun_freq, dvfs_dryrun_epp, dvfs_dryrun_close },
+  { NULL, NULL, NULL, NULL, NULL }
+};
+
+/* ################################################################### *
+ * ACTUATION
+ * ################################################################### */
+
+/*
+ * Move the CPUs whose fast-core status changed to their new level.
+ */
+static void
+dvfs_update(void)
+{
+  dvfs_cpu_t *c;
+  int i, cpu, fast;
+
+  if (dvfs == NULL)
+    return;
+  pthread_mutex_lock(&dvfs_lock);
+  for (i = 0; i < topo_nb_cpus; i++) {
+    cpu = topo_cpus[i].cpu;
+    c = &dvfs_cpus[cpu];
+    if ((fast = fast_core(cpu)) == c->fast)
+      continue;
+    c->fast = fast;
+    c->requested = c->khz[fast];
+    c->nb_requests++;
+    dvfs->set_freq(cpu, c->requested);
+    if (dvfs_set_epp) {
+      c->requested_epp = dvfs_epp[fast];
+      dvfs->set_epp(cpu, c->requested_epp);
+    }
+  }
+  pthread_mutex_unlock(&dvfs_lock);
+}
+
+/*
+ * Open the DVFS backend with the given name (return 0 if not available,
+ * 1 otherwise; no actuation if NULL).
+ */
+static int
+dvfs_open(const char *name)
+{
+  const dvfs_backend_t *b;
+  dvfs_cpu_t *c;
+  unsigned long slow = 0, fast = 0;
+  char *s;
+  int i, cpu;
+
+  if (name == NULL)
+    return 1;
+  for (b = dvfs_backends; b->name != NULL && strcasecmp(name, b->name) != 0; b++)
+    ;
+  if (b->name == NULL)
+    return 0;
+  /* Frequency override: "slow,fast" (kHz) */
+  if ((s = getenv(DVFS_FREQS)) != NULL && sscanf(s, "%lu,%lu", &slow, &fast) != 2) {
+    fprintf(stderr, "Error: invalid DVFS frequencies %s\n", s);
+    exit(1);
+  }
+  /* Preferences: "slow,fast" (e.g., "power,performance") */
+  if ((s = getenv(DVFS_EPP)) != NULL) {
+    if (sscanf(s, "%31[^,],%31s", dvfs_epp[0], dvfs_epp[1]) != 2) {
+      fprintf(stderr, "Error: invalid DVFS energy performance preferences %s\n", s);
+      exit(1);
+    }
+    dvfs_set_epp = 1;
+  }
+
+  for (i = 0; i < topo_nb_cpus; i++) {
+    cpu = topo_cpus[i].cpu;
+    c = &dvfs_cpus[cpu];
+    memset(c, 0, sizeof(*c));
+    c->fast = -1;
+    c->khz[0] = (slow != 0 ? slow : dvfs_read_khz(cpu, "cpuinfo_min_freq"));
+    c->khz[1] = (fast != 0 ? fast : dvfs_read_khz(cpu, "cpuinfo_max_freq"));
+    if (c->khz[0] == 0)
+      c->khz[0] = DVFS_SLOW_KHZ;
+    if (c->khz[1] == 0)
+      c->khz[1] = DVFS_FAST_KHZ;
+    if (dvfs_set_epp && !dvfs_read(cpu, "energy_performance_preference", c->saved_epp, sizeof(c->saved_epp)))
+      c->saved_epp[0] = '\0';
+  }
+  if (!b->open())
+    return 0;
+  dvfs = b;
+  return 1;
+}
+
+/*
+ * Print the requests of every CPU (to check a dry run).
+ */
+static void
+dvfs_report(void)
+{
+  dvfs_cpu_t *c;
+  int i;
+
+  if (dvfs == NULL)
+    return;
+  for (i = 0; i < topo_nb_cpus; i++) {
+    c = &dvfs_cpus[topo_cpus[i].cpu];
+    if (c->nb_requests == 0)
+      continue;
+    fprintf(stderr, "dvfs %s cpu %d:\t%lu kHz\t%s\t%lu requests\n", dvfs->name,
+            topo_cpus[i].cpu, c->requested, (c->requested_epp != NULL ? c->requested_epp : "-"),
+            c->nb_requests);
+  }
+}
+
+/*
+ * Restore the settings changed by the backend.
+ */
+static void
+dvfs_close(void)
+{
+  dvfs_cpu_t *c;
+  int i;
+
+  if (dvfs == NULL)
+    return;
+  pthread_mutex_lock(&dvfs_lock);
+  if (dvfs_set_epp) {
+    for (i = 0; i < topo_nb_cpus; i++) {
+      c = &dvfs_cpus[topo_cpus[i].cpu];
+      if (c->saved_epp[0] != '\0')
+        dvfs->set_epp(topo_cpus[i].cpu, c->saved_epp);
+    }
+  }
+  dvfs->close();
+  dvfs = NULL;
+  pthread_mutex_unlock(&dvfs_lock);
+}
+
+#endif /* _DVFS_H_ */
@@ -0,0 +1,366 @@
+/*
+ * File:
+ *   energy.h
+ * Description:
+ *   Energy sources for the Green-CM tuners (MSR RAPL, powercap, model).
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation, version 2
+ * of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#ifndef _ENERGY_H_
+#define _ENERGY_H_
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "stm_internal.h"
+#include "x86_energy.h"
+
+#ifndef POWERCAP_SYSFS
+# define POWERCAP_SYSFS                 "/sys/class/powercap"
+#endif /* ! POWERCAP_SYSFS */
+#define ES_MAX_PACKAGES                 64
+
+/* All backends report the average power since the previous get_power()
+ * call and the energy consumed since init_device(), per package. */
+typedef struct es_backend {             /* Energy source backend */
+  const char *name;
+  struct x86_energy_source *(*open)(void);
+} es_backend_t;
+
+typedef struct es_package {             /* Accumulated energy of a package */
+  double energy;                        /* Joules since init_device() */
+  double last_energy;                   /* Joules at previous get_power() */
+  double last_time;                     /* Seconds at previous get_power() */
+  double raw;                           /* Last raw counter (powercap) */
+} es_package_t;
+
+static es_package_t es_packages[ES_MAX_PACKAGES];
+
+/*
+ * Monotonic time in seconds.
+ */
+static double
+es_now(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/*
+ * Average power of a package since the previous call.
+ */
+static double
+es_power(int pkg, double energy)
+{
+  es_package_t *p = &es_packages[pkg];
+  double now, power;
+
+  now = es_now();
+  power = (now > p->last_time ? (energy - p->last_energy) / (now - p->last_time) : 0);
+  p->last_energy = energy;
+  p->last_time = now;
+  return power;
+}
+
+static int
+es_noop(void)
+{
+  return 0;
+}
+
+static int
+es_noop_device(int pkg)
+{
+  return 0;
+}
+
+/* ################################################################### *
+ * MSR RAPL (libx86_energy)
+ * ################################################################### */
+
+static struct x86_energy_source *
+es_msr_open(void)
+{
+  return get_available_sources();
+}
+
+/* ################################################################### *
+ * POWERCAP (/sys/class/powercap/intel-rapl:N, no privileges needed)
+ * ################################################################### */
+
+static int pc_nb_packages = 0;
+static int pc_zone[ES_MAX_PACKAGES];
+
+/*
+ * Read a counter of a package zone (-1 if not readable).
+ */
+static double
+pc_read(int pkg, const char *file)
+{
+  char path[128];
+  FILE *f;
+  double v;
+
+  snprintf(path, sizeof(path), POWERCAP_SYSFS "/intel-rapl:%d/%s", pc_zone[pkg], file);
+  if ((f = fopen(path, "r")) == NULL)
+    return -1;
+  if (fscanf(f, "%lf", &v) != 1)
+    v = -1;
+  fclose(f);
+  return v;
+}
+
+/*
+ * Accumulate the energy counter of a package (handles wrap-around).
+ */
+static double
+pc_energy(int pkg)
+{
+  es_package_t *p = &es_packages[pkg];
+  double raw, range;
+
+  if ((raw = pc_read(pkg, "energy_uj")) < 0)
+    return p->energy;
+  if (raw < p->raw) {
+    range = pc_read(pkg, "max_energy_range_uj");
+    p->energy += ((range > 0 ? range : p->raw) - p->raw + raw) / 1e6;
+  } else {
+    p->energy += (raw - p->raw) / 1e6;
+  }
+  p->raw = raw;
+  return p->energy;
+}
+
+static int
+pc_get_nr_packages(void)
+{
+  return pc_nb_packages;
+}
+
+static int
+pc_init_device(int pkg)
+{
+  es_package_t *p = &es_packages[pkg];
+
+  p->raw = pc_read(pkg, "energy_uj");
+  p->energy = p->last_energy = 0;
+  p->last_time = es_now();
+  return 0;
+}
+
+static double
+pc_get_power(int pkg)
+{
+  return es_power(pkg, pc_energy(pkg));
+}
+
+static double
+pc_get_energy(int pkg)
+{
+  return pc_energy(pkg);
+}
+
+static struct x86_energy_source pc_source = {
+  GRANULARITY_SOCKET, pc_get_nr_packages, es_noop, pc_init_device,
+  es_noop_device, es_noop, pc_get_power, pc_get_energy
+};
+
+static struct x86_energy_source *
+es_powercap_open(void)
+{
+  int zone;
+
+  pc_nb_packages = 0;
+  for (zone = 0; zone < ES_MAX_PACKAGES; zone++) {
+    pc_zone[pc_nb_packages] = zone;
+    /* Counters are root-only on some kernels: skip unreadable zones */
+    if (pc_read(pc_nb_packages, "energy_uj") < 0)
+      continue;
+    pc_nb_packages++;
+  }
+  return (pc_nb_packages > 0 ? &pc_source : NULL);
+}
+
+/* ################################################################### *
+ * SIMULATED (power model driven by backoff accounting)
+ * ################################################################### */
+
+typedef struct sim_model {              /* Power model (watts) */
+  double idle;                          /* Package static power */
+  double active;                        /* Thread running transactions */
+  double spin;                          /* Thread spinning in backoff */
+  double sleep;                         /* Thread sleeping in backoff */
+} sim_model_t;
+
+static sim_model_t sim_model = { 20.0, 8.0, 6.0, 0.5 };
+/* Spin iterations per microsecond (set from the calibration) */
+static int sim_spin_rate = 0;
+static int sim_opened = 0;
+static double sim_last_spun = 0;
+static double sim_last_slept = 0;
+static pthread_mutex_t sim_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/*
+ * Charge the time elapsed since the previous call to the model: threads
+ * are spinning or sleeping as accounted by the backoff, active otherwise
+ * (called with sim_lock held).  The totals come from the counter slabs,
+ * which are never freed and keep counting across thread exits.
+ */
+static double
+sim_charge(void)
+{
+  es_package_t *p = &es_packages[0];
+  double now, dt, spun = 0, slept = 0, d_spun, d_slept, active;
+  stats_slab_t *slab;
+  int i, n;
+
+  for (slab = _tinystm.stats; slab != NULL; slab = slab->next) {
+    for (i = 0; i < STATS_SLAB_SLOTS; i++) {
+      spun += ATOMIC_LOAD(&slab->slots[i].spun);
+      slept += ATOMIC_LOAD(&slab->slots[i].slept);
+    }
+  }
+  n = (int)ATOMIC_LOAD(&_tinystm.threads_nb);
+  /* The raw field holds the time of the previous charge */
+  now = es_now();
+  dt = (now - p->raw) * 1e6;
+  p->raw = now;
+  d_spun = spun - sim_last_spun;
+  d_slept = slept - sim_last_slept;
+  sim_last_spun = spun;
+  sim_last_slept = slept;
+  spun = (sim_spin_rate > 0 ? d_spun / sim_spin_rate : 0);
+  slept = d_slept;
+  active = n * dt - spun - slept;
+  if (active < 0)
+    active = 0;
+  p->energy += (sim_model.idle * dt + sim_model.active * active
+                + sim_model.spin * spun + sim_model.sleep * slept) / 1e6;
+  return p->energy;
+}
+
+static int
+sim_get_nr_packages(void)
+{
+  return 1;
+}
+
+static int
+sim_init_device(int pkg)
+{
+  es_package_t *p = &es_packages[pkg];
+
+  p->energy = p->last_energy = 0;
+  p->raw = p->last_time = es_now();
+  return 0;
+}
+
+static double
+sim_energy(void)
+{
+  double e;
+
+  pthread_mutex_lock(&sim_lock);
+  e = sim_charge();
+  pthread_mutex_unlock(&sim_lock);
+  return e;
+}
+
+static double
+sim_get_power(int pkg)
+{
+  return es_power(pkg, sim_energy());
+}
+
+static double
+sim_get_energy(int pkg)
+{
+  return sim_energy();
+}
+
+static struct x86_energy_source sim_source = {
+  GRANULARITY_SYSTEM, sim_get_nr_packages, es_noop, sim_init_device,
+  es_noop_device, es_noop, sim_get_power, sim_get_energy
+};
+
+static struct x86_energy_source *
+es_sim_open(void)
+{
+  char *s;
+
+  /* Model override: "idle,active,spin,sleep" (watts) */
+  if ((s = getenv(ENERGY_SIM_MODEL)) != NULL
+      && sscanf(s, "%lf,%lf,%lf,%lf", &sim_model.idle, &sim_model.active,
+                &sim_model.spin, &sim_model.sleep) != 4) {
+    fprintf(stderr, "Error: invalid energy model %s\n", s);
+    exit(1);
+  }
+  sim_opened = 1;
+  return &sim_source;
+}
+
+/*
+ * Charge the model when the number of threads changes: before a new
+ * thread registers, and before an exiting thread takes its counters
+ * out of the sums.
+ */
+static void
+energy_thread_change(stm_tx_t *tx)
+{
+  if (!sim_opened)
+    return;
+  pthread_mutex_lock(&sim_lock);
+  sim_charge();
+#ifdef GREEN_BACKOFF
+  if (tx != NULL) {
+    sim_last_spun -= tx->bo_spun;
+    sim_last_slept -= tx->bo_slept;
+  }
+#endif /* GREEN_BACKOFF */
+  pthread_mutex_unlock(&sim_lock);
+}
+
+/* Probed in order by "auto" (the model always succeeds) */
+static const es_backend_t es_backends[] = {
+  { "msr", es_msr_open },
+  { "powercap", es_powercap_open },
+  { "sim", es_sim_open },
+  { NULL, NULL }
+};
+
+/*
+ * Open the energy source with the given name, or the first available
+ * one if NULL or "auto" (return NULL if not available).
+ */
+static struct x86_energy_source *
+energy_open(const char *name, const char **opened)
+{
+  struct x86_energy_source *s;
+  int i;
+
+  for (i = 0; es_backends[i].name != NULL; i++) {
+    if (name != NULL && strcasecmp(name, "auto") != 0 && strcasecmp(name, es_backends[i].name) != 0)
+      continue;
+    if ((s = es_backends[i].open()) != NULL) {
+      *opened = es_backends[i].name;
+      return s;
+    }
+  }
+  return NULL;
+}
+
+#endif /* _ENERGY_H_ */
@@ -26,6 +26,7 @@
 #include <assert.h>
 #include <stdio.h>
 #include <stdint.h>
+#include <unistd.h>
 
 #include <pthread.h>
 
@@ -35,7 +36,19 @@
 #include "atomic.h"
 #include "stm.h"
 
-/* TODO: could be made much more efficient by allocating large chunks. */
+/*
+ * Each thread keeps the blocks it frees in a queue of bags (arrays of
+ * addresses tagged with the latest epoch of their blocks).  When the
+ * bags hold more than GC_LIMBO_BYTES, the thread releases those whose
+ * epoch precedes the start of all active transactions.  That lower
+ * bound is cached and only recomputed (by one thread at a time, over
+ * the slots in use) when it is too old to release the oldest bag.
+ * Bags of exited threads go to a shared stack, which is drained by the
+ * threads that clean up or, if GC_RECLAIMER is set to a period in
+ * microseconds, by a background thread to which the threads hand off
+ * all their bags.  Released blocks are passed to a function set with
+ * gc_set_release (free by default).
+ */
 
 /* ################################################################### *
  * DEFINES
@@ -43,12 +56,12 @@
 
 #define MAX_GC_THREADS                  1024
 #define EPOCH_MAX                       (~(gc_word_t)0)
-
-#ifndef NO_PERIODIC_CLEANUP
-# ifndef CLEANUP_FREQUENCY
-#  define CLEANUP_FREQUENCY             1
-# endif /* ! CLEANUP_FREQUENCY */
-#endif /* ! NO_PERIODIC_CLEANUP */
+#define GC_BAG_SIZE                     252                 /* Blocks per bag (bag of about 2 KB) */
+#define GC_BLOCK_SIZE                   64                  /* Size assumed for blocks freed without size */
+#ifndef GC_LIMBO_BYTES
+# define GC_LIMBO_BYTES                 (1 << 20)           /* Bytes freed by a thread between cleanups */
+#endif /* ! GC_LIMBO_BYTES */
+#define GC_RECLAIMER                    "GC_RECLAIMER"
 
 #ifdef DEBUG
 /* Note: stdio is thread-safe */
@@ -66,32 +79,27 @@
 enum {                                  /* Descriptor status */
   GC_NULL = 0,
   GC_BUSY = 1,
-  GC_FREE_EMPTY = 2,
-  GC_FREE_FULL = 3
+  GC_FREE = 2
 };
 
-typedef struct gc_block {               /* Block of allocated memory */
-  void *addr;                           /* Address of memory */
-  struct gc_block *next;                /* Next block */
-} gc_block_t;
-
-typedef struct gc_region {              /* A list of allocated memory blocks */
-  struct gc_block *blocks;              /* Memory blocks */
-  gc_word_t ts;                         /* Allocation timestamp */
-  struct gc_region *next;               /* Next region */
-} gc_region_t;
+typedef struct gc_bag {                 /* Blocks freed by a thread */
+  struct gc_bag *next;                  /* Next bag */
+  gc_word_t ts;                         /* Latest epoch of the blocks */
+  size_t bytes;                         /* Size of the blocks */
+  unsigned int nb;                      /* Number of blocks */
+  void *addrs[GC_BAG_SIZE];             /* Addresses of the blocks */
+} gc_bag_t;
 
 typedef struct gc_thread {              /* Descriptor of an active thread */
   union {                               /* For padding... */
     struct {
       gc_word_t used;                   /* Is this entry used? */
-      pthread_t thread;                 /* Thread descriptor */
       gc_word_t ts;                     /* Start timestamp */
-      gc_region_t *head;                /* First memory region(s) assigned to thread */
-      gc_region_t *tail;                /* Last memory region(s) assigned to thread */
-#ifndef NO_PERIODIC_CLEANUP
-      unsigned int frees;               /* How many blocks have been freed? */
-#endif /* ! NO_PERIODIC_CLEANUP */
+      gc_bag_t *head;                   /* Oldest bag */
+      gc_bag_t *tail;                   /* Bag being filled */
+      gc_bag_t *spare;                  /* Empty bag kept for reuse */
+      size_t bytes;                     /* Size of the blocks in the bags */
+      size_t limit;                     /* Size that triggers a cleanup */
     };
     char padding[CACHELINE_SIZE];       /* Padding (should be at least a cache line) */
   };
@@ -100,6 +108,16 @@ typedef struct gc_thread {              /* Descriptor of an active thread */
 static struct {                         /* Descriptors of active threads */
   volatile gc_thread_t *slots;          /* Array of thread slots */
   volatile gc_word_t nb_active;         /* Number of used thread slots */
+  volatile gc_word_t nb_slots;          /* Number of slots ever used (lowest free slots are reused first) */
+  char padding[CACHELINE_SIZE];
+  volatile gc_word_t min;               /* Cached lower bound on the start time of active transactions */
+  volatile gc_word_t scanning;          /* Is a thread recomputing the lower bound? */
+  gc_bag_t *volatile orphans;           /* Bags of exited threads or handed off to the reclaimer */
+  void (*release)(void **, unsigned int); /* Called on the blocks that can be reused */
+  pthread_mutex_t lock;                 /* Serializes the reclaimer with reset and exit */
+  unsigned long period;                 /* Period of the reclaimer (us, 0 if none) */
+  pthread_t reclaimer;                  /* Background reclaimer */
+  volatile int stop;                    /* Stop the reclaimer? */
 } gc_threads;
 
 static gc_word_t (*gc_current_epoch)(void); /* Read the value of the current epoch */
@@ -121,18 +139,17 @@ static inline int gc_get_idx(void)
  */
 static inline gc_word_t gc_compute_min(gc_word_t now)
 {
-  int i;
+  gc_word_t i, n;
   gc_word_t min, ts;
-  stm_word_t used;
 
-  PRINT_DEBUG("==> gc_compute_min(%d)\n", gc_get_idx());
+  PRINT_DEBUG("==> gc_compute_min()\n");
 
   min = now;
-  for (i = 0; i < MAX_GC_THREADS; i++) {
-    used = (gc_word_t)ATOMIC_LOAD(&gc_threads.slots[i].used);
-    if (used == GC_NULL)
-      break;
-    if (used != GC_BUSY)
+  /* Slots are read after the clock (see gc_set_epoch) */
+  ATOMIC_MB_READ;
+  n = ATOMIC_LOAD(&gc_threads.nb_slots);
+  for (i = 0; i < n && i < MAX_GC_THREADS; i++) {
+    if ((gc_word_t)ATOMIC_LOAD(&gc_threads.slots[i].used) != GC_BUSY)
       continue;
     /* Used entry */
     ts = (gc_word_t)ATOMIC_LOAD(&gc_threads.slots[i].ts);
@@ -140,67 +157,171 @@ static inline gc_word_t gc_compute_min(gc_word_t now)
       min = ts;
   }
 
-  PRINT_DEBUG("==> gc_compute_min(%d,m=%lu)\n", gc_get_idx(), (unsigned long)min);
+  PRINT_DEBUG("==> gc_compute_min(m=%lu)\n", (unsigned long)min);
 
   return min;
 }
 
 /*
- * Free block list.
+ * Lower bound on the start time of active transactions, recomputed only
+ * if the cached one does not exceed ts.  A transaction publishes the
+ * current epoch before reading its start time (see gc_set_epoch), and
+ * the clock only grows, so a bound remains valid until the next reset.
  */
-static inline void gc_clean_blocks(gc_block_t *mb)
+static gc_word_t gc_get_min(gc_word_t ts)
 {
-  gc_block_t *next_mb;
-
-  while (mb != NULL) {
-    PRINT_DEBUG("==> free(%d,a=%p)\n", gc_get_idx(), mb->addr);
-    free(mb->addr);
-    next_mb = mb->next;
-    free(mb);
-    mb = next_mb;
+  gc_word_t min, m;
+
+  min = ATOMIC_LOAD(&gc_threads.min);
+  if (min > ts)
+    return min;
+  /* A single thread recomputes the bound, the others keep the cached one */
+  if (ATOMIC_LOAD(&gc_threads.scanning) != 0 || ATOMIC_CAS_FULL(&gc_threads.scanning, 0, 1) == 0)
+    return min;
+  m = gc_compute_min(gc_current_epoch());
+  if (m > min) {
+    ATOMIC_STORE(&gc_threads.min, m);
+    min = m;
+  }
+  ATOMIC_STORE(&gc_threads.scanning, 0);
+  return min;
+}
+
+static void gc_release_free(void **addrs, unsigned int nb)
+{
+  unsigned int i;
+
+  for (i = 0; i < nb; i++) {
+    PRINT_DEBUG("==> free(a=%p)\n", addrs[i]);
+    free(addrs[i]);
   }
 }
 
 /*
- * Free region list.
+ * Release the blocks of a bag and the bag itself.
  */
-static inline void gc_clean_regions(gc_region_t *mr)
+static inline void gc_release_bag(gc_bag_t *b)
 {
-  gc_region_t *next_mr;
+  if (b->nb > 0)
+    gc_threads.release(b->addrs, b->nb);
+  free(b);
+}
+
+/*
+ * Push a list of bags on the shared stack.
+ */
+static void gc_push(gc_bag_t *first, gc_bag_t *last)
+{
+  gc_bag_t *top;
+
+  do {
+    top = (gc_bag_t *)ATOMIC_LOAD(&gc_threads.orphans);
+    last->next = top;
+  } while (ATOMIC_CAS_FULL(&gc_threads.orphans, top, first) == 0);
+}
 
-  while (mr != NULL) {
-    gc_clean_blocks(mr->blocks);
-    next_mr = mr->next;
-    free(mr);
-    mr = next_mr;
+/*
+ * Release the bags of the shared stack that are older than min and put
+ * back the others.
+ */
+static void gc_collect_orphans(gc_word_t min)
+{
+  gc_bag_t *b, *next, *first, *last;
+
+  do {
+    b = (gc_bag_t *)ATOMIC_LOAD(&gc_threads.orphans);
+  } while (b != NULL && ATOMIC_CAS_FULL(&gc_threads.orphans, b, NULL) == 0);
+  first = last = NULL;
+  for (; b != NULL; b = next) {
+    next = b->next;
+    if (min > b->ts) {
+      gc_release_bag(b);
+    } else {
+      if (last == NULL)
+        last = b;
+      b->next = first;
+      first = b;
+    }
   }
+  if (first != NULL)
+    gc_push(first, last);
 }
 
 /*
  * Garbage-collect old data associated with a thread.
  */
-void gc_cleanup_thread(int idx, gc_word_t min)
+static void gc_cleanup_thread(volatile gc_thread_t *t)
 {
-  gc_region_t *mr;
+  gc_bag_t *b;
+  gc_word_t min;
 
-  PRINT_DEBUG("==> gc_cleanup_thread(%d,m=%lu)\n", idx, (unsigned long)min);
+  PRINT_DEBUG("==> gc_cleanup_thread(%lu)\n", (unsigned long)t->bytes);
 
-  if (gc_threads.slots[idx].head == NULL) {
-    /* Nothing to clean up */
-    return;
+  min = gc_get_min(t->head == NULL ? 0 : t->head->ts);
+  while ((b = t->head) != NULL && min > b->ts) {
+    t->head = b->next;
+    t->bytes -= b->bytes;
+    if (t->spare == NULL) {
+      gc_threads.release(b->addrs, b->nb);
+      t->spare = b;
+    } else {
+      gc_release_bag(b);
+    }
   }
+  if (t->head == NULL)
+    t->tail = NULL;
+  /* Blocks held back by slow transactions are not scanned again before more are freed */
+  t->limit = t->bytes + GC_LIMBO_BYTES;
+  if ((gc_bag_t *)ATOMIC_LOAD(&gc_threads.orphans) != NULL)
+    gc_collect_orphans(min);
+}
 
-  while (min > gc_threads.slots[idx].head->ts) {
-    gc_clean_blocks(gc_threads.slots[idx].head->blocks);
-    mr = gc_threads.slots[idx].head->next;
-    free(gc_threads.slots[idx].head);
-    gc_threads.slots[idx].head = mr;
-    if(mr == NULL) {
-      /* All memory regions deleted */
-      gc_threads.slots[idx].tail = NULL;
-      break;
+/*
+ * Give the bags of a thread to the shared stack.
+ */
+static void gc_handoff(volatile gc_thread_t *t)
+{
+  if (t->head != NULL)
+    gc_push(t->head, t->tail);
+  t->head = t->tail = NULL;
+  t->bytes = 0;
+}
+
+/*
+ * Background reclaimer.
+ */
+static void *gc_reclaimer(void *arg)
+{
+  while (ATOMIC_LOAD(&gc_threads.stop) == 0) {
+    usleep(gc_threads.period);
+    pthread_mutex_lock(&gc_threads.lock);
+    if ((gc_bag_t *)ATOMIC_LOAD(&gc_threads.orphans) != NULL)
+      gc_collect_orphans(gc_get_min(EPOCH_MAX - 1));
+    pthread_mutex_unlock(&gc_threads.lock);
+  }
+  return NULL;
+}
+
+/*
+ * Release all bags (no transaction must be active).
+ */
+static void gc_release_all(void)
+{
+  volatile gc_thread_t *t;
+  gc_bag_t *b;
+  gc_word_t i;
+
+  for (i = 0; i < gc_threads.nb_slots && i < MAX_GC_THREADS; i++) {
+    t = &gc_threads.slots[i];
+    while ((b = t->head) != NULL) {
+      t->head = b->next;
+      gc_release_bag(b);
     }
+    t->tail = NULL;
+    t->bytes = 0;
+    t->limit = GC_LIMBO_BYTES;
   }
+  gc_collect_orphans(EPOCH_MAX);
 }
 
 /* ################################################################### *
@@ -213,6 +334,7 @@ void gc_cleanup_thread(int idx, gc_word_t min)
 void gc_init(gc_word_t (*epoch)(void))
 {
   int i;
+  char *s;
 
   PRINT_DEBUG("==> gc_init()\n");
 
@@ -224,12 +346,26 @@ void gc_init(gc_word_t (*epoch)(void))
   for (i = 0; i < MAX_GC_THREADS; i++) {
     gc_threads.slots[i].used = GC_NULL;
     gc_threads.slots[i].ts = EPOCH_MAX;
-    gc_threads.slots[i].head = gc_threads.slots[i].tail = NULL;
-#ifndef NO_PERIODIC_CLEANUP
-    gc_threads.slots[i].frees = 0;
-#endif /* ! NO_PERIODIC_CLEANUP */
+    gc_threads.slots[i].head = gc_threads.slots[i].tail = gc_threads.slots[i].spare = NULL;
+    gc_threads.slots[i].bytes = 0;
+    gc_threads.slots[i].limit = GC_LIMBO_BYTES;
   }
   gc_threads.nb_active = 0;
+  gc_threads.nb_slots = 0;
+  gc_threads.min = 0;
+  gc_threads.scanning = 0;
+  gc_threads.orphans = NULL;
+  gc_threads.release = gc_release_free;
+  pthread_mutex_init(&gc_threads.lock, NULL);
+  gc_threads.stop = 0;
+  gc_threads.period = 0;
+  if ((s = getenv(GC_RECLAIMER)) != NULL && atol(s) > 0) {
+    gc_threads.period = atol(s);
+    if (pthread_create(&gc_threads.reclaimer, NULL, gc_reclaimer, NULL) != 0) {
+      perror("pthread_create");
+      gc_threads.period = 0;
+    }
+  }
 }
 
 /*
@@ -246,20 +382,36 @@ void gc_exit(void)
     fprintf(stderr, "Error: some threads have not been cleaned up\n");
     exit(1);
   }
+  if (gc_threads.period != 0) {
+    ATOMIC_STORE(&gc_threads.stop, 1);
+    pthread_join(gc_threads.reclaimer, NULL);
+    gc_threads.period = 0;
+  }
   /* Clean up memory */
+  gc_release_all();
   for (i = 0; i < MAX_GC_THREADS; i++)
-    gc_clean_regions(gc_threads.slots[i].head);
+    free(gc_threads.slots[i].spare);
+  pthread_mutex_destroy(&gc_threads.lock);
 
   free((void *)gc_threads.slots);
 }
 
+/*
+ * Set the function that releases the blocks that are no longer
+ * accessed (free by default).  It may be called by any thread.
+ */
+void gc_set_release(void (*release)(void **addrs, unsigned int nb))
+{
+  gc_threads.release = (release != NULL ? release : gc_release_free);
+}
+
 /*
  * Initialize thread-specific GC resources (to be called once by each thread).
  */
 void gc_init_thread(void)
 {
-  int i, idx;
-  gc_word_t used;
+  gc_word_t i, n;
+  int idx;
 
   PRINT_DEBUG("==> gc_init_thread()\n");
 
@@ -267,24 +419,32 @@ void gc_init_thread(void)
     fprintf(stderr, "Error: too many concurrent threads created\n");
     exit(1);
   }
-  /* Find entry in threads array */
-  i = 0;
-  /* TODO: not wait-free */
-  while (1) {
-    used = (gc_word_t)ATOMIC_LOAD(&gc_threads.slots[i].used);
-    if (used != GC_BUSY) {
-      if (ATOMIC_CAS_FULL(&gc_threads.slots[i].used, used, GC_BUSY) != 0) {
-        idx = i;
-        /* Sets lower bound to EPOCH_MAX (thread will need to set correct timestamp before first transaction) */
-        ATOMIC_STORE(&gc_threads.slots[idx].ts, EPOCH_MAX);
-        break;
+  /* Reuse the lowest free slot to keep the scanned range short */
+  idx = -1;
+  n = ATOMIC_LOAD(&gc_threads.nb_slots);
+  for (i = 0; i < n && i < MAX_GC_THREADS; i++) {
+    if ((gc_word_t)ATOMIC_LOAD(&gc_threads.slots[i].used) == GC_FREE
+        && ATOMIC_CAS_FULL(&gc_threads.slots[i].used, GC_FREE, GC_BUSY) != 0) {
+      idx = i;
+      break;
+    }
+  }
+  if (idx < 0) {
+    /* At most MAX_GC_THREADS threads are active, so a slot is free past the last one */
+    while ((i = ATOMIC_FETCH_INC_FULL(&gc_threads.nb_slots)) >= MAX_GC_THREADS) {
+      /* All slots have been used: look for a free one again */
+      for (i = 0; i < MAX_GC_THREADS; i++) {
+        if ((gc_word_t)ATOMIC_LOAD(&gc_threads.slots[i].used) == GC_FREE
+            && ATOMIC_CAS_FULL(&gc_threads.slots[i].used, GC_FREE, GC_BUSY) != 0)
+          goto found;
       }
-      /* CAS failed: another thread must have acquired slot */
-      assert (gc_threads.slots[i].used != GC_NULL);
     }
-    if (++i >= MAX_GC_THREADS)
-      i = 0;
+    ATOMIC_STORE(&gc_threads.slots[i].used, GC_BUSY);
+ found:
+    idx = i;
   }
+  /* Sets lower bound to EPOCH_MAX (thread will need to set correct timestamp before first transaction) */
+  ATOMIC_STORE(&gc_threads.slots[idx].ts, EPOCH_MAX);
   tls_set_gc(idx);
 
   PRINT_DEBUG("==> gc_init_thread(i=%d)\n", idx);
@@ -296,21 +456,25 @@ void gc_init_thread(void)
 void gc_exit_thread(void)
 {
   int idx = gc_get_idx();
-  /* NOTA: if gc_exit_thread is not called when it finishes, others threads will not free chunks. */
+  volatile gc_thread_t *t = &gc_threads.slots[idx];
 
   PRINT_DEBUG("==> gc_exit_thread(%d)\n", idx);
 
   /* No more lower bound for this thread */
-  ATOMIC_STORE(&gc_threads.slots[idx].ts, EPOCH_MAX);
+  ATOMIC_STORE(&t->ts, EPOCH_MAX);
+  /* Leave memory to the other threads or the reclaimer */
+  gc_handoff(t);
+  free(t->spare);
+  t->spare = NULL;
+  t->limit = GC_LIMBO_BYTES;
   /* Release slot */
-  ATOMIC_STORE(&gc_threads.slots[idx].used, gc_threads.slots[idx].head == NULL ? GC_FREE_EMPTY : GC_FREE_FULL);
+  ATOMIC_STORE(&t->used, GC_FREE);
   ATOMIC_FETCH_DEC_FULL(&gc_threads.nb_active);
-  /* Leave memory for next thread to cleanup */
 }
 
 /*
- * Set new epoch (to be called by each thread, typically when starting
- * new transactions to indicate their start timestamp).
+ * Set new epoch (to be called by each thread when starting a new
+ * transaction, with a full fence before it reads its start timestamp).
  */
 void gc_set_epoch(gc_word_t epoch)
 {
@@ -324,54 +488,65 @@ void gc_set_epoch(gc_word_t epoch)
     return;
   }
 
-  /* Do not need a barrier as we only compute lower bounds */
   ATOMIC_STORE(&gc_threads.slots[idx].ts, epoch);
 }
 
 /*
- * Free memory (the thread must indicate the current timestamp).
+ * Remove the lower bound of the thread (to be called when a transaction
+ * ends, so that idle threads do not hold back collection).
+ */
+void gc_clear_epoch(void)
+{
+  ATOMIC_STORE(&gc_threads.slots[gc_get_idx()].ts, EPOCH_MAX);
+}
+
+/*
+ * Free memory (the thread must indicate the current timestamp and, if
+ * known, the size of the block).
  */
-void gc_free(void *addr, gc_word_t epoch)
+void gc_free(void *addr, size_t size, gc_word_t epoch)
 {
-  gc_region_t *mr;
-  gc_block_t *mb;
+  volatile gc_thread_t *t;
+  gc_bag_t *b;
   int idx = gc_get_idx();
 
   PRINT_DEBUG("==> gc_free(%d,%lu)\n", idx, (unsigned long)epoch);
 
-  if (gc_threads.slots[idx].head == NULL || gc_threads.slots[idx].head->ts < epoch) {
-    /* Allocate a new region */
-    if ((mr = (gc_region_t *)malloc(sizeof(gc_region_t))) == NULL) {
+  t = &gc_threads.slots[idx];
+  b = t->tail;
+  if (b == NULL || b->nb == GC_BAG_SIZE) {
+    /* Start a new bag */
+    if ((b = t->spare) != NULL) {
+      t->spare = NULL;
+    } else if ((b = (gc_bag_t *)malloc(sizeof(gc_bag_t))) == NULL) {
       perror("malloc");
       exit(1);
     }
-    mr->ts = epoch;
-    mr->blocks = NULL;
-    mr->next = NULL;
-    if (gc_threads.slots[idx].head == NULL) {
-      gc_threads.slots[idx].head = gc_threads.slots[idx].tail = mr;
-    } else {
-      gc_threads.slots[idx].tail->next = mr;
-      gc_threads.slots[idx].tail = mr;
-    }
-  } else {
-    /* Add to current region */
-    mr = gc_threads.slots[idx].head;
-  }
-
-  /* Allocate block */
-  if ((mb = (gc_block_t *)malloc(sizeof(gc_block_t))) == NULL) {
-    perror("malloc");
-    exit(1);
+    b->next = NULL;
+    b->ts = epoch;
+    b->bytes = 0;
+    b->nb = 0;
+    if (t->tail == NULL)
+      t->head = b;
+    else
+      t->tail->next = b;
+    t->tail = b;
   }
-  mb->addr = addr;
-  mb->next = mr->blocks;
-  mr->blocks = mb;
+  b->addrs[b->nb++] = addr;
+  if (epoch > b->ts)
+    b->ts = epoch;
+  if (size == 0)
+    size = GC_BLOCK_SIZE;
+  b->bytes += size;
+  t->bytes += size;
 
 #ifndef NO_PERIODIC_CLEANUP
-  gc_threads.slots[idx].frees++;
-  if (gc_threads.slots[idx].frees % CLEANUP_FREQUENCY == 0)
-    gc_cleanup();
+  if (t->bytes >= t->limit) {
+    if (gc_threads.period != 0)
+      gc_handoff(t);
+    else
+      gc_cleanup_thread(t);
+  }
 #endif /* ! NO_PERIODIC_CLEANUP */
 }
 
@@ -381,44 +556,28 @@ void gc_free(void *addr, gc_word_t epoch)
  */
 void gc_cleanup(void)
 {
-  gc_word_t min;
   int idx = gc_get_idx();
 
   PRINT_DEBUG("==> gc_cleanup(%d)\n", idx);
 
-  if (gc_threads.slots[idx].head == NULL) {
+  if (gc_threads.slots[idx].head == NULL && (gc_bag_t *)ATOMIC_LOAD(&gc_threads.orphans) == NULL) {
     /* Nothing to clean up */
     return;
   }
 
-  min = gc_compute_min(gc_current_epoch());
-
-  gc_cleanup_thread(idx, min);
+  gc_cleanup_thread(&gc_threads.slots[idx]);
 }
 
 /*
- * Garbage-collect old data associated with all threads (should be
- * called periodically).
+ * Garbage-collect old data left by exited threads (should be called
+ * periodically).
  */
 void gc_cleanup_all(void)
 {
-  int i;
-  gc_word_t min = EPOCH_MAX;
-
   PRINT_DEBUG("==> gc_cleanup_all()\n");
 
-  for (i = 0; i < MAX_GC_THREADS; i++) {
-    if ((gc_word_t)ATOMIC_LOAD(&gc_threads.slots[i].used) == GC_NULL)
-      break;
-    if ((gc_word_t)ATOMIC_LOAD(&gc_threads.slots[i].used) == GC_FREE_FULL) {
-      if (ATOMIC_CAS_FULL(&gc_threads.slots[i].used, GC_FREE_FULL, GC_BUSY) != 0) {
-        if (min == EPOCH_MAX)
-          min = gc_compute_min(gc_current_epoch());
-        gc_cleanup_thread(i, min);
-        ATOMIC_STORE(&gc_threads.slots[i].used, gc_threads.slots[i].head == NULL ? GC_FREE_EMPTY : GC_FREE_FULL);
-      }
-    }
-  }
+  if ((gc_bag_t *)ATOMIC_LOAD(&gc_threads.orphans) != NULL)
+    gc_collect_orphans(gc_get_min(EPOCH_MAX - 1));
 }
 
 /*
@@ -427,18 +586,14 @@ void gc_cleanup_all(void)
  */
 void gc_reset(void)
 {
-  int i;
+  gc_word_t i;
 
   PRINT_DEBUG("==> gc_reset()\n");
 
-  for (i = 0; i < MAX_GC_THREADS; i++) {
-    if (gc_threads.slots[i].used == GC_NULL)
-      break;
-    gc_clean_regions(gc_threads.slots[i].head);
+  pthread_mutex_lock(&gc_threads.lock);
+  gc_release_all();
+  for (i = 0; i < gc_threads.nb_slots && i < MAX_GC_THREADS; i++)
     gc_threads.slots[i].ts = EPOCH_MAX;
-    gc_threads.slots[i].head = gc_threads.slots[i].tail = NULL;
-#ifndef NO_PERIODIC_CLEANUP
-    gc_threads.slots[i].frees = 0;
-#endif /* ! NO_PERIODIC_CLEANUP */
-  }
+  gc_threads.min = 0;
+  pthread_mutex_unlock(&gc_threads.lock);
 }
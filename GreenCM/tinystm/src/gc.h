@@ -42,8 +42,11 @@ void gc_init_thread(void);
 void gc_exit_thread(void);
 
 void gc_set_epoch(gc_word_t epoch);
+void gc_clear_epoch(void);
 
-void gc_free(void *addr, gc_word_t epoch);
+void gc_free(void *addr, size_t size, gc_word_t epoch);
+
+void gc_set_release(void (*release)(void **addrs, unsigned int nb));
 
 void gc_cleanup(void);
 
@@ -0,0 +1,88 @@
+/*
+ * File:
+ *   hist.h
+ * Description:
+ *   Log-linear histograms (stm_hist_t).
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation, version 2
+ * of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#ifndef _HIST_H_
+#define _HIST_H_
+
+#include <stm.h>
+
+#include "utils.h"
+
+/*
+ * Values below 2^(S+1) (S = STM_HIST_SUB_BITS) have a bucket of their
+ * own.  Above, a value with its highest bit at position e is shifted
+ * right by e - S, keeping its top S + 1 bits: bucket (e - S) * 2^S + top
+ * covers 2^(e - S) consecutive values.
+ */
+
+/*
+ * Record a value (no branch).
+ */
+static INLINE void
+hist_record(stm_hist_t *h, unsigned long long v)
+{
+  unsigned int shift = 63 - __builtin_clzll(v | (1ULL << STM_HIST_SUB_BITS)) - STM_HIST_SUB_BITS;
+
+  h->buckets[(shift << STM_HIST_SUB_BITS) + (v >> shift)]++;
+  h->count++;
+  h->sum += v;
+  h->max = (v > h->max ? v : h->max);
+}
+
+/*
+ * Largest value of a bucket.
+ */
+static inline unsigned long long
+hist_bucket_max(unsigned int i)
+{
+  unsigned int shift = (i >> STM_HIST_SUB_BITS) > 0 ? (i >> STM_HIST_SUB_BITS) - 1 : 0;
+
+  return ((unsigned long long)(i - (shift << STM_HIST_SUB_BITS)) << shift) + (1ULL << shift) - 1;
+}
+
+static inline void
+hist_merge(stm_hist_t *dst, const stm_hist_t *src)
+{
+  unsigned int i;
+
+  dst->count += src->count;
+  dst->sum += src->sum;
+  if (dst->max < src->max)
+    dst->max = src->max;
+  for (i = 0; i < STM_HIST_BUCKETS; i++)
+    dst->buckets[i] += src->buckets[i];
+}
+
+static inline unsigned long long
+hist_percentile(const stm_hist_t *h, double p)
+{
+  unsigned long long rank, n;
+  unsigned int i;
+
+  if (h->count == 0)
+    return 0;
+  rank = (unsigned long long)(p / 100 * h->count + 0.5);
+  if (rank < 1)
+    rank = 1;
+  for (i = 0, n = 0; i < STM_HIST_BUCKETS; i++) {
+    if ((n += h->buckets[i]) >= rank)
+      return (hist_bucket_max(i) < h->max ? hist_bucket_max(i) : h->max);
+  }
+  return h->max;
+}
+
+#endif /* _HIST_H_ */
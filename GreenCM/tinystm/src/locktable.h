@@ -0,0 +1,296 @@
+/*
+ * File:
+ *   locktable.h
+ * Description:
+ *   Allocation of the lock array (ownership records).
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation, version 2
+ * of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#ifndef _LOCKTABLE_H_
+#define _LOCKTABLE_H_
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+#include "stm_internal.h"
+
+/*
+ * The lock array is mapped at stm_init.  Its size (LOCK_TABLE_LOG_SIZE)
+ * and the number of address bits ignored when hashing
+ * (LOCK_TABLE_SHIFT) default to the compile-time values.  Pages are
+ * faulted in by the first thread that uses them unless
+ * LOCK_TABLE_NUMA=interleave spreads them over all memory nodes.
+ * LOCK_TABLE_PAGES selects small pages, transparent huge pages (thp,
+ * default) or explicit huge pages (huge, falls back to thp if none are
+ * reserved).
+ *
+ * The same settings can be given with stm_set_parameter before stm_init
+ * (lock_table_size, lock_shift, lock_table_pages, lock_table_numa), in
+ * which case they take precedence over the environment.
+ *
+ * Only stm.c includes this file: the lock_table_* functions are declared
+ * in stm_internal.h for the other compilation units (clock roll-over).
+ */
+
+#ifndef LOCK_TABLE_HUGE_PAGE
+# define LOCK_TABLE_HUGE_PAGE           (2UL << 20)         /* Size of a huge page */
+#endif /* ! LOCK_TABLE_HUGE_PAGE */
+#define LOCK_TABLE_MIN_LOG_SIZE         10
+#define LOCK_TABLE_MAX_LOG_SIZE         30
+#define LOCK_TABLE_NODES                1024                /* Upper bound on NUMA node numbers */
+#ifndef MPOL_INTERLEAVE
+# define MPOL_INTERLEAVE                3
+#endif /* ! MPOL_INTERLEAVE */
+
+enum {                                  /* Page kinds (LOCK_TABLE_PAGES) */
+  LT_PAGES_SMALL,
+  LT_PAGES_THP,
+  LT_PAGES_HUGE
+};
+
+static const char *lt_pages_names[] = {
+  /* 0 */ "small",
+  /* 1 */ "thp",
+  /* 2 */ "huge"
+};
+
+static void *lt_map;                    /* Start of the mapping (may precede the aligned table) */
+static size_t lt_map_size;
+static int lt_pages;                    /* Page kind actually obtained */
+static int lt_interleaved;              /* Pages interleaved across nodes? */
+
+static unsigned int lt_set_log_size;    /* Settings from stm_set_parameter (0 or -1: unset) */
+static int lt_set_shift = -1;
+static int lt_set_pages = -1;
+static int lt_set_numa = -1;
+
+/*
+ * Page kind from its name (-1 if unknown).
+ */
+static int
+lock_table_pages_kind(const char *s)
+{
+  int i;
+
+  for (i = 0; i <= LT_PAGES_HUGE; i++) {
+    if (strcmp(s, lt_pages_names[i]) == 0)
+      return i;
+  }
+  return -1;
+}
+
+/*
+ * Record a lock table setting (before stm_init only).
+ */
+static int
+lock_table_set_parameter(const char *name, void *val)
+{
+  unsigned long n;
+  int i;
+
+  if (_tinystm.initialized)
+    return 0;
+  if (strcmp("lock_table_size", name) == 0) {
+    /* Number of locks, a power of two */
+    n = *(unsigned long *)val;
+    if (n == 0 || (n & (n - 1)) != 0)
+      return 0;
+    for (i = 0; n > 1; i++)
+      n >>= 1;
+    lt_set_log_size = i;
+    return 1;
+  }
+  if (strcmp("lock_shift", name) == 0) {
+    if (*(int *)val < 0)
+      return 0;
+    lt_set_shift = *(int *)val;
+    return 1;
+  }
+  if (strcmp("lock_table_pages", name) == 0) {
+    if ((i = lock_table_pages_kind((const char *)val)) < 0)
+      return 0;
+    lt_set_pages = i;
+    return 1;
+  }
+  if (strcmp("lock_table_numa", name) == 0) {
+    if (strcmp((const char *)val, "interleave") == 0)
+      lt_set_numa = 1;
+    else if (strcmp((const char *)val, "local") == 0)
+      lt_set_numa = 0;
+    else
+      return 0;
+    return 1;
+  }
+  return 0;
+}
+
+/*
+ * Interleave a range across the online memory nodes (no-op on
+ * single-node systems).
+ */
+static int
+lock_table_interleave(void *addr, size_t size)
+{
+  unsigned long mask[LOCK_TABLE_NODES / (8 * sizeof(unsigned long))];
+  const unsigned int bits = 8 * sizeof(unsigned long);
+  int first, last, n, nodes;
+  char sep;
+  FILE *f;
+
+  if ((f = fopen("/sys/devices/system/node/online", "r")) == NULL)
+    return 0;
+  memset(mask, 0, sizeof(mask));
+  nodes = 0;
+  /* Format: 0-3,6,8-9 */
+  while ((n = fscanf(f, "%d", &first)) == 1) {
+    last = first;
+    sep = (char)fgetc(f);
+    if (sep == '-') {
+      if (fscanf(f, "%d", &last) != 1)
+        break;
+      sep = (char)fgetc(f);
+    }
+    for (; first <= last && first < LOCK_TABLE_NODES; first++, nodes++)
+      mask[first / bits] |= 1UL << (first % bits);
+    if (sep != ',')
+      break;
+  }
+  fclose(f);
+  if (nodes < 2)
+    return 0;
+  if (syscall(SYS_mbind, addr, size, MPOL_INTERLEAVE, mask, (unsigned long)LOCK_TABLE_NODES + 1, 0) != 0) {
+    perror("lock table mbind");
+    return 0;
+  }
+  return 1;
+}
+
+/*
+ * Map the lock array and set the index parameters.
+ */
+void
+lock_table_alloc(void)
+{
+  unsigned int log_size, min_shift;
+  int numa;
+  size_t size;
+  char *s, *p;
+
+  log_size = LOCK_ARRAY_LOG_SIZE;
+  if (lt_set_log_size > 0)
+    log_size = lt_set_log_size;
+  else if ((s = getenv(LOCK_TABLE_LOG_SIZE)) != NULL && atoi(s) > 0)
+    log_size = atoi(s);
+#ifdef LOCK_IDX_SWAP
+  /* Bytes 0 and 1 of the index are swapped */
+  if (log_size < 16)
+    log_size = 16;
+#endif /* LOCK_IDX_SWAP */
+  if (log_size < LOCK_TABLE_MIN_LOG_SIZE)
+    log_size = LOCK_TABLE_MIN_LOG_SIZE;
+  if (log_size > LOCK_TABLE_MAX_LOG_SIZE)
+    log_size = LOCK_TABLE_MAX_LOG_SIZE;
+  /* A lock covers at least one word */
+  min_shift = (sizeof(stm_word_t) == 4 ? 2 : 3);
+  _tinystm.lock_shift = LOCK_SHIFT_DEFAULT;
+  if (lt_set_shift >= 0)
+    _tinystm.lock_shift = lt_set_shift;
+  else if ((s = getenv(LOCK_TABLE_SHIFT)) != NULL && atoi(s) >= 0)
+    _tinystm.lock_shift = atoi(s);
+  if (_tinystm.lock_shift < min_shift)
+    _tinystm.lock_shift = min_shift;
+  if (_tinystm.lock_shift > 8 * sizeof(stm_word_t) - log_size)
+    _tinystm.lock_shift = 8 * sizeof(stm_word_t) - log_size;
+  _tinystm.lock_mask = ((stm_word_t)1 << log_size) - 1;
+
+  lt_pages = LT_PAGES_THP;
+  if (lt_set_pages >= 0) {
+    lt_pages = lt_set_pages;
+  } else if ((s = getenv(LOCK_TABLE_PAGES)) != NULL) {
+    if ((lt_pages = lock_table_pages_kind(s)) < 0) {
+      fprintf(stderr, "Error: unknown page kind %s (small, thp or huge)\n", s);
+      exit(1);
+    }
+  }
+
+  size = sizeof(stm_word_t) << log_size;
+  if (size < LOCK_TABLE_HUGE_PAGE)
+    lt_pages = LT_PAGES_SMALL;
+  p = MAP_FAILED;
+#ifdef MAP_HUGETLB
+  if (lt_pages == LT_PAGES_HUGE) {
+    lt_map_size = size;
+    p = mmap(NULL, lt_map_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+  }
+#endif /* MAP_HUGETLB */
+  if (p == MAP_FAILED) {
+    if (lt_pages == LT_PAGES_HUGE)
+      lt_pages = LT_PAGES_THP;
+    /* Map one more huge page to align the table on a huge page boundary */
+    lt_map_size = size + (lt_pages == LT_PAGES_THP ? LOCK_TABLE_HUGE_PAGE : 0);
+    p = mmap(NULL, lt_map_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (p == MAP_FAILED) {
+      perror("lock table mmap");
+      exit(1);
+    }
+  }
+  lt_map = p;
+  if (lt_pages == LT_PAGES_THP) {
+    p = (char *)(((uintptr_t)p + LOCK_TABLE_HUGE_PAGE - 1) & ~(LOCK_TABLE_HUGE_PAGE - 1));
+#ifdef MADV_HUGEPAGE
+    if (madvise(p, size, MADV_HUGEPAGE) != 0)
+      lt_pages = LT_PAGES_SMALL;
+#else /* ! MADV_HUGEPAGE */
+    lt_pages = LT_PAGES_SMALL;
+#endif /* ! MADV_HUGEPAGE */
+  }
+  /* Pages are zero and not faulted in yet: the policy applies to all of them */
+  lt_interleaved = 0;
+  numa = lt_set_numa;
+  if (numa < 0)
+    numa = ((s = getenv(LOCK_TABLE_NUMA)) != NULL && strcmp(s, "interleave") == 0);
+  if (numa)
+    lt_interleaved = lock_table_interleave(p, size);
+  _tinystm.locks = (volatile stm_word_t *)p;
+  PRINT_DEBUG("\tLOCK_TABLE=2^%u locks, shift %u, %s pages%s\n", log_size, _tinystm.lock_shift,
+              lt_pages_names[lt_pages], lt_interleaved ? ", interleaved" : "");
+}
+
+/*
+ * Clear all locks.  Pages are dropped rather than written so that they
+ * are faulted in again by the threads that use them (and keep their
+ * NUMA policy).
+ */
+void
+lock_table_reset(void)
+{
+  size_t size = (_tinystm.lock_mask + 1) * sizeof(stm_word_t);
+
+  if (lt_pages == LT_PAGES_HUGE || madvise((void *)_tinystm.locks, size, MADV_DONTNEED) != 0)
+    memset((void *)_tinystm.locks, 0, size);
+}
+
+void
+lock_table_free(void)
+{
+  if (lt_map == NULL)
+    return;
+  munmap(lt_map, lt_map_size);
+  lt_map = NULL;
+  _tinystm.locks = NULL;
+}
+
+#endif /* _LOCKTABLE_H_ */
@@ -28,6 +28,12 @@
 #include <assert.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#ifdef __GLIBC__
+# include <malloc.h>
+#endif /* __GLIBC__ */
 
 #include "mod_cb.h"
 #include "mod_mem.h"
@@ -35,6 +41,7 @@
 /* TODO use stm_internal.h for faster accesses */
 #include "stm.h"
 #include "utils.h"
+#include "atomic.h"
 #include "gc.h"
 
 
@@ -43,6 +50,57 @@
  * ################################################################### */
 #define DEFAULT_CB_SIZE                 16
 
+/*
+ * Blocks of up to SLAB_MAX_SIZE bytes are carved from chunks of a
+ * reserved address range, each chunk holding blocks of one size class.
+ * A thread reuses the blocks of its free lists, then the blocks left by
+ * exited threads, then carves a new chunk.  Blocks allocated by a
+ * transaction are logged and put back on the free lists if it aborts.
+ * Blocks freed by a transaction are logged and, when it commits, passed
+ * to the epoch-based collector, which hands them back once no
+ * transaction started before (mod_mem_init(1)), or reused right away
+ * (mod_mem_init(0)).  Memory is never returned to libc, so
+ * slabs are only used if MEM_SLABS=1 (the application must not pass the
+ * blocks to free()).  Larger blocks go through malloc and callbacks.
+ */
+#ifndef SLAB_ARENA_LOG_SIZE
+# define SLAB_ARENA_LOG_SIZE            34                  /* Address range reserved: 2^34 = 16 GB */
+#endif /* ! SLAB_ARENA_LOG_SIZE */
+#ifndef SLAB_CHUNK_LOG_SIZE
+# define SLAB_CHUNK_LOG_SIZE            16                  /* Chunks of 2^16 = 64 KB */
+#endif /* ! SLAB_CHUNK_LOG_SIZE */
+#define SLAB_CHUNK_SIZE                 ((size_t)1 << SLAB_CHUNK_LOG_SIZE)
+#define SLAB_HEADER                     64                  /* Chunk header (size class) */
+#define SLAB_GRAIN                      16                  /* Size and alignment of the smallest blocks */
+#define SLAB_MAX_SIZE                   2048
+#define SLAB_CLASSES                    28
+#define SLAB_LOG_SIZE                   64                  /* Initial size of the allocation/free logs */
+#define MEM_SLABS                       "MEM_SLABS"
+
+static const unsigned short slab_sizes[SLAB_CLASSES] = {
+  16, 32, 48, 64, 80, 96, 112, 128, 144, 160, 176, 192, 208, 224, 240, 256,
+  320, 384, 448, 512, 640, 768, 896, 1024, 1280, 1536, 1792, 2048
+};
+
+typedef struct slab_block {             /* Free block */
+  struct slab_block *next;              /* Next block */
+} slab_block_t;
+
+typedef struct slab_log {               /* Blocks allocated or freed by the current transaction */
+  void **addrs;
+  unsigned int nb;
+  unsigned int size;
+} slab_log_t;
+
+static struct {
+  char *base;                           /* Reserved range (NULL if slabs are disabled) */
+  char *end;
+  volatile gc_word_t next;              /* Offset of the next unused chunk */
+  pthread_mutex_t lock;                 /* Protects the lists below */
+  slab_block_t *free[SLAB_CLASSES];     /* Blocks left by exited threads or released by the collector */
+  unsigned char class_of[SLAB_MAX_SIZE / SLAB_GRAIN + 1];
+} slab = { .lock = PTHREAD_MUTEX_INITIALIZER };
+
 typedef struct mod_cb_entry {           /* Callback entry */
   void (*f)(void *);                    /* Function */
   void *arg;                            /* Argument to be passed to function */
@@ -55,6 +113,11 @@ typedef struct mod_cb_info {
   unsigned short abort_size;            /* Array size for abort callbacks */
   unsigned short abort_nb;              /* Number of abort callbacks */
   mod_cb_entry_t *abort;                /* Abort callback entries */
+  slab_block_t *free[SLAB_CLASSES];     /* Blocks ready for reuse */
+  char *bump[SLAB_CLASSES];             /* Next unused block of the current chunk */
+  char *limit[SLAB_CLASSES];            /* End of the current chunk */
+  slab_log_t allocs;                    /* Blocks allocated by the current transaction */
+  slab_log_t frees;                     /* Blocks freed by the current transaction */
 } mod_cb_info_t;
 
 /* TODO: to avoid false sharing, this should be in a dedicated cacheline.
@@ -137,6 +200,202 @@ int stm_on_commit(void (*on_commit)(void *arg), void *arg)
   return 1;
 }
 
+/* ################################################################### *
+ * SLAB FUNCTIONS
+ * ################################################################### */
+
+/*
+ * Reserve the address range of the slabs (pages are only backed when
+ * used).
+ */
+static void
+slab_init(void)
+{
+  size_t size = (size_t)1 << SLAB_ARENA_LOG_SIZE;
+  char *p, *s;
+  unsigned int i, c;
+
+  if (slab.base != NULL || (s = getenv(MEM_SLABS)) == NULL || strcmp(s, "1") != 0)
+    return;
+  for (i = 0, c = 0; i <= SLAB_MAX_SIZE / SLAB_GRAIN; i++) {
+    while (slab_sizes[c] < i * SLAB_GRAIN)
+      c++;
+    slab.class_of[i] = c;
+  }
+  p = (char *)mmap(NULL, size + SLAB_CHUNK_SIZE, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+  if (p == MAP_FAILED) {
+    /* Keep using malloc */
+    perror("slab mmap");
+    return;
+  }
+  /* Chunks are aligned on their size */
+  p = (char *)(((uintptr_t)p + SLAB_CHUNK_SIZE - 1) & ~(uintptr_t)(SLAB_CHUNK_SIZE - 1));
+  slab.end = p + size;
+  slab.next = 0;
+  slab.base = p;
+}
+
+static INLINE int
+slab_owns(void *addr)
+{
+  return (char *)addr >= slab.base && (char *)addr < slab.end;
+}
+
+static INLINE unsigned int
+slab_class(void *addr)
+{
+  return *(unsigned int *)((uintptr_t)addr & ~(uintptr_t)(SLAB_CHUNK_SIZE - 1));
+}
+
+static INLINE void
+slab_push(mod_cb_info_t *icb, void *addr)
+{
+  slab_block_t *b = (slab_block_t *)addr;
+  unsigned int c = slab_class(addr);
+
+  b->next = icb->free[c];
+  icb->free[c] = b;
+}
+
+static INLINE void
+slab_log_add(slab_log_t *log, void *addr)
+{
+  if (unlikely(log->nb >= log->size)) {
+    log->size *= 2;
+    if ((log->addrs = (void **)xrealloc(log->addrs, sizeof(void *) * log->size)) == NULL) {
+      perror("realloc error");
+      exit(1);
+    }
+  }
+  log->addrs[log->nb++] = addr;
+}
+
+/*
+ * Get a block when the free list of its class is empty.
+ */
+static NOINLINE void *
+slab_refill(mod_cb_info_t *icb, unsigned int c)
+{
+  slab_block_t *b;
+  gc_word_t off;
+  char *chunk;
+
+  if (slab.free[c] != NULL) {
+    pthread_mutex_lock(&slab.lock);
+    icb->free[c] = slab.free[c];
+    slab.free[c] = NULL;
+    pthread_mutex_unlock(&slab.lock);
+    if ((b = icb->free[c]) != NULL) {
+      icb->free[c] = b->next;
+      return b;
+    }
+  }
+  /* New chunk */
+  off = ATOMIC_FETCH_ADD_FULL(&slab.next, SLAB_CHUNK_SIZE);
+  if (unlikely(off >= (gc_word_t)(slab.end - slab.base)))
+    return NULL;
+  chunk = slab.base + off;
+  *(unsigned int *)chunk = c;
+  icb->bump[c] = chunk + SLAB_HEADER + slab_sizes[c];
+  icb->limit[c] = chunk + SLAB_CHUNK_SIZE;
+  return chunk + SLAB_HEADER;
+}
+
+static INLINE void *
+slab_alloc(mod_cb_info_t *icb, size_t size)
+{
+  unsigned int c = slab.class_of[(size + SLAB_GRAIN - 1) / SLAB_GRAIN];
+  slab_block_t *b;
+  char *p;
+
+  if ((b = icb->free[c]) != NULL) {
+    icb->free[c] = b->next;
+    return b;
+  }
+  p = icb->bump[c];
+  if (p != NULL && p + slab_sizes[c] <= icb->limit[c]) {
+    icb->bump[c] = p + slab_sizes[c];
+    return p;
+  }
+  return slab_refill(icb, c);
+}
+
+/*
+ * Publish the blocks freed by a committed transaction.
+ */
+static void
+slab_commit_frees(mod_cb_info_t *icb)
+{
+  unsigned int i;
+#ifdef EPOCH_GC
+  gc_word_t epoch;
+
+  if (mod_cb.use_gc) {
+    epoch = stm_get_clock();
+    for (i = 0; i < icb->frees.nb; i++)
+      gc_free(icb->frees.addrs[i], slab_sizes[slab_class(icb->frees.addrs[i])], epoch);
+    icb->frees.nb = 0;
+    return;
+  }
+#endif /* EPOCH_GC */
+  for (i = 0; i < icb->frees.nb; i++)
+    slab_push(icb, icb->frees.addrs[i]);
+  icb->frees.nb = 0;
+}
+
+#ifdef EPOCH_GC
+/*
+ * Take back the blocks released by the collector (called by any
+ * thread).
+ */
+static void
+slab_release(void **addrs, unsigned int nb)
+{
+  slab_block_t *b;
+  unsigned int i, c;
+
+  pthread_mutex_lock(&slab.lock);
+  for (i = 0; i < nb; i++) {
+    if (slab_owns(addrs[i])) {
+      b = (slab_block_t *)addrs[i];
+      c = slab_class(b);
+      b->next = slab.free[c];
+      slab.free[c] = b;
+    } else {
+      free(addrs[i]);
+    }
+  }
+  pthread_mutex_unlock(&slab.lock);
+}
+#endif /* EPOCH_GC */
+
+/*
+ * Give the blocks of an exiting thread to the other threads.
+ */
+static void
+slab_thread_exit(mod_cb_info_t *icb)
+{
+  slab_block_t *b;
+  unsigned int c;
+
+  pthread_mutex_lock(&slab.lock);
+  for (c = 0; c < SLAB_CLASSES; c++) {
+    /* Unused part of the current chunk */
+    while (icb->bump[c] != NULL && icb->bump[c] + slab_sizes[c] <= icb->limit[c]) {
+      slab_push(icb, icb->bump[c]);
+      icb->bump[c] += slab_sizes[c];
+    }
+    while ((b = icb->free[c]) != NULL) {
+      icb->free[c] = b->next;
+      b->next = slab.free[c];
+      slab.free[c] = b;
+    }
+  }
+  pthread_mutex_unlock(&slab.lock);
+  xfree(icb->allocs.addrs);
+  xfree(icb->frees.addrs);
+}
+
 /* ################################################################### *
  * MEMORY ALLOCATION FUNCTIONS
  * ################################################################### */
@@ -158,6 +417,13 @@ int_stm_malloc(struct stm_tx *tx, size_t size)
     size = (size + 7) & ~(size_t)0x07;
   }
 
+  if (likely(size <= SLAB_MAX_SIZE && slab.base != NULL) && (addr = slab_alloc(icb, size)) != NULL) {
+    /* Put back on the free list upon abort */
+    if (stm_active_tx(tx))
+      slab_log_add(&icb->allocs, addr);
+    return addr;
+  }
+
   if (unlikely((addr = malloc(size)) == NULL)) {
     perror("malloc");
     exit(1);
@@ -200,6 +466,13 @@ void *int_stm_calloc(struct stm_tx *tx, size_t nm, size_t size)
     size = (size + 7) & ~(size_t)0x07;
   }
 
+  if (likely(nm <= SLAB_MAX_SIZE && size <= SLAB_MAX_SIZE && nm * size <= SLAB_MAX_SIZE && slab.base != NULL) && (addr = slab_alloc(icb, nm * size)) != NULL) {
+    memset(addr, 0, nm * size);
+    if (stm_active_tx(tx))
+      slab_log_add(&icb->allocs, addr);
+    return addr;
+  }
+
   if ((addr = calloc(nm, size)) == NULL) {
     perror("calloc");
     exit(1);
@@ -231,7 +504,11 @@ epoch_free(void *addr)
   if (mod_cb.use_gc) {
     /* TODO use tx->end could be also used */
     stm_word_t t = stm_get_clock();
-    gc_free(addr, t);
+#ifdef __GLIBC__
+    gc_free(addr, malloc_usable_size(addr), t);
+#else /* ! __GLIBC__ */
+    gc_free(addr, 0, t);
+#endif /* ! __GLIBC__ */
   } else {
     free(addr);
   }
@@ -266,6 +543,10 @@ void int_stm_free2(struct stm_tx *tx, void *addr, size_t idx, size_t size)
     }
   }
   /* Schedule for removal */
+  if (slab_owns(addr)) {
+    slab_log_add(&icb->frees, addr);
+    return;
+  }
 #ifdef EPOCH_GC
   mod_cb_add_on_commit(icb, epoch_free, addr);
 #else /* ! EPOCH_GC */
@@ -319,6 +600,10 @@ static void mod_cb_on_commit(void *arg)
   }
   /* Reset abort callback */
   icb->abort_nb = 0;
+  /* Keep allocated blocks, publish freed ones */
+  icb->allocs.nb = 0;
+  if (icb->frees.nb > 0)
+    slab_commit_frees(icb);
 }
 
 /*
@@ -338,6 +623,10 @@ static void mod_cb_on_abort(void *arg)
   }
   /* Reset commit callback */
   icb->commit_nb = 0;
+  /* Give back allocated blocks, forget freed ones */
+  while (icb->allocs.nb > 0)
+    slab_push(icb, icb->allocs.addrs[--icb->allocs.nb]);
+  icb->frees.nb = 0;
 }
 
 /*
@@ -349,11 +638,15 @@ static void mod_cb_on_thread_init(void *arg)
 
   if ((icb = (mod_cb_info_t *)xmalloc(sizeof(mod_cb_info_t))) == NULL)
     goto err_malloc;
+  memset(icb, 0, sizeof(*icb));
   icb->commit_nb = icb->abort_nb = 0;
   icb->commit_size = icb->abort_size = DEFAULT_CB_SIZE;
   icb->commit = xmalloc(sizeof(mod_cb_entry_t) * icb->commit_size);
   icb->abort = xmalloc(sizeof(mod_cb_entry_t) * icb->abort_size);
-  if (unlikely(icb->commit == NULL || icb->abort == NULL))
+  icb->allocs.size = icb->frees.size = SLAB_LOG_SIZE;
+  icb->allocs.addrs = xmalloc(sizeof(void *) * icb->allocs.size);
+  icb->frees.addrs = xmalloc(sizeof(void *) * icb->frees.size);
+  if (unlikely(icb->commit == NULL || icb->abort == NULL || icb->allocs.addrs == NULL || icb->frees.addrs == NULL))
     goto err_malloc;
 
   stm_set_specific(mod_cb.key, icb);
@@ -374,6 +667,7 @@ static void mod_cb_on_thread_exit(void *arg)
   icb = (mod_cb_info_t *)stm_get_specific(mod_cb.key);
   assert(icb != NULL);
 
+  slab_thread_exit(icb);
   xfree(icb->abort);
   xfree(icb->commit);
   xfree(icb);
@@ -407,7 +701,11 @@ void mod_cb_init(void)
 void mod_mem_init(int use_gc)
 {
   mod_cb_mem_init();
+  slab_init();
 #ifdef EPOCH_GC
+  /* The collector gives slab blocks back to the slabs */
+  if (slab.base != NULL)
+    gc_set_release(slab_release);
   mod_cb.use_gc = use_gc;
 #endif /* EPOCH_GC */
 }
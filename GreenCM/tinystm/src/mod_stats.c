@@ -73,6 +73,11 @@ int stm_get_global_stats(const char *name, void *val)
     *(unsigned long *)val = mod_stats_global.retries_max;
     return 1;
   }
+  if (strcmp("global_counters", name) == 0) {
+    /* Live commits and aborts of all threads, read in one pass */
+    stm_get_counters((stm_counters_t *)val);
+    return 1;
+  }
 
   return 0;
 }
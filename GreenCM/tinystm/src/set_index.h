@@ -0,0 +1,146 @@
+/*
+ * File:
+ *   set_index.h
+ * Description:
+ *   Hash index over the entries of a read or write set.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation, version 2
+ * of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#ifndef _SET_INDEX_H_
+#define _SET_INDEX_H_
+
+#include <string.h>
+
+#include <stm.h>
+
+#include "utils.h"
+
+/*
+ * Sets are scanned linearly until they reach SET_INDEX_THRESHOLD
+ * entries.  Beyond, lookups first add the entries appended since the
+ * previous lookup to an open-addressing table (linear probing, at most
+ * half full) that maps a key to the position of its first entry.
+ * Slots are tagged with an epoch: the table is emptied between
+ * transactions by changing the epoch.
+ */
+
+#ifndef SET_INDEX_THRESHOLD
+# define SET_INDEX_THRESHOLD            32                  /* Entries before the index is used */
+#endif /* ! SET_INDEX_THRESHOLD */
+#define SET_INDEX_MIN_LOG_SIZE          8
+
+typedef struct si_slot {                /* Index slot */
+  stm_word_t key;                       /* Address or lock */
+  unsigned int epoch;                   /* Valid if equal to the index epoch */
+  unsigned int pos;                     /* Position of the entry in the set */
+} si_slot_t;
+
+typedef struct set_index {              /* Index of a set */
+  si_slot_t *slots;                     /* Table (NULL until first needed) */
+  unsigned int log_size;                /* Log2 of the number of slots */
+  unsigned int epoch;                   /* Current epoch (never 0) */
+  unsigned int nb;                      /* Entries of the set already indexed */
+} set_index_t;
+
+static INLINE unsigned int
+set_index_hash(const set_index_t *ix, stm_word_t key)
+{
+  return (unsigned int)(((unsigned long long)key * 0x9E3779B97F4A7C15ULL) >> (64 - ix->log_size));
+}
+
+/*
+ * Empty the index (upon transaction start).
+ */
+static INLINE void
+set_index_reset(set_index_t *ix)
+{
+  if (ix->nb == 0)
+    return;
+  ix->nb = 0;
+  if (unlikely(++ix->epoch == 0)) {
+    memset(ix->slots, 0, sizeof(si_slot_t) << ix->log_size);
+    ix->epoch = 1;
+  }
+}
+
+/*
+ * Make room for n entries.  A new table is empty (entries must be added
+ * again).
+ */
+static INLINE void
+set_index_reserve(set_index_t *ix, unsigned int n)
+{
+  unsigned int log_size;
+
+  if (likely(ix->slots != NULL && (n << 1) <= (1U << ix->log_size)))
+    return;
+  for (log_size = SET_INDEX_MIN_LOG_SIZE; (1U << log_size) < (n << 2); log_size++)
+    ;
+  xfree(ix->slots);
+  ix->slots = (si_slot_t *)xmalloc(sizeof(si_slot_t) << log_size);
+  memset(ix->slots, 0, sizeof(si_slot_t) << log_size);
+  ix->log_size = log_size;
+  ix->epoch = 1;
+  ix->nb = 0;
+}
+
+/*
+ * Add an entry, unless its key is already indexed.
+ */
+static INLINE void
+set_index_add(set_index_t *ix, stm_word_t key, unsigned int pos)
+{
+  unsigned int mask = (1U << ix->log_size) - 1;
+  unsigned int i = set_index_hash(ix, key);
+  si_slot_t *s;
+
+  for (;; i = (i + 1) & mask) {
+    s = &ix->slots[i];
+    if (s->epoch != ix->epoch) {
+      s->key = key;
+      s->epoch = ix->epoch;
+      s->pos = pos;
+      return;
+    }
+    if (s->key == key)
+      return;
+  }
+}
+
+/*
+ * Position of the first entry with a key (-1 if none).
+ */
+static INLINE int
+set_index_find(const set_index_t *ix, stm_word_t key)
+{
+  unsigned int mask = (1U << ix->log_size) - 1;
+  unsigned int i = set_index_hash(ix, key);
+  const si_slot_t *s;
+
+  for (;; i = (i + 1) & mask) {
+    s = &ix->slots[i];
+    if (s->epoch != ix->epoch)
+      return -1;
+    if (s->key == key)
+      return (int)s->pos;
+  }
+}
+
+static inline void
+set_index_free(set_index_t *ix)
+{
+  xfree(ix->slots);
+  ix->slots = NULL;
+  ix->nb = 0;
+}
+
+#endif /* _SET_INDEX_H_ */
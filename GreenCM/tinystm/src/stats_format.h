@@ -0,0 +1,82 @@
+/*
+ * File:
+ *   stats_format.h
+ * Description:
+ *   Layout of the per-thread counters and of the live statistics
+ *   segment (see stats_shm.h), shared with scripts/stmtop.c.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation, version 2
+ * of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#ifndef _STATS_FORMAT_H_
+#define _STATS_FORMAT_H_
+
+#include <stdint.h>
+
+/*
+ * The segment is a header followed by slabs of counter slots, one slot
+ * per thread.  The owner of a slot bumps seq before and after updating
+ * commits, aborts and aborts_r (readers retry while seq is odd or has
+ * changed); the other fields are single words that only grow.  The
+ * tuning parameters in the header are protected the same way by the
+ * header seq.
+ */
+
+#define STATS_MAGIC                     0x53544154534d5453ULL /* "STMSTATS" */
+#define STATS_VERSION                   2
+#define STATS_SLAB_SLOTS                64                  /* Counter slots allocated at once */
+#define STATS_REASONS                   16                  /* Abort reasons: (STM_ABORT_* >> 8) & 0x0F */
+#define STATS_WAIT_BUCKETS              16                  /* Backoff waits: bucket b counts [4^b, 4^(b+1)) */
+#define STATS_ALIGNED                   __attribute__((aligned(64)))
+
+typedef struct tx_stats {               /* Counters of a thread, polled by the tuner and stmtop */
+  volatile uintptr_t seq;               /* Odd while the owner is updating */
+  volatile uintptr_t commits;           /* Total number of commits (kept when the slot is reused) */
+  volatile uintptr_t aborts;            /* Total number of aborts (kept when the slot is reused) */
+  volatile uintptr_t used;              /* Is the slot owned by a thread? */
+  volatile uintptr_t aborts_r[STATS_REASONS]; /* Aborts wrt. abort reason */
+  volatile uintptr_t wait[STATS_WAIT_BUCKETS]; /* Backoff waits (spin iterations) by power of 4 */
+  volatile uintptr_t spun;              /* Iterations spun in backoff */
+  volatile uintptr_t slept;             /* Microseconds slept in backoff */
+  volatile uintptr_t cpu;               /* CPU of the current owner */
+  volatile uintptr_t escalations;       /* Restarts in serial irrevocable mode (starvation guard) */
+} STATS_ALIGNED tx_stats_t;
+
+typedef struct stats_slab {             /* Slab of counters (never freed) */
+  tx_stats_t slots[STATS_SLAB_SLOTS];
+  struct stats_slab *volatile next;     /* Meaningless outside the process */
+} stats_slab_t;
+
+typedef struct stats_shm {              /* Segment header */
+  uint64_t magic;
+  uint32_t version;
+  uint32_t header_size;                 /* Offset of the first slab */
+  uint32_t slab_size;                   /* sizeof(stats_slab_t) */
+  uint32_t nb_slabs;                    /* Slabs in the segment (threads beyond are not shown) */
+  uint64_t pid;
+  uint64_t start;                       /* CLOCK_REALTIME of stm_init (ns) */
+  uint64_t tsc_khz;                     /* TSC frequency (0 if unknown) */
+  char cm[16];                          /* Contention manager */
+  volatile uint64_t seq;                /* Odd while the parameters are updated */
+  char policy[16];                      /* Backoff policy */
+  volatile uint64_t ferraris;
+  volatile uint64_t max_ferraris;
+  volatile uint64_t backoff_threshold;
+  volatile uint64_t asym_threshold;
+  volatile uint64_t max_backoff;
+  volatile uint64_t thresh_index;
+  volatile uint64_t spintosleep;
+  volatile uint64_t beta;
+  volatile uint64_t adm_cap;            /* Admission cap (~0 if the gate is open) */
+  volatile uint64_t starve_threshold;   /* Bound of the starvation guard (0 if disabled) */
+} STATS_ALIGNED stats_shm_t;
+
+#endif /* _STATS_FORMAT_H_ */
@@ -0,0 +1,137 @@
+/*
+ * File:
+ *   stats_shm.h
+ * Description:
+ *   Live statistics segment for external monitoring (scripts/stmtop.c).
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation, version 2
+ * of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#ifndef _STATS_SHM_H_
+#define _STATS_SHM_H_
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+
+#include "stm_internal.h"
+#include "stats_format.h"
+
+/*
+ * If STATS_SHM is set (and not 0), the first counter slabs are placed in
+ * /dev/shm/tinystm.<pid> instead of the heap, so that threads update
+ * the published counters directly and the commit path is unchanged.
+ * The tuning parameters are copied to the header whenever they change.
+ */
+
+static char stats_shm_path[64];
+
+/*
+ * Copy the tuning parameters to the segment.
+ */
+static void
+stats_shm_publish(void)
+{
+  static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+  stats_shm_t *h = _tinystm.shm;
+
+  if (h == NULL)
+    return;
+  pthread_mutex_lock(&lock);
+  ATOMIC_STORE(&h->seq, h->seq + 1);
+  ATOMIC_MB_WRITE;
+  h->tsc_khz = tsc_khz;
+  h->ferraris = ferraris;
+  h->max_ferraris = max_ferraris;
+  h->backoff_threshold = backoff_threshold;
+  h->asym_threshold = asym_threshold;
+  h->starve_threshold = starve_threshold;
+  h->thresh_index = thresh_index;
+  h->spintosleep = spintosleep;
+  h->beta = beta;
+#ifdef GREEN_BACKOFF
+  strncpy(h->policy, _tinystm.backoff_policy != NULL ? _tinystm.backoff_policy->name : "", sizeof(h->policy) - 1);
+  h->max_backoff = max_backoff;
+  h->adm_cap = ATOMIC_LOAD(&_tinystm.adm_cap);
+#else /* ! GREEN_BACKOFF */
+  h->adm_cap = ~0ULL;
+#endif /* ! GREEN_BACKOFF */
+  ATOMIC_STORE_REL(&h->seq, h->seq + 1);
+  pthread_mutex_unlock(&lock);
+}
+
+/*
+ * Create the segment and make its slabs the first counter slabs.
+ */
+static void
+stats_shm_open(const char *cm)
+{
+  stats_shm_t *h;
+  stats_slab_t *slabs;
+  struct timespec ts;
+  size_t size;
+  char *s;
+  int fd, i;
+
+  if (_tinystm.shm != NULL || (s = getenv(STATS_SHM)) == NULL || strcmp(s, "0") == 0)
+    return;
+  size = sizeof(stats_shm_t) + STATS_SHM_SLABS * sizeof(stats_slab_t);
+  snprintf(stats_shm_path, sizeof(stats_shm_path), "/dev/shm/tinystm.%d", (int)getpid());
+  if ((fd = open(stats_shm_path, O_RDWR | O_CREAT | O_TRUNC, 0644)) < 0 || ftruncate(fd, size) != 0) {
+    perror("statistics segment");
+    exit(1);
+  }
+  h = (stats_shm_t *)mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+  if (h == MAP_FAILED) {
+    perror("statistics mmap");
+    exit(1);
+  }
+  slabs = (stats_slab_t *)(h + 1);
+  for (i = 0; i < STATS_SHM_SLABS - 1; i++)
+    slabs[i].next = &slabs[i + 1];
+  slabs[i].next = _tinystm.stats;
+  _tinystm.stats = slabs;
+
+  clock_gettime(CLOCK_REALTIME, &ts);
+  h->version = STATS_VERSION;
+  h->header_size = sizeof(stats_shm_t);
+  h->slab_size = sizeof(stats_slab_t);
+  h->nb_slabs = STATS_SHM_SLABS;
+  h->pid = getpid();
+  h->start = ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+  strncpy(h->cm, cm, sizeof(h->cm) - 1);
+  _tinystm.shm = h;
+  /* The magic is written last */
+  ATOMIC_MB_WRITE;
+  h->magic = STATS_MAGIC;
+  PRINT_DEBUG("\tSTATS_SHM=%s (%d threads)\n", stats_shm_path, STATS_SHM_SLABS * STATS_SLAB_SLOTS);
+}
+
+/*
+ * Remove the segment name.  The mapping is kept: threads may still be
+ * running.
+ */
+static void
+stats_shm_close(void)
+{
+  if (_tinystm.shm == NULL)
+    return;
+  stats_shm_publish();
+  unlink(stats_shm_path);
+}
+
+#endif /* _STATS_SHM_H_ */
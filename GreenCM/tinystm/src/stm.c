@@ -25,6 +25,7 @@
 
 #define _GNU_SOURCE
 #include <assert.h>
+#include <errno.h>
 #include <signal.h>
 #include <stdio.h>
 #include <string.h>
@@ -34,6 +35,22 @@
 #include "stm.h"
 //#include "stm_internal.h"
 #include "aperf.h"
+#include "energy.h"
+#include "topology.h"
+#include "stats_shm.h"
+#include "locktable.h"
+#ifdef TM_TRACE
+# include "trace.h"
+#endif /* TM_TRACE */
+#ifdef GREEN_BACKOFF
+# if defined(__x86_64__) || defined(__i386__)
+#  include <cpuid.h>
+# endif /* defined(__x86_64__) || defined(__i386__) */
+# include "calibrate.h"
+# include "dvfs.h"
+# include "tuner.h"
+# include "admission.h"
+#endif /* GREEN_BACKOFF */
 #include "utils.h"
 #include "atomic.h"
 #include "gc.h"
@@ -57,9 +74,56 @@ static const char *cm_names[] = {
   /* 0 */ "SUICIDE",
   /* 1 */ "DELAY",
   /* 2 */ "BACKOFF",
+#ifdef MODULAR_BACKOFF
+  /* 3 */ "HYBRID"
+#else /* ! MODULAR_BACKOFF */
   /* 3 */ "MODULAR"
+#endif /* ! MODULAR_BACKOFF */
 };
 
+static const char *clock_names[] = {
+  /* 0 */ "GV1",
+  /* 1 */ "GV4",
+  /* 2 */ "GV5",
+  /* 3 */ "HIER"
+};
+
+#ifdef TM_STATISTICS
+/* Indexes are defined in stm_internal.h */
+static const char *hist_names[] = {
+  /* 0 */ "commit latency",
+  /* 1 */ "attempt",
+  /* 2 */ "spin wait",
+  /* 3 */ "sleep wait",
+  /* 4 */ "retries"
+};
+#endif /* TM_STATISTICS */
+
+/* Green-CM tuning state (shared with the tuner thread) */
+unsigned long asym_threshold;
+unsigned long starve_threshold;
+unsigned long sched_threshold;
+unsigned long backoff_threshold;
+#ifdef GREEN_BACKOFF
+unsigned long max_backoff = MAX_BACKOFF;
+int spin_mode = SPIN_MODE_NOP;
+unsigned long spin_tsc_mult;
+#endif /* GREEN_BACKOFF */
+float backoff_thresholds[1500];
+unsigned long min_backoff_threshold;
+unsigned long max_backoff_threshold;
+unsigned int thresholds[10000];
+unsigned int ferraris;
+unsigned int max_ferraris;
+int running;
+int thresholding;
+int spintosleep;
+int beta;
+int park_beta;
+unsigned long tsc_khz;
+int thresh_index;
+int thread_status[MAX_CPUS];
+
 /* Global variables */
 global_t _tinystm =
     { .nb_specific = 0
@@ -226,541 +290,363 @@ signal_catcher(int sig)
 }
 #endif /* SIGNAL_HANDLER */
 
-unsigned long get_total_commits(){
-	unsigned long commits = 0;
-	stm_tx_t *t;
-	t = _tinystm.threads;
-	while (t != NULL) {
-		commits += t->stat_commits;
-		t = t->next;
-	}
-	return commits;
+thread_proc_2(void* x)
+{
+	do_measure_all_cpus(100000,0);
+	pthread_exit(NULL);
 }
 
-unsigned long get_total_aborts(){
-        unsigned long aborts = 0;
-        stm_tx_t *t;
-        t = _tinystm.threads;
-        while (t != NULL) {
-                aborts += t->stat_aborts;
-                t = t->next;
-        }
-        return aborts;
-}
-
-thread_proc_4(void* x){
-	int iterations = 0;
-	int tdir = 75;
-	int fdir = 1;
-	int tunef = 1;
-	int skip = 1;
-	int thresh_index = 1;
-	volatile unsigned long tcommits_pre = 0;
- 	volatile unsigned long tcommits_post = 0;
-	int tcommits = 0;
-	int tcommits_prev = 0;
-	int sampling_period = 10000;
-
-	struct timespec tim, tim2;
- 	tim.tv_sec = 0;
- 	tim.tv_nsec = sampling_period*10000;
-
-
- 	float power_pre,power_post,power_prev,power_max;
- 	float power=0;
- 	int j;
- 	float edp=0, edp_mae, edp_avg=0;
- 	float edp_prev = 0;
-
-	while(running){
-
-		iterations += 1;
-	  
-		tcommits_pre = get_total_commits();
-		nanosleep(&tim , &tim2);
-	 	tcommits_post = get_total_commits();
-        	tcommits = tcommits_post-tcommits_pre;
- 
-                printf("current thresholds are %d, %d\n",ferraris, thresh_index);
-
-        	if(!running)
-                	break;
-
-	        power_post = 0;
-        	for (j = 0; j < nr_packages; j++)
-                	power_post += source->get_power(j);
-        	power = power_post;
-
-        	if(power==0.0)
-                	pthread_exit(NULL);
-
-        	edp = tcommits/power;
-
-		if(tcommits < 30)
-			continue;
-
-
-		if((edp < edp_prev) && !skip){
-			if(tunef == 1){
-				tdir *= -1;
-				if (tdir != 1 && tdir != -1){
-	                                tdir = tdir/2;
-        		                if (tdir==0)
-                        		        tdir = 1;
-                        	}
-				thresh_index += tdir;
-			}
-			else{
-				fdir *= -1;
-				ferraris += fdir;
-			}
-		}
-
-
-		if(tunef == 1)
-			ferraris += fdir;
-		else
-			thresh_index += tdir;
-
-		if (thresh_index < 0){
-                	thresh_index = 0;
-        	}
-        	else if (thresh_index > max_backoff_threshold ){
-                	thresh_index = max_backoff_threshold;
-        	}
-		if (ferraris == -1)
-                	ferraris = 0;
-        	else if (ferraris > max_ferraris )
-                	ferraris = max_ferraris;
-
-		spintosleep = backoff_thresholds[thresh_index];
-		backoff_threshold = spintosleep*(beta+5);
-
-		edp_prev = edp;
-		skip = 0;	
-		tunef *= -1;
-	}
+/*
+ * Discover the topology, order the fast cores and plan the placement of
+ * application threads (once).
+ */
+static void
+topo_init(void)
+{
+  static int discovered = 0;
+  char *s;
+
+  if (discovered)
+    return;
+  topo_discover();
+  s = getenv(FAST_CORE_ORDER);
+  if (s == NULL)
+    s = "spread";
+  if (!topo_order(s)) {
+    fprintf(stderr, "Error: invalid fast core order %s\n", s);
+    exit(1);
+  }
+  PRINT_DEBUG("\tFAST_CORE_ORDER=%s (%d CPUs)\n", s, topo_nb_cpus);
+  if ((s = getenv(THREAD_PLACEMENT)) != NULL && *s != '\0') {
+    if (!topo_place(s)) {
+      fprintf(stderr, "Error: invalid thread placement %s\n", s);
+      exit(1);
+    }
+    PRINT_DEBUG("\tTHREAD_PLACEMENT=%s\n", topo_placement);
+  }
+  discovered = 1;
 }
 
+#ifdef GREEN_BACKOFF
+/* ################################################################### *
+ * BACKOFF POLICIES
+ * ################################################################### */
 
-thread_proc_5(void* x){
-	int sampling_period = 10;
-	struct timespec tim, tim2;
-	tim.tv_sec = 0;
-	tim.tv_nsec = sampling_period*1000;
-	int tcommits=0, taborts=0;
-	volatile unsigned long tcommits_pre=0, tcommits_post=0, taborts_pre=0, taborts_post=0;
-	int counter = 0;
-	while(running){
-		taborts_pre = get_total_aborts();
-		tcommits_pre = get_total_commits();
-        	nanosleep(&tim , &tim2);
-		taborts_post = get_total_aborts();
-	        tcommits_post = get_total_commits();
-        	tcommits = tcommits_post-tcommits_pre;
-		taborts = taborts_post-taborts_pre;
-		if (tcommits>100){
-			counter++;
-			if (counter==100){
-				printf("commits in past 0 us is: shady\n");
-                        	spintosleep=1000;
-                        	backoff_threshold = 55*spintosleep;
-			}
-		}
-		//if (tcommits < 10){
-                //	continue;
-        	//}
-		printf("commits in past %d us is: %d,%d\n",sampling_period,tcommits,taborts);	
-	}
+/*
+ * Read the number of fast cores for asymmetric policies.
+ */
+static void
+bo_init_ferraris(void)
+{
+  char *s;
+
+  topo_init();
+  s = getenv(FERRARIS);
+  max_ferraris = (s != NULL ? (unsigned int)strtoul(s, NULL, 10) : 0);
+  if (max_ferraris > topo_nb_cpus)
+    max_ferraris = topo_nb_cpus;
+  asym_threshold = 1000000000;
 }
 
-thread_proc(void* x)
-{
- int jump = -1;
- int ferraris_prev;
- int can_switch = 1;
- int dir = -1;
- int skip = 0;
- int oscillating = 0;
- int confidence = 0;
- //int confidence_threshold = 1;
- int prev_turn = -3;
- unsigned long min_threshold = 30;
- unsigned long max_threshold = 500;
- unsigned long tcommits_pre=0;
- unsigned long tcommits_post=0;
- int tcommits=0;
- unsigned long sampling_period=10000;
-
- struct timespec tim, tim2;
- tim.tv_sec = 0;
- tim.tv_nsec = sampling_period*1000;
-
- unsigned long tcommits_prev=0;
- unsigned long iterations=0;
- unsigned long prev_iterations=-1;
-
- float power_prev=0;
- float power=0;
- int j;
- float edp;
- float edp_prev = 0;
- /*while(tcommits_prev == 0){
-	tcommits_prev=get_total_commits();
- 	ulseep(10);	
- }*/
- while(running){
-    if(can_switch){
-	iterations += 1;
-	tcommits_pre = get_total_commits();
-	nanosleep(&tim , &tim2);
-	tcommits_post = get_total_commits();
-	tcommits = tcommits_post-tcommits_pre;
-
-	if(!running)
-                break;
-		
-	power = 0;
-        for (j = 0; j < nr_packages; j++)
-                power += source->get_power(j);
-	edp = tcommits/power;
-
-	printf("ferraris: %d, %f, %d, %f\n",ferraris,edp,tcommits,power);
-
-        
-	if (tcommits <= 30)
-                continue;
-	
-	//printf("commits: %d, sampling period: %d\n",tcommits,sampling_period);
-	/*if(tcommits < min_threshold){
-		sampling_period *= 2;
-		skip  = 1;
-		//tcommits_prev = tcommits*2;
-		continue;
-	}
-	if(tcommits > max_threshold){
-		sampling_period /= 2;
-		skip = 1;
-		if (sampling_period == 0)
-			sampling_period = 1;
-		//tcommits_prev = tcommits/2;
-		continue;
-	}*/
-
-
-        if(edp < edp_prev && !skip){
-
-
-		if((abs(ferraris-prev_turn)) <= 2 && abs(ferraris-prev_turn) > 0){
-                        oscillating += 1;
-                        //printf("oscillating at %d, %d\n",ferraris,prev_turn);
-                }
-                else
-                        oscillating = 0;
-                if(oscillating == 3){
-                        prev_iterations = iterations;
-                        can_switch = 0;
-                        oscillating = 0;
-                        printf("\n\ncaught oscillating\n\n");
-                        break;
-                }
-
-
-
-	//if(tcommits < tcommits_prev && !skip){
-		//confidence++;
-		prev_turn = ferraris;
-		//if(confidence == 2){
-			//confidence_threshold++;
-			dir *= -1;
-			//confidence == 0;
-			//if (dir != 1 || dir != -1)
-			//	dir = dir/2;
-			//if (dir==0)
-			//	dir = 1;
-		        //fprintf(stderr,"turning\t%d\t%d\t%d\t%d\n",iterations,tcommits,tcommits_prev,ferraris);
-		//}
-	}
-	//else
-	//	confidence = 0;
-	tcommits_prev = tcommits;
-	edp_prev = edp;
-	if(can_switch && !skip)
-		ferraris += dir;
-	skip = 0;
-	if (ferraris == -1){
-		prev_turn = 0;
-		ferraris = 0;
-	}
-	else if (ferraris > max_ferraris ){
-		ferraris = max_ferraris;
-		prev_turn = max_ferraris;
-	}
-	//asym_threshold += dir;
-	//if (asym_threshold == 0){
-	//	asym_threshold = 100;
-		//printf("zeroing: %d\n",asym_threshold);
-	//}
-	#if BO==DDASYM_ADPT || BO==DDASYM_SLEEP
- 		if (ferraris != 0){
-			if (asym_threshold < 50 && can_switch){
-				ferraris -= 2;
-				//printf("removing two ferraris: %d\n",ferraris); 
-				can_switch == 0;
-			}
-			else if (asym_threshold > 100 && !can_switch)
-				can_switch = 1;
-			else if (asym_threshold > 200){
-				can_switch == 1;
-				if (ferraris < 16)
-					ferraris += 2;
-			}
-		}
-	#endif
-    }
-    else{
-	//pthread_exit(NULL);
-
-	//break;
-	iterations += 1;
-
-	 tcommits_pre = get_total_commits();
-        nanosleep(&tim , &tim2);
-        tcommits_post = get_total_commits();
-        tcommits = tcommits_post-tcommits_pre;
-
-	power = 0;
-        for (j = 0; j < nr_packages; j++)
-                power += source->get_power(j);
-
-        if(power==0.0)
-                pthread_exit(NULL);
-
-        edp = tcommits/power;
-
-	printf("ferraris: %d, %f, %d, %f\n",ferraris,edp,tcommits,power);
-        if (iterations> prev_iterations+20 && jump == -1){
-                edp_prev=edp;
-                jump =  rand() % 17;//(100-thresh_index);
-                ferraris_prev = ferraris;
-                ferraris = jump;
-                skip = 1;
-		//can_switch=1;
-                printf("try this threshold: %d\n",jump);
-        }
+/*
+ * Linear scale of spin-to-sleep thresholds explored by the tuners.
+ */
+static void
+bo_init_thresholds(void)
+{
+  int j;
 
-        if (iterations> prev_iterations+21){
-                jump = -1;
-                if(edp<edp_prev){
-                        can_switch = 0;
-                        ferraris = ferraris_prev;
-                        prev_iterations = iterations;
-                }
-                else
-                        can_switch = 1;
-        }
+  for (j = 0; j < 150; j++)
+    backoff_thresholds[j] = 1500 + j * 1000;
+  min_backoff_threshold = 0;
+  max_backoff_threshold = 149;
+}
+
+/* Indexes are the SPIN_MODE values defined in stm_internal.h */
+static const char *spin_modes[] = {
+  /* 0 */ "nop",
+  /* 1 */ "pause",
+  /* 2 */ "tpause",
+  NULL
+};
 
+/*
+ * Select the spin wait primitive: TPAUSE if the CPU supports it, PAUSE
+ * against a TSC deadline if the TSC is invariant, the calibrated nop
+ * loop otherwise (the environment can select a supported lower one).
+ */
+static void
+bo_init_spin(void)
+{
+  int best = SPIN_MODE_NOP, i;
+  char *s;
+#if defined(__x86_64__) || defined(__i386__)
+  unsigned int a, b, c, d;
+
+  if (tsc_khz > 0 && __get_cpuid(0x80000007, &a, &b, &c, &d) && (d & (1 << 8))) {
+    best = SPIN_MODE_PAUSE;
+    /* CPUID.7.0:ECX.WAITPKG */
+    if (__get_cpuid_count(7, 0, &a, &b, &c, &d) && (c & (1 << 5)))
+      best = SPIN_MODE_TPAUSE;
+  }
+#endif /* defined(__x86_64__) || defined(__i386__) */
+  spin_mode = best;
+  if ((s = getenv(BACKOFF_SPIN)) != NULL) {
+    for (i = 0; spin_modes[i] != NULL; i++) {
+      if (strcasecmp(spin_modes[i], s) == 0)
+        break;
+    }
+    if (spin_modes[i] == NULL || i > best) {
+      fprintf(stderr, "Error: spin wait %s not available\n", s);
+      exit(1);
     }
+    spin_mode = i;
+  }
+  /* TSC ticks per spin() iteration (16-bit fixed point) */
+  spin_tsc_mult = (tsc_khz << 16) / (1000UL * spintosleep);
+  PRINT_DEBUG("\tBACKOFF_SPIN=%s\n", spin_modes[spin_mode]);
 }
- 
-
-        //for(j = 0; j < nr_packages; j++){
-        //        source->fini_device(j);
-        //        printf("Power for package %d: %f\n", j,source->get_energy(j));
-        //}
-
-   //pthread_exio(NULL);
-
-}
-
-thread_proc_3(void* x)
-{
- int jump = -1;
- int can_switch = 1;
- int dir = 75;
- int skip = 0;
- int tunfer = 1;
- int oscillating = 0;
- int confidence = 0;
- int thresh_index_prev,thresh_index_best;
- int prev_turn = -3;
- unsigned long min_threshold = 30;
- unsigned long max_threshold = 200;
- volatile unsigned long tcommits_pre=0;
- volatile unsigned long tcommits_post=0;
- int tcommits=0,tcommits_max;
- unsigned long sampling_period=10000;
- unsigned long tcommits_prev=0;
- unsigned long iterations=-1;
- unsigned long prev_iterations=-1;
-	
- struct timespec tim, tim2;
- tim.tv_sec = 0;
- tim.tv_nsec = sampling_period*10000;
-
- float power_pre,power_post,power_prev,power_max;
- float power=0;
- int j;
- float edp=0, edp_mae, edp_avg=0;
- float edp_prev = 0;
- 
-while(running){
-    if(can_switch){
-	iterations += 1;
-
-	tcommits_pre = get_total_commits();	
-        nanosleep(&tim , &tim2);
-	tcommits_post = get_total_commits();
-	tcommits = tcommits_post-tcommits_pre;
-	
-	if(!running)
-		break;
-	
-	power_post = 0;
-        for (j = 0; j < nr_packages; j++)
-                power_post += source->get_power(j);
-	power = power_post;
-
-	if(power==0.0)
-                pthread_exit(NULL);
-
-        edp = tcommits/power;
-
-	//thresholds[iterations] = thresh_index;
-	printf("%d: current threshold is %d %f %d %f with step %d\n",iterations, thresh_index,edp,tcommits,power,dir);
-
-
-	if (tcommits < 30){
-		if(jump!=-1)
-			skip = 1;
-		continue;
-	}
 
+static void
+bo_init_none(void)
+{
+}
 
-        if((edp < edp_prev) && !skip){
-
-
-               if((abs(thresh_index-prev_turn)) <= 3){
-                        oscillating += 1;
-                        printf("oscillating at %d, %d\n",thresh_index,prev_turn);
-                }
-                else
-                        oscillating = 0;
-                if(oscillating == 5){
-                        prev_iterations = iterations;
-                        can_switch = 0;
-                        oscillating = 0;
-                        thresholding = 0;
-                        printf("\n\ncaught oscillating\n\n");
-                }
-
-		prev_turn = thresh_index;
-			dir *= -1;
-			if (dir != 1 && dir != -1){
-				dir = dir/2;
-				if (dir==0)
-					dir = 1;
-			}
-	}
+/*
+ * Asymmetric backoff with a fixed set of fast cores.
+ */
+static void
+bo_init_asym(void)
+{
+  bo_init_ferraris();
+  ferraris = max_ferraris;
+  fast_cores_publish(ferraris);
+  dvfs_update();
+  srand(time(NULL));
+}
 
-	if(can_switch && !skip){
-                thresh_index += dir;
-        }
+/*
+ * Start from half of the fast cores for the online tuner.
+ */
+static void
+bo_init_tuned_asym(void)
+{
+  bo_init_ferraris();
+  ferraris = max_ferraris / 2;
+  fast_cores_publish(ferraris);
+  dvfs_update();
+  bo_init_thresholds();
+  thresholding = 1;
+}
 
+/*
+ * Asymmetric backoff with the number of fast cores and the spin-to-sleep
+ * threshold tuned online.
+ */
+static void
+bo_init_dasym(void)
+{
+  bo_init_tuned_asym();
+  tuner_start("ferraris,threshold");
+}
 
-	edp_prev = edp;
-	skip = 0;
+/*
+ * Same as above, also tuning the retries before fast cores back off
+ * exponentially.
+ */
+static void
+bo_init_ddasym(void)
+{
+  bo_init_tuned_asym();
+  tuner_start("ferraris,threshold,asym_threshold");
+}
 
-	if (thresh_index < 0){
-		//prev_turn = 0;
-		thresh_index = 0;
-	}
-	else if (thresh_index > max_backoff_threshold ){
-		//prev_turn = max_backoff_threshold;
-		thresh_index = max_backoff_threshold;
-	}
-	spintosleep = backoff_thresholds[thresh_index];
-	backoff_threshold = 55*spintosleep;  
-    }
-    else{
+/*
+ * Adaptive backoff with the spin-to-sleep threshold tuned online.
+ */
+static void
+bo_init_thresh(void)
+{
+  bo_init_thresholds();
+  tuner_start("threshold");
+}
 
-	#if BO==DASYM_ADPT
-	if(tunfer){
-		//thread_proc(NULL);
-		tunfer = 0;
-	}
-	#endif
-
-	//can_switch = 1;
-	//continue;
-
-        tcommits_pre = get_total_commits();
-        nanosleep(&tim , &tim2);
-        tcommits_post = get_total_commits();
-        tcommits = tcommits_post-tcommits_pre;
-
-	
-        if(!running)
-                break;
-
-        power_post = 0;
-        for (j = 0; j < nr_packages; j++)
-                power_post += source->get_power(j);
-        power = power_post;
-
-	if(power==0.0)
-		pthread_exit(NULL);
-		
-        edp = tcommits/power;
-        printf("current threshold is %d %f %d %f with step %d\n",thresh_index,edp,tcommits,power,dir);
-
-	if(tcommits<30)
-		continue;
-
-	iterations += 1;
-
-	if (iterations> prev_iterations+20 && jump == -1){
-		edp_prev=edp;
-		jump =  rand() % 100;//(100-thresh_index);
-		thresh_index_prev = thresh_index;
-		thresh_index = jump;
-		spintosleep = backoff_thresholds[thresh_index];
-        	backoff_threshold = 55*spintosleep;
-		skip = 1;
-		//can_switch = 1;
-	}
+/*
+ * Does the thread run on one of the current fast cores ("ferraris")?
+ */
+static INLINE int
+bo_fast_core(stm_tx_t *tx)
+{
+  return fast_core(tx->cpu_id);
+}
 
-        if (iterations> prev_iterations+21){
-		jump = -1;
-		//tunfer = 1;
-		if(edp<edp_prev){
-                        can_switch = 0;
-                        thresh_index = thresh_index_prev;
-                        spintosleep = backoff_thresholds[thresh_index];
-                        backoff_threshold = 55*spintosleep;
-                        prev_iterations = iterations;
-                }
-		else{
-			tunfer = 1;
-			can_switch = 1;
-		}
-	}
+/*
+ * Exponential growth of the backoff window.
+ */
+static void
+bo_grow_sym(stm_tx_t *tx)
+{
+  if (tx->backoff < max_backoff)
+    tx->backoff <<= 1;
+}
 
-	//can_switch=1;
-    }
+/*
+ * Linear growth on fast cores (until asym_threshold retries), exponential
+ * growth elsewhere.
+ */
+static void
+bo_grow_asym(stm_tx_t *tx)
+{
+  if (tx->backoff >= max_backoff)
+    return;
+  if (tx->_retries < asym_threshold && bo_fast_core(tx))
+    tx->backoff += 1000;
+  else
+    tx->backoff <<= 1;
+}
+
+/*
+ * Restart from the window learned for the atomic block.
+ */
+static void
+bo_reset(stm_tx_t *tx)
+{
+  tx->backoff = tx->bo_site->floor;
+}
+
+/*
+ * Sleep for the given number of microseconds.
+ */
+static void
+bo_sleep(stm_tx_t *tx, long sleeping)
+{
+  struct timespec tim, tim2;
+
+  if (sleeping < 0)
+    sleeping = 0;
+  tx->bo_slept += sleeping;
+  TRACE_EVENT(&tx->trace, TR_BACKOFF_START, TR_WAIT_SLEEP, 0, sleeping * spintosleep);
+  tim.tv_sec = 0;
+  tim.tv_nsec = sleeping * 1000;
+  if (sleeping > 999999) {
+    tim.tv_sec = sleeping / 1000000;
+    tim.tv_nsec = (sleeping % 1000000) * 1000;
   }
-   pthread_exit(NULL);
+  /* Sleep the remainder if interrupted by a signal */
+  while (nanosleep(&tim, &tim2) != 0 && errno == EINTR)
+    tim = tim2;
+  TRACE_EVENT(&tx->trace, TR_BACKOFF_END, TR_WAIT_SLEEP, 0, 0);
 }
 
+/*
+ * Spin for the time of the given number of calibrated iterations.
+ */
+static INLINE void
+bo_spin(stm_tx_t *tx, unsigned long wait)
+{
+  tx->bo_spun += wait;
+  TRACE_EVENT(&tx->trace, TR_BACKOFF_START, TR_WAIT_SPIN, 0, wait);
+  spin_wait(wait, spin_mode);
+  TRACE_EVENT(&tx->trace, TR_BACKOFF_END, TR_WAIT_SPIN, 0, 0);
+}
 
+static void
+bo_wait_spin(stm_tx_t *tx, unsigned long wait)
+{
+  bo_spin(tx, wait);
+}
 
+/*
+ * Same as spinning, with PAUSE even if TPAUSE is available.
+ */
+static void
+bo_wait_spin_pause(stm_tx_t *tx, unsigned long wait)
+{
+  tx->bo_spun += wait;
+  TRACE_EVENT(&tx->trace, TR_BACKOFF_START, TR_WAIT_SPIN, 0, wait);
+  spin_wait(wait, spin_mode == SPIN_MODE_NOP ? SPIN_MODE_NOP : SPIN_MODE_PAUSE);
+  TRACE_EVENT(&tx->trace, TR_BACKOFF_END, TR_WAIT_SPIN, 0, 0);
+}
 
-thread_proc_2(void* x)
+static void
+bo_wait_sleep(stm_tx_t *tx, unsigned long wait)
 {
-	do_measure_all_cpus(100000,0);
-	pthread_exit(NULL);
+  bo_sleep(tx, wait - 75000 / 1500);
+}
+
+/*
+ * Spin for short waits, sleep (minus the cost of sleeping) for long ones
+ * (the threshold is learned per atomic block around the global one).
+ */
+static void
+bo_wait_adpt(stm_tx_t *tx, unsigned long wait)
+{
+  if (wait > bo_site_threshold(tx)) {
+    bo_sleep(tx, ((long)wait - beta * spintosleep) / spintosleep);
+  } else {
+    bo_spin(tx, wait);
+    tx->bo_site->spun = 1;
+  }
+}
+
+/*
+ * Park until the contended lock is released, with the backoff as
+ * timeout (sleep if the abort was not caused by a lock).
+ */
+static void
+bo_wait_park(stm_tx_t *tx, unsigned long wait)
+{
+  long usec = ((long)wait - park_beta * spintosleep) / spintosleep;
+
+  if (usec < 0)
+    usec = 0;
+  if (tx->c_lock != NULL) {
+    tx->bo_slept += usec;
+    TRACE_EVENT(&tx->trace, TR_BACKOFF_START, TR_WAIT_PARK, 0, wait);
+    stm_park(tx, usec);
+    TRACE_EVENT(&tx->trace, TR_BACKOFF_END, TR_WAIT_PARK, 0, 0);
+  } else {
+    bo_sleep(tx, usec);
+  }
+}
+
+/*
+ * Spin for short waits, park for long ones.
+ */
+static void
+bo_wait_adpt_park(stm_tx_t *tx, unsigned long wait)
+{
+  if (wait > bo_site_threshold(tx)) {
+    bo_wait_park(tx, wait);
+  } else {
+    bo_spin(tx, wait);
+    tx->bo_site->spun = 1;
+  }
 }
 
+/* Indexes are the BO values defined in stm_internal.h */
+static const bo_policy_t bos[] = {
+  /* 0 */ { "adpt", bo_init_none, bo_grow_sym, bo_reset, bo_wait_adpt },
+  /* 1 */ { "spin", bo_init_none, bo_grow_sym, bo_reset, bo_wait_spin },
+  /* 2 */ { "sleep", bo_init_none, bo_grow_sym, bo_reset, bo_wait_sleep },
+  /* 3 */ { "spin_pause", bo_init_none, bo_grow_sym, bo_reset, bo_wait_spin_pause },
+  /* 4 */ { "asym_adpt", bo_init_asym, bo_grow_asym, bo_reset, bo_wait_adpt },
+  /* 5 */ { "asym_spin", bo_init_asym, bo_grow_asym, bo_reset, bo_wait_spin },
+  /* 6 */ { "asym_sleep", bo_init_asym, bo_grow_asym, bo_reset, bo_wait_sleep },
+  /* 7 */ { "dasym_adpt", bo_init_dasym, bo_grow_asym, bo_reset, bo_wait_adpt },
+  /* 8 */ { "ddasym_adpt", bo_init_ddasym, bo_grow_asym, bo_reset, bo_wait_adpt },
+  /* 9 */ { "dasym_sleep", bo_init_dasym, bo_grow_asym, bo_reset, bo_wait_sleep },
+  /* 10 */ { "ddasym_sleep", bo_init_ddasym, bo_grow_asym, bo_reset, bo_wait_sleep },
+  /* 11 */ { "adpt_thresh", bo_init_thresh, bo_grow_sym, bo_reset, bo_wait_adpt },
+  /* 12 */ { "asym_adpt_thresh", bo_init_asym, bo_grow_asym, bo_reset, bo_wait_adpt },
+  /* 13 */ { "dasym_spin", bo_init_asym, bo_grow_asym, bo_reset, bo_wait_spin },
+  /* 14 */ { "park", bo_init_none, bo_grow_sym, bo_reset, bo_wait_park },
+  /* 15 */ { "adpt_park", bo_init_none, bo_grow_sym, bo_reset, bo_wait_adpt_park },
+  /* 16 */ { "asym_adpt_park", bo_init_asym, bo_grow_asym, bo_reset, bo_wait_adpt_park },
+  { NULL, NULL, NULL, NULL, NULL }
+};
+#endif /* GREEN_BACKOFF */
+
 /* ################################################################### *
  * STM FUNCTIONS
  * ################################################################### */
@@ -772,10 +658,25 @@ _CALLCONV void
 stm_init(void)
 {
 	int j;
-        source = get_available_sources();
-        assert(source != NULL);
+	const char *name;
+#ifdef TM_TRACE
+	trace_open();
+#endif /* TM_TRACE */
+	stats_shm_open(cm_names[CM]);
+	topo_init();
+#if CLOCK_SCHEME == CLOCK_HIER
+	/* Threads of the same socket combine their clock increments */
+	for (j = 0; j < topo_nb_cpus; j++)
+	  _tinystm.clock_group_of[topo_cpus[j].cpu] = topo_cpus[j].package % CLOCK_GROUPS;
+#endif /* CLOCK_SCHEME == CLOCK_HIER */
+	/* Select energy source (first available one unless set in the environment) */
+	source = energy_open(getenv(ENERGY_SOURCE), &name);
+	if (source == NULL) {
+	  fprintf(stderr, "Error: energy source %s not available\n", getenv(ENERGY_SOURCE));
+	  exit(1);
+	}
         nr_packages = source->get_nr_packages();
-        printf("Found %d packages.\n", nr_packages);
+        printf("Found %d packages (%s).\n", nr_packages, name);
 
         for(j = 0; j < nr_packages; j++){
                 source->init_device(j);
@@ -783,49 +684,6 @@ stm_init(void)
 	pthread_t t2;
         pthread_create(&t2, NULL, thread_proc_2, NULL);
 	running = 1;
-#if CM == CM_BACKOFF
-	thresh_index  = 0;
-	spintosleep = atoi(getenv("SPINTOSLEEP"));
-	beta = atoi(getenv("BETA"));
-	backoff_threshold = spintosleep*(beta+5);
-	//pthread_t t3;
-        //pthread_create(&t3, NULL, thread_proc_3, NULL);
-	//pthread_t t5;
-        //pthread_create(&t5, NULL, thread_proc_5, NULL);
-	//backoff_threshold = atoi(getenv("THRESHOLD"));
-	//spintosleep = 3.0;
-	#if BO==ASYM_ADPT || BO==ASYM_SPIN || BO==ASYM_SLEEP || BO==ASYM_ADPT_THRESH || BO==DASYM_SPIN
-	max_ferraris = atoi(getenv("FERRARIS"));
-	ferraris = max_ferraris;
-	asym_threshold = 1000000000;
-	srand(time(NULL));
-	#elif BO==DASYM_ADPT || BO==DDASYM_ADPT || BO==DASYM_SLEEP || BO==DDASYM_SLEEP || BO==DASYM_SPIN
-	max_ferraris = atoi(getenv("FERRARIS"));
-	ferraris=max_ferraris/2;
-	asym_threshold = 1000000000;
-	for(j=0;j<150;j++)
-                backoff_thresholds[j] = 1500+j*1000;
-        min_backoff_threshold = 0;
-        max_backoff_threshold = 149;
-	thresholding = 1;
-	pthread_t t3;
-        pthread_create(&t3, NULL, thread_proc_4, NULL);
-	//pthread_t t1;
-        //pthread_create(&t1, NULL, thread_proc, NULL);
-	#elif BO==ADPT_THRESH || BO==ASYM_ADPT_THRESH
-	//backoff_thresholds[0]=1500;
-	for(j=0;j<150;j++)
-		//backoff_thresholds[j] = backoff_thresholds[j-1]+0.045*backoff_thresholds[j];
-		backoff_thresholds[j] = 1500+j*1000;
-		//backoff_thresholds[j] = (1UL << j+4);
-
-	min_backoff_threshold = 0;
-	max_backoff_threshold = 149;
-	//backoff_threshold = backoff_thresholds[15];
-	pthread_t t3;
-        pthread_create(&t3, NULL, thread_proc_3, NULL);
-	#endif
-#endif
 #if CM == CM_MODULAR
   char *s;
   #if MOD == KARMA
@@ -867,14 +725,71 @@ stm_init(void)
   PRINT_DEBUG("\tVR_THRESHOLD=%d\n", _tinystm.vr_threshold);
 #endif /* CM == CM_MODULAR */
 
-  /* Set locks and clock but should be already to 0 */
-  memset((void *)_tinystm.locks, 0, LOCK_ARRAY_SIZE * sizeof(stm_word_t));
+  /* Map locks (already 0) and reset clock */
+  lock_table_alloc();
   CLOCK = 0;
+  rs_scan_init();
 
   stm_quiesce_init();
 
   tls_init();
 
+#ifdef GREEN_BACKOFF
+  thresh_index  = 0;
+  {
+    /* Measured costs of spinning and sleeping (the environment overrides them) */
+    calibration_t c;
+    char *s;
+    calibrate(&c);
+    spintosleep = ((s = getenv(SPINTOSLEEP)) != NULL && atoi(s) > 0 ? atoi(s) : c.spintosleep);
+    beta = ((s = getenv(BETA)) != NULL ? atoi(s) : c.beta);
+    park_beta = ((s = getenv(PARK_BETA)) != NULL ? atoi(s) : c.park_beta);
+    tsc_khz = c.tsc_khz;
+    sim_spin_rate = c.spintosleep;
+    PRINT_DEBUG("\tSPINTOSLEEP=%d BETA=%d PARK_BETA=%d TSC=%lukHz\n", spintosleep, beta, park_beta, tsc_khz);
+  }
+  backoff_threshold = spintosleep*(beta+5);
+  bo_init_spin();
+#ifdef IRREVOCABLE_ENABLED
+  {
+    /* Starvation guard (0 disables it) */
+    char *s = getenv(STARVE_THRESHOLD);
+    starve_threshold = (s != NULL ? strtoul(s, NULL, 10) : STARVE_THRESHOLD_DEFAULT);
+    PRINT_DEBUG("\tSTARVE_THRESHOLD=%lu\n", starve_threshold);
+  }
+#endif /* IRREVOCABLE_ENABLED */
+#ifdef CONFLICT_SCHED
+  {
+    /* Conflict-aware scheduling of retries (0 disables it) */
+    char *s = getenv(SCHED_THRESHOLD);
+    sched_threshold = (s != NULL ? strtoul(s, NULL, 10) : 0);
+    PRINT_DEBUG("\tSCHED_THRESHOLD=%lu\n", sched_threshold);
+  }
+#endif /* CONFLICT_SCHED */
+  /* Frequency of fast and slow cores (no actuation if unset) */
+  if (!dvfs_open(getenv(DVFS_BACKEND))) {
+    fprintf(stderr, "Error: DVFS backend %s not available\n", getenv(DVFS_BACKEND));
+    exit(1);
+  }
+  PRINT_DEBUG("\tDVFS_BACKEND=%s\n", (dvfs != NULL ? dvfs->name : "none"));
+  //backoff_threshold = atoi(getenv("THRESHOLD"));
+  //spintosleep = 3.0;
+  /* Select backoff policy (the environment overrides the one set at compile time) */
+  if (_tinystm.backoff_policy == NULL) {
+    char *s = getenv(BACKOFF_POLICY);
+    if (s == NULL)
+      _tinystm.backoff_policy = &bos[BO];
+    else if (!stm_set_parameter("backoff_policy", s)) {
+      fprintf(stderr, "Error: unknown backoff policy %s\n", s);
+      exit(1);
+    }
+  }
+  PRINT_DEBUG("\tBACKOFF_POLICY=%s\n", _tinystm.backoff_policy->name);
+  _tinystm.backoff_policy->init();
+  admission_start();
+#endif /* GREEN_BACKOFF */
+  stats_shm_publish();
+
 #ifdef SIGNAL_HANDLER
   if (getenv(NO_SIGNAL_HANDLER) == NULL) {
     /* Catch signals for non-faulting load */
@@ -890,24 +805,50 @@ stm_init(void)
   _tinystm.initialized = 1;
 }
 
+#ifdef TM_STATISTICS
+/*
+ * Print the histograms of exited threads (durations in microseconds
+ * if the TSC frequency is known).
+ */
+static void
+hist_report(void)
+{
+  static const double p[] = { 50, 90, 99, 99.9 };
+  const stm_hist_t *h;
+  double scale;
+  int i, j;
+
+  printf("Histograms (durations in %s):\n", tsc_khz != 0 ? "us" : "TSC ticks");
+  for (i = 0; i < HIST_NB; i++) {
+    h = &_tinystm.hist[i];
+    if (h->count == 0)
+      continue;
+    scale = (i == HIST_RETRIES || tsc_khz == 0 ? 1 : 1000.0 / tsc_khz);
+    printf("  %-14s | count:%12llu mean:%12.2f", hist_names[i], h->count, h->sum * scale / h->count);
+    for (j = 0; j < (int)(sizeof(p) / sizeof(p[0])); j++)
+      printf(" p%g:%12.2f", p[j], hist_percentile(h, p[j]) * scale);
+    printf(" max:%12.2f\n", h->max * scale);
+  }
+}
+#endif /* TM_STATISTICS */
+
 /*
  * Called once (from main) to clean up STM infrastructure.
  */
 _CALLCONV void
 stm_exit(void)
 {
-	//#if BO==ASYM_ADPT || BO==ASYM_SPIN || BO==ASYM_SLEEP
+	/* Frequency samples are only recorded in the trace (TR_FREQ) */
 	running = 0;
-	int x,y;
-	for (x=0;x<64;x++){
-		fprintf(stderr,"cpu %d:\t",x);
-		for (y=0;y<7;y++){
-			fprintf(stderr,"%d\t",freqmonitor[x][y]);
-		}
-		fprintf(stderr,"\n");
-	}
-	//#endif
 	usleep(2);
+#ifdef TM_TRACE
+	trace_close();
+#endif /* TM_TRACE */
+	stats_shm_close();
+#ifdef GREEN_BACKOFF
+	dvfs_report();
+	dvfs_close();
+#endif /* GREEN_BACKOFF */
 	int j;
         for(j = 0; j < nr_packages; j++){
                 source->fini_device(j);
@@ -919,6 +860,11 @@ stm_exit(void)
   if (!_tinystm.initialized)
     return;
 
+#ifdef TM_STATISTICS
+  if (getenv("TM_STATISTICS") != NULL)
+    hist_report();
+#endif /* TM_STATISTICS */
+
   tls_exit();
   stm_quiesce_exit();
 
@@ -926,15 +872,33 @@ stm_exit(void)
   gc_exit();
 #endif /* EPOCH_GC */
 
+  lock_table_free();
+
   _tinystm.initialized = 0;
 }
 
+/*
+ * Called by the CURRENT thread to run on the CPU planned for it.
+ */
+_CALLCONV int
+stm_bind_thread(long id)
+{
+  int cpu;
+
+  if (!_tinystm.initialized || (cpu = topo_thread_cpu(id)) < 0)
+    return -1;
+  if (stick_this_thread_to_core(cpu) != 0)
+    return -1;
+  return cpu;
+}
+
 /*
  * Called by the CURRENT thread to initialize thread-local STM data.
  */
 _CALLCONV stm_tx_t *
 stm_init_thread(void)
 {
+  energy_thread_change(NULL);
   return int_stm_init_thread();
 }
 
@@ -945,12 +909,14 @@ _CALLCONV void
 stm_exit_thread(void)
 {
   TX_GET;
+  energy_thread_change(tx);
   int_stm_exit_thread(tx);
 }
 
 _CALLCONV void
 stm_exit_thread_tx(stm_tx_t *tx)
 {
+  energy_thread_change(tx);
   int_stm_exit_thread(tx);
 }
 
@@ -1152,6 +1118,46 @@ stm_get_stats_tx(stm_tx_t *tx, const char *name, void *val)
   return int_stm_get_stats(tx, name, val);
 }
 
+/*
+ * Return the commits and aborts of all threads (past and present).
+ */
+_CALLCONV void
+stm_get_counters(stm_counters_t *counters)
+{
+  stats_slab_t *slab;
+  tx_stats_t *st;
+  stm_word_t seq, commits, aborts;
+  int i;
+
+  counters->commits = counters->aborts = 0;
+  for (slab = _tinystm.stats; slab != NULL; slab = slab->next) {
+    for (i = 0; i < STATS_SLAB_SLOTS; i++) {
+      st = &slab->slots[i];
+      /* Consistent pair of counters (the owner only holds seq odd briefly) */
+      do {
+        seq = ATOMIC_LOAD_ACQ(&st->seq);
+        commits = ATOMIC_LOAD(&st->commits);
+        aborts = ATOMIC_LOAD(&st->aborts);
+        ATOMIC_MB_READ;
+      } while ((seq & 1) != 0 || ATOMIC_LOAD(&st->seq) != seq);
+      counters->commits += commits;
+      counters->aborts += aborts;
+    }
+  }
+}
+
+_CALLCONV void
+stm_hist_merge(stm_hist_t *dst, const stm_hist_t *src)
+{
+  hist_merge(dst, src);
+}
+
+_CALLCONV unsigned long long
+stm_hist_percentile(const stm_hist_t *hist, double percentile)
+{
+  return hist_percentile(hist, percentile);
+}
+
 /*
  * Return STM parameters.
  */
@@ -1166,20 +1172,64 @@ stm_get_parameter(const char *name, void *val)
     *(const char **)val = design_names[DESIGN];
     return 1;
   }
+  if (strcmp("clock_scheme", name) == 0) {
+    *(const char **)val = clock_names[CLOCK_SCHEME];
+    return 1;
+  }
+  if (strcmp("lock_table_size", name) == 0) {
+    *(unsigned long *)val = (unsigned long)_tinystm.lock_mask + 1;
+    return 1;
+  }
+  if (strcmp("lock_shift", name) == 0) {
+    *(int *)val = _tinystm.lock_shift;
+    return 1;
+  }
+  if (strcmp("lock_table_pages", name) == 0) {
+    *(const char **)val = lt_pages_names[lt_pages];
+    return 1;
+  }
+  if (strcmp("lock_table_numa", name) == 0) {
+    *(const char **)val = (lt_interleaved ? "interleave" : "local");
+    return 1;
+  }
+  if (strcmp("validate_kernel", name) == 0) {
+    *(const char **)val = _tinystm.rs_scan_name;
+    return 1;
+  }
   if (strcmp("initial_rw_set_size", name) == 0) {
     *(int *)val = RW_SET_SIZE;
     return 1;
   }
-#if CM == CM_BACKOFF
+  if (strcmp("thread_placement", name) == 0) {
+    *(const char **)val = topo_placement;
+    return 1;
+  }
+#ifdef GREEN_BACKOFF
   if (strcmp("min_backoff", name) == 0) {
     *(unsigned long *)val = MIN_BACKOFF;
     return 1;
   }
   if (strcmp("max_backoff", name) == 0) {
-    *(unsigned long *)val = MAX_BACKOFF;
+    *(unsigned long *)val = max_backoff;
+    return 1;
+  }
+  if (strcmp("backoff_policy", name) == 0) {
+    *(const char **)val = (_tinystm.backoff_policy != NULL ? _tinystm.backoff_policy->name : bos[BO].name);
+    return 1;
+  }
+  if (strcmp("starve_threshold", name) == 0) {
+    *(unsigned long *)val = starve_threshold;
+    return 1;
+  }
+  if (strcmp("sched_threshold", name) == 0) {
+    *(unsigned long *)val = sched_threshold;
+    return 1;
+  }
+  if (strcmp("dvfs_backend", name) == 0) {
+    *(const char **)val = (dvfs != NULL ? dvfs->name : NULL);
     return 1;
   }
-#endif /* CM == CM_BACKOFF */
+#endif /* GREEN_BACKOFF */
 #if CM == CM_MODULAR
   if (strcmp("vr_threshold", name) == 0) {
     *(int *)val = _tinystm.vr_threshold;
@@ -1201,8 +1251,30 @@ stm_get_parameter(const char *name, void *val)
 _CALLCONV int
 stm_set_parameter(const char *name, void *val)
 {
-#if CM == CM_MODULAR
+#if CM == CM_MODULAR || defined(GREEN_BACKOFF)
   int i;
+#endif /* CM == CM_MODULAR || defined(GREEN_BACKOFF) */
+
+  /* Lock table geometry (before stm_init only) */
+  if (lock_table_set_parameter(name, val))
+    return 1;
+#ifdef GREEN_BACKOFF
+  if (strcmp("backoff_policy", name) == 0) {
+    for (i = 0; bos[i].name != NULL; i++) {
+      if (strcasecmp(bos[i].name, (const char *)val) == 0) {
+        _tinystm.backoff_policy = &bos[i];
+        /* Switching online: set up the new policy right away */
+        if (_tinystm.initialized) {
+          bos[i].init();
+          stats_shm_publish();
+        }
+        return 1;
+      }
+    }
+    return 0;
+  }
+#endif /* GREEN_BACKOFF */
+#if CM == CM_MODULAR
 
   if (strcmp("cm_policy", name) == 0) {
     for (i = 0; cms[i].name != NULL; i++) {
@@ -1535,7 +1607,6 @@ int_stm_set_irrevocable(stm_tx_t *tx, int serial)
     /* Success: remember we have the lock */
     tx->irrevocable++;
     /* Try validating transaction */
-printf(DESIGN);
 #if DESIGN == WRITE_BACK_ETL
     if (!stm_wbetl_validate(tx)) {
       stm_rollback(tx, STM_ABORT_VALIDATE);
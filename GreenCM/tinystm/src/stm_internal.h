@@ -35,20 +35,37 @@
 #include "atomic.h"
 #include "gc.h"
 #include <sched.h>
-
-unsigned long asym_threshold;
-unsigned long backoff_threshold;
-float backoff_thresholds[1500];
-unsigned long min_backoff_threshold;
-unsigned long max_backoff_threshold;
-unsigned int thresholds[10000];
-unsigned int ferraris;
-unsigned int max_ferraris;
-int running;
-int thresholding;
-int spintosleep;
-int beta;
-int thresh_index;
+#include <limits.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#include "stats_format.h"
+#include "hist.h"
+#include "set_index.h"
+#ifdef TM_TRACE
+# include "trace_format.h"
+#endif /* TM_TRACE */
+
+extern unsigned long asym_threshold;
+extern unsigned long starve_threshold;
+extern unsigned long sched_threshold;
+extern unsigned long backoff_threshold;
+extern unsigned long max_backoff;
+extern float backoff_thresholds[1500];
+extern unsigned long min_backoff_threshold;
+extern unsigned long max_backoff_threshold;
+extern unsigned int thresholds[10000];
+extern unsigned int ferraris;
+extern unsigned int max_ferraris;
+extern int running;
+extern int thresholding;
+extern int spintosleep;
+extern int beta;
+extern int park_beta;
+extern unsigned long tsc_khz;
+extern int spin_mode;
+extern unsigned long spin_tsc_mult;
+extern int thresh_index;
 
 /*int athreads_4[4] = {0,1,2,3};
 int athreads_8[8] = {0,1,2,3,4,5,6,7};
@@ -77,6 +94,9 @@ int athreads_64[64] = {0,1,16,17,32,33,48,49,8,9,24,25,40,41,56,57,2,3,4,5,6,7,1
 #define ADPT_THRESH			11
 #define ASYM_ADPT_THRESH		12
 #define DASYM_SPIN			13
+#define PARK				14
+#define ADPT_PARK			15
+#define ASYM_ADPT_PARK			16
 
 #ifndef BO
 # define BO				SPIN
@@ -102,6 +122,24 @@ int athreads_64[64] = {0,1,16,17,32,33,48,49,8,9,24,25,40,41,56,57,2,3,4,5,6,7,1
 # define DESIGN                         WRITE_BACK_ETL
 #endif /* ! DESIGN */
 
+/* Global clock schemes */
+#define CLOCK_GV1                       0                   /* Fetch-and-increment upon update commit */
+#define CLOCK_GV4                       1                   /* CAS, or share the timestamp of the winner */
+#define CLOCK_GV5                       2                   /* Commit at clock + 1, advance the clock on demand */
+#define CLOCK_HIER                      3                   /* GV4 with per-socket combining */
+
+#ifndef CLOCK_SCHEME
+# define CLOCK_SCHEME                   CLOCK_GV1
+#endif /* ! CLOCK_SCHEME */
+
+#if CLOCK_SCHEME == CLOCK_GV5 && DESIGN != WRITE_BACK_ETL
+# error "GV5 clock can only be used with WB-ETL design"
+#endif /* CLOCK_SCHEME == CLOCK_GV5 && DESIGN != WRITE_BACK_ETL */
+
+#if defined(INCREMENTAL_VALIDATION) && CLOCK_SCHEME != CLOCK_GV1
+# error "INCREMENTAL_VALIDATION requires unique commit timestamps (GV1 clock)"
+#endif /* defined(INCREMENTAL_VALIDATION) && CLOCK_SCHEME != CLOCK_GV1 */
+
 /* Contention managers */
 #define CM_SUICIDE                      0
 #define CM_DELAY                        1
@@ -112,6 +150,17 @@ int athreads_64[64] = {0,1,16,17,32,33,48,49,8,9,24,25,40,41,56,57,2,3,4,5,6,7,1
 # define CM                             CM_SUICIDE
 #endif /* ! CM */
 
+/* Green-CM backoff: how a transaction waits after an abort.  With
+ * MODULAR_BACKOFF, the losers of the CM_MODULAR arbitration wait the
+ * same way instead of busy waiting on the contended lock. */
+#if CM == CM_BACKOFF || (CM == CM_MODULAR && defined(MODULAR_BACKOFF))
+# define GREEN_BACKOFF
+#endif /* CM == CM_BACKOFF || (CM == CM_MODULAR && defined(MODULAR_BACKOFF)) */
+
+#if defined(MODULAR_BACKOFF) && CM != CM_MODULAR
+# error "MODULAR_BACKOFF can only be used with MODULAR contention manager"
+#endif /* defined(MODULAR_BACKOFF) && CM != CM_MODULAR */
+
 #if DESIGN != WRITE_BACK_ETL && CM == CM_MODULAR
 # error "MODULAR contention manager can only be used with WB-ETL design"
 #endif /* DESIGN != WRITE_BACK_ETL && CM == CM_MODULAR */
@@ -124,6 +173,11 @@ int athreads_64[64] = {0,1,16,17,32,33,48,49,8,9,24,25,40,41,56,57,2,3,4,5,6,7,1
 # error "MODULAR contention manager requires EPOCH_GC"
 #endif /* CM == CM_MODULAR && ! defined(EPOCH_GC) */
 
+#if defined(GREEN_BACKOFF) && defined(EPOCH_GC)
+/* Conflict-aware scheduling of retries (owners of locks must not be freed while read) */
+# define CONFLICT_SCHED
+#endif /* defined(GREEN_BACKOFF) && defined(EPOCH_GC) */
+
 #if defined(READ_LOCKED_DATA) && CM != CM_MODULAR
 # error "READ_LOCKED_DATA can only be used with MODULAR contention manager"
 #endif /* defined(READ_LOCKED_DATA) && CM != CM_MODULAR */
@@ -148,14 +202,69 @@ int athreads_64[64] = {0,1,16,17,32,33,48,49,8,9,24,25,40,41,56,57,2,3,4,5,6,7,1
 
 #define	BACKINGOFF	{0,0}
 
-#if CM == CM_BACKOFF
+#ifndef MAX_CPUS
+# define MAX_CPUS                       1024                /* Upper bound on CPU numbers (multiple of 64) */
+#endif /* ! MAX_CPUS */
+
+#ifndef STATS_SHM_SLABS
+# define STATS_SHM_SLABS                4                   /* Counter slabs in the statistics segment */
+#endif /* ! STATS_SHM_SLABS */
+
+#ifdef GREEN_BACKOFF
 # ifndef MIN_BACKOFF
 #  define MIN_BACKOFF                   (1UL << 4)
 # endif /* MIN_BACKOFF */
 # ifndef MAX_BACKOFF
 #  define MAX_BACKOFF                   (1UL << 31)
 # endif /* MAX_BACKOFF */
-#endif /* CM == CM_BACKOFF */
+#endif /* GREEN_BACKOFF */
+
+#ifdef GREEN_BACKOFF
+# define BACKOFF_POLICY                 "BACKOFF_POLICY"
+# define FERRARIS                       "FERRARIS"
+# define SPINTOSLEEP                    "SPINTOSLEEP"
+# define BETA                           "BETA"
+# define PARK_BETA                      "PARK_BETA"
+# define CALIBRATION_FILE               "CALIBRATION_FILE"
+# define TUNER_PARAMS                   "TUNER_PARAMS"
+# define TUNER_OPTIMIZER                "TUNER_OPTIMIZER"
+# define DVFS_BACKEND                   "DVFS_BACKEND"
+# define DVFS_FREQS                     "DVFS_FREQS"
+# define DVFS_EPP                       "DVFS_EPP"
+# define TUNER_OBJECTIVE                "TUNER_OBJECTIVE"
+# define TUNER_PERIOD                   "TUNER_PERIOD"
+# define BACKOFF_SPIN                   "BACKOFF_SPIN"
+# define ADMISSION                      "ADMISSION"
+# define ADMISSION_PERIOD               "ADMISSION_PERIOD"
+# define STARVE_THRESHOLD               "STARVE_THRESHOLD"
+# ifndef STARVE_THRESHOLD_DEFAULT
+#  define STARVE_THRESHOLD_DEFAULT      0                   /* Retries before escalation (0: disabled) */
+# endif /* STARVE_THRESHOLD_DEFAULT */
+# define SCHED_THRESHOLD                "SCHED_THRESHOLD"
+# ifndef SCHED_PARK_USEC
+#  define SCHED_PARK_USEC               1000                /* Timeout of a retry queued behind another transaction */
+# endif /* SCHED_PARK_USEC */
+# define ADM_OPEN                       (~(stm_word_t)0)    /* Admission cap when the gate is open */
+# ifndef ADM_PARK_USEC
+#  define ADM_PARK_USEC                 1000                /* Timeout of a thread parked at the gate */
+# endif /* ADM_PARK_USEC */
+# define SPIN_MODE_NOP                  0                   /* Calibrated nop loop */
+# define SPIN_MODE_PAUSE                1                   /* PAUSE until a TSC deadline */
+# define SPIN_MODE_TPAUSE               2                   /* TPAUSE until a TSC deadline */
+# ifndef PARK_LOG_STRIPES
+#  define PARK_LOG_STRIPES              10                  /* Futexes for parked threads: 2^10 = 1024 */
+# endif /* PARK_LOG_STRIPES */
+# define PARK_STRIPES                   (1 << PARK_LOG_STRIPES)
+# define PARK_IDX(l)                    ((stm_word_t)((l) - _tinystm.locks) & (PARK_STRIPES - 1))
+# define PARK_WORD_BITS                 (8 * sizeof(unsigned long))
+# ifndef BO_LOG_SITES
+#  define BO_LOG_SITES                  4                   /* Atomic blocks tracked per thread: 2^4 = 16 */
+# endif /* BO_LOG_SITES */
+# define BO_SITES                       (1 << BO_LOG_SITES)
+# define BO_SCALE_ONE                   256                 /* Fixed-point 1.0 for the per-site threshold */
+# define BO_SCALE_MIN                   (BO_SCALE_ONE / 16)
+# define BO_SCALE_MAX                   (BO_SCALE_ONE * 16)
+#endif /* GREEN_BACKOFF */
 
 #if CM == CM_MODULAR
 # define VR_THRESHOLD                   "VR_THRESHOLD"
@@ -165,6 +274,40 @@ int athreads_64[64] = {0,1,16,17,32,33,48,49,8,9,24,25,40,41,56,57,2,3,4,5,6,7,1
 #endif /* CM == CM_MODULAR */
 
 #define NO_SIGNAL_HANDLER               "NO_SIGNAL_HANDLER"
+#define ENERGY_SOURCE                   "ENERGY_SOURCE"
+#define ENERGY_SIM_MODEL                "ENERGY_SIM_MODEL"
+#define FREQ_SOURCE                     "FREQ_SOURCE"
+#define FREQ_PERIOD                     "FREQ_PERIOD"
+#define STATS_SHM                       "STATS_SHM"
+#define LOCK_TABLE_LOG_SIZE             "LOCK_TABLE_LOG_SIZE"
+#define LOCK_TABLE_SHIFT                "LOCK_TABLE_SHIFT"
+#define LOCK_TABLE_PAGES                "LOCK_TABLE_PAGES"
+#define LOCK_TABLE_NUMA                 "LOCK_TABLE_NUMA"
+#define VALIDATE_KERNEL                 "VALIDATE_KERNEL"
+#define FAST_CORE_ORDER                 "FAST_CORE_ORDER"
+#define THREAD_PLACEMENT                "THREAD_PLACEMENT"
+#ifdef INCREMENTAL_VALIDATION
+# ifndef COMMIT_RING_LOG_SIZE
+#  define COMMIT_RING_LOG_SIZE          10                  /* Commits recorded: 2^10 = 1024 */
+# endif /* ! COMMIT_RING_LOG_SIZE */
+# define COMMIT_RING_SIZE               (1 << COMMIT_RING_LOG_SIZE)
+# define COMMIT_RING_LOCKS              6                   /* Locks recorded per commit (one cache line) */
+#endif /* INCREMENTAL_VALIDATION */
+#if CLOCK_SCHEME == CLOCK_HIER
+# ifndef CLOCK_GROUPS
+#  define CLOCK_GROUPS                  8                   /* Combining slots (sockets beyond share them) */
+# endif /* ! CLOCK_GROUPS */
+#endif /* CLOCK_SCHEME == CLOCK_HIER */
+#ifdef TM_TRACE
+# define TRACE_FILE                     "TRACE_FILE"
+# define TRACE_SIZE                     "TRACE_SIZE"
+# ifndef TRACE_SIZE_DEFAULT
+#  define TRACE_SIZE_DEFAULT            256                 /* Megabytes (sparse file) */
+# endif /* TRACE_SIZE_DEFAULT */
+# define TRACE_EVENT(b, t, a8, a16, a32) trace_event(b, t, a8, a16, a32)
+#else /* ! TM_TRACE */
+# define TRACE_EVENT(b, t, a8, a16, a32) /* Nothing */
+#endif /* ! TM_TRACE */
 
 #if defined(CTX_LONGJMP)
 # define JMP_BUF                        jmp_buf
@@ -280,10 +423,8 @@ enum {                                  /* Transaction status */
  * We use an array of locks and hash the address to find the location of the lock.
  * We try to avoid collisions as much as possible (two addresses covered by the same lock).
  */
-#define LOCK_ARRAY_SIZE                 (1 << LOCK_ARRAY_LOG_SIZE)
-#define LOCK_MASK                       (LOCK_ARRAY_SIZE - 1)
-#define LOCK_SHIFT                      (((sizeof(stm_word_t) == 4) ? 2 : 3) + LOCK_SHIFT_EXTRA)
-#define LOCK_IDX(a)                     (((stm_word_t)(a) >> LOCK_SHIFT) & LOCK_MASK)
+#define LOCK_SHIFT_DEFAULT              (((sizeof(stm_word_t) == 4) ? 2 : 3) + LOCK_SHIFT_EXTRA)
+#define LOCK_IDX(a)                     (((stm_word_t)(a) >> _tinystm.lock_shift) & _tinystm.lock_mask)
 #ifdef LOCK_IDX_SWAP
 # if LOCK_ARRAY_LOG_SIZE < 16
 #  error "LOCK_IDX_SWAP requires LOCK_ARRAY_LOG_SIZE to be at least 16"
@@ -318,15 +459,12 @@ enum {                                  /* Transaction status */
 #endif /* MAX_SPECIFIC */
 
 
-typedef struct r_entry {                /* Read set entry */
-  stm_word_t version;                   /* Version read */
-  volatile stm_word_t *lock;            /* Pointer to lock (for fast access) */
-} r_entry_t;
-
-typedef struct r_set {                  /* Read set */
-  r_entry_t *entries;                   /* Array of entries */
+typedef struct r_set {                  /* Read set (entry i is locks[i] and versions[i]) */
+  volatile stm_word_t **locks;          /* Pointers to locks */
+  stm_word_t *versions;                 /* Versions read */
   unsigned int nb_entries;              /* Number of entries */
   unsigned int size;                    /* Size of array */
+  set_index_t index;                    /* Index by lock (large sets only) */
 } r_set_t;
 
 typedef struct w_entry {                /* Write set entry */
@@ -337,9 +475,9 @@ typedef struct w_entry {                /* Write set entry */
       stm_word_t mask;                  /* Write mask */
       stm_word_t version;               /* Version overwritten */
       volatile stm_word_t *lock;        /* Pointer to lock (for fast access) */
-#if CM == CM_MODULAR || defined(CONFLICT_TRACKING)
+#if CM == CM_MODULAR || defined(CONFLICT_TRACKING) || defined(CONFLICT_SCHED)
       struct stm_tx *tx;                /* Transaction owning the write set */
-#endif /* CM == CM_MODULAR || defined(CONFLICT_TRACKING) */
+#endif /* CM == CM_MODULAR || defined(CONFLICT_TRACKING) || defined(CONFLICT_SCHED) */
       union {
         struct w_entry *next;           /* WRITE_BACK_ETL || WRITE_THROUGH: Next address covered by same lock (if any) */
         stm_word_t no_drop;             /* WRITE_BACK_CTL: Should we drop lock upon abort? */
@@ -361,13 +499,68 @@ typedef struct w_set {                  /* Write set */
 #ifdef USE_BLOOM_FILTER
   stm_word_t bloom;                     /* WRITE_BACK_CTL: Same Bloom filter as in TL2 */
 #endif /* USE_BLOOM_FILTER */
+  set_index_t index;                    /* Index by address (large sets only) */
 } w_set_t;
 
+#if CLOCK_SCHEME == CLOCK_HIER
+typedef struct clock_group {            /* Commit timestamps taken for a socket */
+  volatile stm_word_t busy;             /* Is a thread incrementing the global clock? */
+  volatile stm_word_t stamp;            /* Last timestamp taken */
+} ALIGNED clock_group_t;
+#endif /* CLOCK_SCHEME == CLOCK_HIER */
+
+#ifdef INCREMENTAL_VALIDATION
+typedef struct cr_record {              /* Locks written by a commit */
+  volatile stm_word_t ts;               /* 2 * commit timestamp (odd while being written) */
+  stm_word_t nb;                        /* Number of locks (COMMIT_RING_LOCKS + 1 if more) */
+  volatile stm_word_t *locks[COMMIT_RING_LOCKS];
+} ALIGNED cr_record_t;
+#endif /* INCREMENTAL_VALIDATION */
+
+/* First entry from i whose lock is owned or has changed (n if none) */
+typedef unsigned int (*rs_scan_fn_t)(volatile stm_word_t **locks, const stm_word_t *versions, unsigned int i, unsigned int n);
+
 typedef struct cb_entry {               /* Callback entry */
   void (*f)(void *);                    /* Function */
   void *arg;                            /* Argument to be passed to function */
 } cb_entry_t;
 
+#ifdef TM_STATISTICS
+enum {                                  /* Histograms (see hist_names in stm.c) */
+  HIST_COMMIT = 0,                      /* TSC ticks from first start to commit (retries included) */
+  HIST_ATTEMPT,                         /* TSC ticks of each attempt (committed or aborted) */
+  HIST_SPIN,                            /* TSC ticks spinning in backoff */
+  HIST_SLEEP,                           /* TSC ticks sleeping or parked in backoff */
+  HIST_RETRIES,                         /* Aborts before each commit */
+  HIST_NB
+};
+#endif /* TM_STATISTICS */
+
+#ifdef GREEN_BACKOFF
+typedef struct bo_site {                /* Backoff state of an atomic block (per thread) */
+  stm_word_t key;                       /* Transaction id or return address of start (0 if free) */
+  unsigned long floor;                  /* Learned initial backoff window */
+  unsigned int scale;                   /* Spin-to-sleep threshold relative to the global one */
+  unsigned int spun;                    /* Was the last wait spent spinning? */
+  unsigned long commits;                /* Commits of the block (cumulative) */
+  unsigned long aborts;                 /* Aborts of the block (cumulative) */
+  unsigned long long latency;           /* Average TSC ticks of a committed attempt (EWMA 1/8) */
+  unsigned long escalations;            /* Executions escalated to serial irrevocable (cumulative) */
+  tx_stats_t *enemy;                    /* Counters of the thread it keeps conflicting with (scheduler) */
+  unsigned long heat;                   /* Votes for enemy (majority of the conflicts) */
+  unsigned long queued;                 /* Retries queued behind enemy (cumulative) */
+} bo_site_t;
+#endif /* GREEN_BACKOFF */
+
+#ifdef TM_TRACE
+typedef struct trace_buf {              /* Trace output of a thread */
+  trace_chunk_t *chunk;                 /* Chunk being filled (NULL if none) */
+  unsigned int thread;                  /* Thread number in the trace */
+  unsigned int seq;                     /* Number of chunks claimed */
+  int stopped;                          /* Is the file full? */
+} trace_buf_t;
+#endif /* TM_TRACE */
+
 typedef struct stm_tx {                 /* Transaction descriptor */
   JMP_BUF env;                          /* Environment for setjmp/longjmp */
   stm_tx_attr_t attr;                   /* Transaction attributes (user-specified) */
@@ -388,13 +581,20 @@ typedef struct stm_tx {                 /* Transaction descriptor */
 #endif /* CM == CM_MODULAR */
   void *data[MAX_SPECIFIC];             /* Transaction-specific data (fixed-size array for better speed) */
   struct stm_tx *next;                  /* For keeping track of all transactional threads */
+  tx_stats_t *stats;                    /* Commit/abort counters (own cache line) */
+#if CLOCK_SCHEME == CLOCK_HIER
+  clock_group_t *clock_group;           /* Combining slot of the socket */
+#endif /* CLOCK_SCHEME == CLOCK_HIER */
+#ifdef TM_TRACE
+  trace_buf_t trace;                    /* Event trace */
+#endif /* TM_TRACE */
 #ifdef CONFLICT_TRACKING
   pthread_t thread_id;                  /* Thread identifier (immutable) */
 #endif /* CONFLICT_TRACKING */
-#if CM == CM_DELAY || CM == CM_MODULAR
+#if CM == CM_DELAY || CM == CM_MODULAR || defined(GREEN_BACKOFF)
   volatile stm_word_t *c_lock;          /* Pointer to contented lock (cause of abort) */
-#endif /* CM == CM_DELAY || CM == CM_MODULAR */
-#if CM == CM_BACKOFF
+#endif /* CM == CM_DELAY || CM == CM_MODULAR || defined(GREEN_BACKOFF) */
+#ifdef GREEN_BACKOFF
   //unsigned int backoff_asym_threshold;
   //unsigned int backoff_threshold;
   unsigned int _retries;
@@ -402,10 +602,16 @@ typedef struct stm_tx {                 /* Transaction descriptor */
   unsigned int backoffs;
   unsigned long totalbackoffs;
   unsigned long maxbackoff;
-  unsigned int stat_backoff_wait[10];
   unsigned long backoff;                /* Maximum backoff duration */
   unsigned long seed;                   /* RNG seed */
-#endif /* CM == CM_BACKOFF */
+  unsigned long bo_spun;                /* Iterations spun in backoff (cumulative) */
+  unsigned long bo_slept;               /* Microseconds slept in backoff (cumulative) */
+  bo_site_t *bo_site;                   /* Atomic block being executed */
+  unsigned long long bo_attempt;        /* TSC at the start of the current attempt (starvation guard) */
+  unsigned long long bo_wasted;         /* TSC ticks of the aborted attempts (starvation guard) */
+  unsigned int admitted;                /* Does the transaction hold an admission slot? */
+  bo_site_t bo_sites[BO_SITES];         /* Atomic blocks executed by the thread */
+#endif /* GREEN_BACKOFF */
 #if CM == CM_MODULAR
   int visible_reads;                    /* Should we use visible reads? */
 #endif /* CM == CM_MODULAR */
@@ -416,6 +622,9 @@ typedef struct stm_tx {                 /* Transaction descriptor */
   unsigned int stat_commits;            /* Total number of commits (cumulative) */
   unsigned int stat_aborts;             /* Total number of aborts (cumulative) */
   unsigned int stat_retries_max;        /* Maximum number of consecutive aborts (retries) */
+  unsigned long long hist_first;        /* TSC at the first start of the transaction */
+  unsigned long long hist_attempt;      /* TSC at the start of the current attempt */
+  stm_hist_t hist[HIST_NB];             /* Latency, wait and retry histograms */
 #endif /* TM_STATISTICS */
 #ifdef TM_STATISTICS2
   unsigned int stat_aborts_1;           /* Total number of transactions that abort once or more (cumulative) */
@@ -428,10 +637,36 @@ typedef struct stm_tx {                 /* Transaction descriptor */
 #endif /* TM_STATISTICS2 */
 } stm_tx_t;
 
+#ifdef GREEN_BACKOFF
+typedef struct park_stripe {            /* Threads parked on locks of the same stripe */
+  volatile stm_word_t waiters;          /* Number of parked threads */
+  volatile stm_word_t seq;              /* Futex word (low 32 bits), bumped on lock release */
+} park_stripe_t;
+
+typedef struct bo_policy {              /* Backoff policy (see bos[] in stm.c) */
+  const char *name;                     /* Name (same as the BO_POLICY make variable) */
+  void (*init)(void);                   /* Set up global state when the policy is selected */
+  void (*on_abort)(stm_tx_t *);         /* Grow the backoff window after an abort */
+  void (*on_commit)(stm_tx_t *);        /* Reset the backoff window after aborts */
+  void (*wait)(stm_tx_t *, unsigned long); /* Wait before restarting */
+} bo_policy_t;
+#endif /* GREEN_BACKOFF */
+
 /* This structure should be ordered by hot and cold variables */
 typedef struct {
-  volatile stm_word_t locks[LOCK_ARRAY_SIZE] ALIGNED;
+  volatile stm_word_t *locks ALIGNED;   /* Lock array (mapped by stm_init) */
+  stm_word_t lock_mask;                 /* Number of locks - 1 */
+  unsigned int lock_shift;              /* Address bits ignored by LOCK_IDX */
+  rs_scan_fn_t rs_scan;                 /* Validation kernel (set by stm_init) */
   volatile stm_word_t gclock[512 / sizeof(stm_word_t)] ALIGNED;
+#if CLOCK_SCHEME == CLOCK_HIER
+  clock_group_t clock_groups[CLOCK_GROUPS];
+  unsigned char clock_group_of[MAX_CPUS]; /* Combining slot of each CPU (set by stm_init) */
+#endif /* CLOCK_SCHEME == CLOCK_HIER */
+#ifdef INCREMENTAL_VALIDATION
+  cr_record_t commit_ring[COMMIT_RING_SIZE];
+#endif /* INCREMENTAL_VALIDATION */
+  const char *rs_scan_name;             /* Name of the validation kernel */
   unsigned int nb_specific;             /* Number of specific slots used (<= MAX_SPECIFIC) */
   unsigned int nb_init_cb;
   cb_entry_t init_cb[MAX_CB];           /* Init thread callbacks */
@@ -452,6 +687,17 @@ typedef struct {
   volatile stm_word_t quiesce;          /* Prevent threads from entering transactions upon quiescence */
   volatile stm_word_t threads_nb;       /* Number of active threads */
   stm_tx_t *threads;                    /* Head of linked list of threads */
+  stats_slab_t *volatile stats;         /* Head of linked list of counter slabs */
+  stats_shm_t *shm;                     /* Live statistics segment (NULL if not published) */
+#ifdef TM_STATISTICS
+  stm_hist_t hist[HIST_NB];             /* Histograms of exited threads (protected by quiesce_mutex) */
+#endif /* TM_STATISTICS */
+#ifdef TM_TRACE
+  trace_header_t *trace;                /* Mapped trace file (NULL if not tracing) */
+  size_t trace_size;                    /* Size of the mapping */
+  volatile stm_word_t trace_next;       /* Next free chunk */
+  volatile stm_word_t trace_threads;    /* Number of traced threads */
+#endif /* TM_TRACE */
   pthread_mutex_t quiesce_mutex;        /* Mutex to support quiescence */
   pthread_cond_t quiesce_cond;          /* Condition variable to support quiescence */
 #if CM == CM_MODULAR
@@ -463,12 +709,20 @@ typedef struct {
 #if CM == CM_MODULAR
   int (*contention_manager)(stm_tx_t *, stm_tx_t *, int);
 #endif /* CM == CM_MODULAR */
+#ifdef GREEN_BACKOFF
+  const bo_policy_t *backoff_policy;    /* Current backoff policy (can be switched online) */
+  volatile stm_word_t parked ALIGNED;   /* Number of parked threads (checked upon lock release) */
+  park_stripe_t park[PARK_STRIPES] ALIGNED;
+  volatile stm_word_t adm_cap ALIGNED;  /* Maximum number of admitted transactions (read on start) */
+  volatile stm_word_t adm_active ALIGNED; /* Number of admitted transactions */
+  volatile stm_word_t adm_waiters;      /* Number of threads parked at the gate */
+  volatile stm_word_t adm_seq;          /* Futex word (low 32 bits), bumped when a slot is freed */
+#endif /* GREEN_BACKOFF */
   /* At least twice a cache line (256 bytes to be on the safe side) */
   char padding[CACHELINE_SIZE];
 } ALIGNED global_t;
 
-int freqmonitor [64][7];
-int thread_status [64];
+extern int thread_status[MAX_CPUS];
 extern global_t _tinystm;
 
 #if CM == CM_MODULAR
@@ -489,6 +743,11 @@ extern global_t _tinystm;
 static NOINLINE void
 stm_rollback(stm_tx_t *tx, unsigned int reason);
 
+/* Defined in stm.c (locktable.h), also used by other compilation units */
+extern void lock_table_alloc(void);
+extern void lock_table_reset(void);
+extern void lock_table_free(void);
+
 /* ################################################################### *
  * INLINE FUNCTIONS
  * ################################################################### */
@@ -538,6 +797,83 @@ stm_quiesce_exit(void)
   pthread_mutex_destroy(&_tinystm.quiesce_mutex);
 }
 
+/*
+ * Get a free counter slot (slots are reused but never freed, so that
+ * the tuner can read them without synchronizing with thread exits).
+ */
+static tx_stats_t *
+stats_acquire(void)
+{
+  stats_slab_t *slab, *volatile *link;
+  int i;
+
+  for (slab = _tinystm.stats; slab != NULL; slab = slab->next) {
+    for (i = 0; i < STATS_SLAB_SLOTS; i++) {
+      if (ATOMIC_LOAD(&slab->slots[i].used) == 0 && ATOMIC_CAS_FULL(&slab->slots[i].used, 0, 1) != 0)
+        return &slab->slots[i];
+    }
+  }
+  if (posix_memalign((void **)&slab, CACHELINE_SIZE, sizeof(stats_slab_t)) != 0) {
+    perror("posix_memalign");
+    exit(1);
+  }
+  memset(slab, 0, sizeof(stats_slab_t));
+  slab->slots[0].used = 1;
+  /* Append (the slabs of the statistics segment are scanned first) */
+  link = &_tinystm.stats;
+  while (*link != NULL || ATOMIC_CAS_FULL((volatile stm_word_t *)link, 0, (stm_word_t)slab) == 0)
+    link = &(*link)->next;
+  return &slab->slots[0];
+}
+
+static INLINE void
+stats_release(tx_stats_t *st)
+{
+  ATOMIC_STORE_REL(&st->used, 0);
+}
+
+/*
+ * Increment a counter of the current thread (readers retry while the
+ * sequence number is odd or has changed).
+ */
+static INLINE void
+stats_inc(tx_stats_t *st, volatile stm_word_t *counter)
+{
+  ATOMIC_STORE(&st->seq, st->seq + 1);
+  ATOMIC_MB_WRITE;
+  ATOMIC_STORE(counter, *counter + 1);
+  ATOMIC_STORE_REL(&st->seq, st->seq + 1);
+}
+
+/*
+ * Count an abort of the current thread and its reason.
+ */
+static INLINE void
+stats_abort(tx_stats_t *st, unsigned int reason)
+{
+  volatile stm_word_t *r = &st->aborts_r[(reason >> 8) & 0x0F];
+
+  ATOMIC_STORE(&st->seq, st->seq + 1);
+  ATOMIC_MB_WRITE;
+  ATOMIC_STORE(&st->aborts, st->aborts + 1);
+  ATOMIC_STORE(r, *r + 1);
+  ATOMIC_STORE_REL(&st->seq, st->seq + 1);
+}
+
+#ifdef GREEN_BACKOFF
+/*
+ * Count a backoff wait in its power-of-4 bucket.
+ */
+static INLINE void
+stats_wait(tx_stats_t *st, unsigned long wait)
+{
+  unsigned int b = (63 - __builtin_clzl(wait | 1)) >> 1;
+
+  b = (b < STATS_WAIT_BUCKETS ? b : STATS_WAIT_BUCKETS - 1);
+  ATOMIC_STORE(&st->wait[b], st->wait[b] + 1);
+}
+#endif /* GREEN_BACKOFF */
+
 /*
  * Called by each thread upon initialization for quiescence support.
  */
@@ -728,8 +1064,14 @@ rollover_clock(void *arg)
 
   /* Reset clock */
   CLOCK = 0;
+#if CLOCK_SCHEME == CLOCK_HIER
+  memset(_tinystm.clock_groups, 0, sizeof(_tinystm.clock_groups));
+#endif /* CLOCK_SCHEME == CLOCK_HIER */
   /* Reset timestamps */
-  memset((void *)_tinystm.locks, 0, LOCK_ARRAY_SIZE * sizeof(stm_word_t));
+  lock_table_reset();
+#ifdef INCREMENTAL_VALIDATION
+  memset(_tinystm.commit_ring, 0, sizeof(_tinystm.commit_ring));
+#endif /* INCREMENTAL_VALIDATION */
 # ifdef EPOCH_GC
   /* Reset GC */
   gc_reset();
@@ -737,12 +1079,101 @@ rollover_clock(void *arg)
 }
 
 /*
- * Check if stripe has been read previously.
+ * Get a commit timestamp (called once all locks are held, may exceed
+ * VERSION_MAX by up to MAX_THREADS).  Any clock value reached after the
+ * locks are held is a valid timestamp, even if other transactions
+ * commit with the same one; *validate is cleared only if the
+ * transaction took the timestamp for itself and no other transaction
+ * committed since it started.
+ */
+static INLINE stm_word_t
+clock_commit(stm_tx_t *tx, int *validate)
+{
+#if CLOCK_SCHEME == CLOCK_GV1
+  stm_word_t t = FETCH_INC_CLOCK + 1;
+
+  *validate = (tx->start != t - 1);
+  return t;
+#elif CLOCK_SCHEME == CLOCK_GV4
+  stm_word_t c = GET_CLOCK;
+
+  if (ATOMIC_CAS_FULL(&CLOCK, c, c + 1) != 0) {
+    *validate = (tx->start != c);
+    return c + 1;
+  }
+  /* Another transaction has moved the clock since c: share its value */
+  *validate = 1;
+  return GET_CLOCK;
+#elif CLOCK_SCHEME == CLOCK_GV5
+  /* Readers advance the clock when they find a newer version */
+  *validate = 1;
+  return GET_CLOCK + 1;
+#elif CLOCK_SCHEME == CLOCK_HIER
+  clock_group_t *g = tx->clock_group;
+  stm_word_t c, s;
+
+  c = GET_CLOCK;
+  for (;;) {
+    /* A timestamp taken by a thread of the socket after c was read */
+    if ((s = ATOMIC_LOAD_ACQ(&g->stamp)) > c) {
+      *validate = 1;
+      return s;
+    }
+    if (ATOMIC_LOAD(&g->busy) == 0 && ATOMIC_CAS_FULL(&g->busy, 0, 1) != 0)
+      break;
+  }
+  /* Take a timestamp for the socket (GV4 on the global clock) */
+  c = GET_CLOCK;
+  if (ATOMIC_CAS_FULL(&CLOCK, c, c + 1) != 0) {
+    *validate = (tx->start != c);
+    s = c + 1;
+  } else {
+    *validate = 1;
+    s = GET_CLOCK;
+  }
+  ATOMIC_STORE_REL(&g->stamp, s);
+  ATOMIC_STORE_REL(&g->busy, 0);
+  return s;
+#endif /* CLOCK_SCHEME == CLOCK_HIER */
+}
+
+/*
+ * Make sure that the clock is not older than a version found in memory
+ * (GV5 only: commits do not advance the clock, so versions may be ahead
+ * of it and commit timestamps must exceed the versions they replace).
+ */
+static INLINE void
+clock_observe(stm_word_t version)
+{
+#if CLOCK_SCHEME == CLOCK_GV5
+  stm_word_t c;
+
+  while ((c = GET_CLOCK) < version && ATOMIC_CAS_FULL(&CLOCK, c, version) == 0)
+    ;
+#endif /* CLOCK_SCHEME == CLOCK_GV5 */
+}
+
+/*
+ * Add the read set entries appended since the last lookup to its index.
+ */
+static INLINE void
+stm_index_rs(stm_tx_t *tx)
+{
+  unsigned int i;
+
+  set_index_reserve(&tx->r_set.index, tx->r_set.nb_entries);
+  for (i = tx->r_set.index.nb; i < tx->r_set.nb_entries; i++)
+    set_index_add(&tx->r_set.index, (stm_word_t)tx->r_set.locks[i], i);
+  tx->r_set.index.nb = i;
+}
+
+/*
+ * Check if stripe has been read previously (index of the first entry
+ * or -1).
  */
-static INLINE r_entry_t *
+static INLINE int
 stm_has_read(stm_tx_t *tx, volatile stm_word_t *lock)
 {
-  r_entry_t *r;
   int i;
 
   PRINT_DEBUG("==> stm_has_read(%p[%lu-%lu],%p)\n", tx, (unsigned long)tx->start, (unsigned long)tx->end, lock);
@@ -751,15 +1182,19 @@ stm_has_read(stm_tx_t *tx, volatile stm_word_t *lock)
   /* TODO if of visible read is not handled */
 #endif /* CM == CM_MODULAR */
 
+  if (tx->r_set.nb_entries >= SET_INDEX_THRESHOLD) {
+    stm_index_rs(tx);
+    return set_index_find(&tx->r_set.index, (stm_word_t)lock);
+  }
+
   /* Look for read */
-  r = tx->r_set.entries;
-  for (i = tx->r_set.nb_entries; i > 0; i--, r++) {
-    if (r->lock == lock) {
+  for (i = 0; i < (int)tx->r_set.nb_entries; i++) {
+    if (tx->r_set.locks[i] == lock) {
       /* Return first match*/
-      return r;
+      return i;
     }
   }
-  return NULL;
+  return -1;
 }
 
 /*
@@ -782,6 +1217,16 @@ stm_has_written(stm_tx_t *tx, volatile stm_word_t *addr)
     return NULL;
 # endif /* USE_BLOOM_FILTER */
 
+  if (tx->w_set.nb_entries >= SET_INDEX_THRESHOLD) {
+    /* Index the entries added since the last lookup */
+    set_index_reserve(&tx->w_set.index, tx->w_set.nb_entries);
+    for (i = tx->w_set.index.nb; i < tx->w_set.nb_entries; i++)
+      set_index_add(&tx->w_set.index, (stm_word_t)tx->w_set.entries[i].addr, i);
+    tx->w_set.index.nb = i;
+    i = set_index_find(&tx->w_set.index, (stm_word_t)addr);
+    return (i < 0 ? NULL : &tx->w_set.entries[i]);
+  }
+
   /* Look for write */
   w = tx->w_set.entries;
   for (i = tx->w_set.nb_entries; i > 0; i--, w++) {
@@ -803,13 +1248,15 @@ stm_allocate_rs_entries(stm_tx_t *tx, int extend)
   if (extend) {
     /* Extend read set */
     tx->r_set.size *= 2;
-    if ((tx->r_set.entries = (r_entry_t *)realloc(tx->r_set.entries, tx->r_set.size * sizeof(r_entry_t))) == NULL) {
+    if ((tx->r_set.locks = (volatile stm_word_t **)realloc(tx->r_set.locks, tx->r_set.size * sizeof(stm_word_t *))) == NULL
+        || (tx->r_set.versions = (stm_word_t *)realloc(tx->r_set.versions, tx->r_set.size * sizeof(stm_word_t))) == NULL) {
       perror("realloc read set");
       exit(1);
     }
   } else {
     /* Allocate read set */
-    if ((tx->r_set.entries = (r_entry_t *)xmalloc(tx->r_set.size * sizeof(r_entry_t))) == NULL) {
+    if ((tx->r_set.locks = (volatile stm_word_t **)xmalloc(tx->r_set.size * sizeof(stm_word_t *))) == NULL
+        || (tx->r_set.versions = (stm_word_t *)xmalloc(tx->r_set.size * sizeof(stm_word_t))) == NULL) {
       perror("malloc read set");
       exit(1);
     }
@@ -822,9 +1269,9 @@ stm_allocate_rs_entries(stm_tx_t *tx, int extend)
 static NOINLINE void
 stm_allocate_ws_entries(stm_tx_t *tx, int extend)
 {
-#if CM == CM_MODULAR || defined(CONFLICT_TRACKING)
+#if CM == CM_MODULAR || defined(CONFLICT_TRACKING) || defined(CONFLICT_SCHED)
   int i, first = (extend ? tx->w_set.size : 0);
-#endif /* CM == CM_MODULAR || defined(CONFLICT_TRACKING) */
+#endif /* CM == CM_MODULAR || defined(CONFLICT_TRACKING) || defined(CONFLICT_SCHED) */
 
   PRINT_DEBUG("==> stm_allocate_ws_entries(%p[%lu-%lu],%d)\n", tx, (unsigned long)tx->start, (unsigned long)tx->end, extend);
 
@@ -846,13 +1293,403 @@ stm_allocate_ws_entries(stm_tx_t *tx, int extend)
   /* Ensure that memory is aligned. */
   assert((((stm_word_t)tx->w_set.entries) & OWNED_MASK) == 0);
 
-#if CM == CM_MODULAR || defined(CONFLICT_TRACKING)
+#if CM == CM_MODULAR || defined(CONFLICT_TRACKING) || defined(CONFLICT_SCHED)
   /* Initialize fields */
   for (i = first; i < tx->w_set.size; i++)
     tx->w_set.entries[i].tx = tx;
-#endif /* CM == CM_MODULAR || defined(CONFLICT_TRACKING) */
+#endif /* CM == CM_MODULAR || defined(CONFLICT_TRACKING) || defined(CONFLICT_SCHED) */
+}
+
+
+/*
+ * Time-stamp counter (monotonic nanoseconds on other architectures).
+ */
+static inline unsigned long long
+RDTSC(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+  unsigned int lo, hi;
+
+  __asm__ __volatile__ ("rdtsc" : "=a" (lo), "=d" (hi));
+  return ((unsigned long long)hi << 32) | lo;
+#else /* ! (defined(__x86_64__) || defined(__i386__)) */
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (unsigned long long)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+#endif /* ! (defined(__x86_64__) || defined(__i386__)) */
+}
+
+#ifdef TM_TRACE
+/*
+ * Claim a new chunk of the trace file (return NULL when full).
+ */
+static NOINLINE trace_chunk_t *
+trace_next_chunk(trace_buf_t *b)
+{
+  trace_header_t *h = _tinystm.trace;
+  trace_chunk_t *c;
+  stm_word_t i;
+
+  if (h == NULL || b->stopped || b->thread == 0)
+    return NULL;
+  i = ATOMIC_FETCH_INC_FULL(&_tinystm.trace_next);
+  if (i >= h->nb_chunks) {
+    b->stopped = 1;
+    b->chunk = NULL;
+    return NULL;
+  }
+  c = (trace_chunk_t *)((char *)h + TRACE_CHUNK_SIZE * (i + 1));
+  c->thread = b->thread;
+  c->seq = b->seq++;
+  c->count = 0;
+  c->magic = TRACE_CHUNK_MAGIC;
+  b->chunk = c;
+  return c;
+}
+
+/*
+ * Append a record to the trace of a thread (no synchronization: the
+ * chunk belongs to the thread).
+ */
+static INLINE void
+trace_event(trace_buf_t *b, int type, int a8, int a16, uint32_t a32)
+{
+  trace_chunk_t *c = b->chunk;
+  trace_rec_t *r;
+
+  if (unlikely(c == NULL || c->count == TRACE_CHUNK_RECS)) {
+    if ((c = trace_next_chunk(b)) == NULL)
+      return;
+  }
+  r = &c->recs[c->count];
+  r->tsc = RDTSC();
+  r->type = (uint8_t)type;
+  r->a8 = (uint8_t)a8;
+  r->a16 = (uint16_t)a16;
+  r->a32 = a32;
+  c->count++;
 }
 
+/*
+ * Register a thread in the trace.
+ */
+static INLINE void
+trace_thread(trace_buf_t *b, int kind, int cpu)
+{
+  b->chunk = NULL;
+  b->seq = 0;
+  b->stopped = 0;
+  b->thread = (_tinystm.trace != NULL ? (unsigned int)ATOMIC_FETCH_INC_FULL(&_tinystm.trace_threads) + 1 : 0);
+  trace_event(b, TR_THREAD, kind, cpu, 0);
+}
+#endif /* TM_TRACE */
+
+#ifdef GREEN_BACKOFF
+/*
+ * Park until the contended lock is released or the timeout (in
+ * microseconds) expires (return 0 if the lock was already free).
+ */
+static NOINLINE int
+stm_park(stm_tx_t *tx, long usec)
+{
+  park_stripe_t *ps;
+  struct timespec to;
+  int seq, parked = 0;
+
+  ps = &_tinystm.park[PARK_IDX(tx->c_lock)];
+  /* Futex value must be read before checking the lock */
+  seq = (int)ATOMIC_LOAD_ACQ(&ps->seq);
+  ATOMIC_FETCH_INC_FULL(&ps->waiters);
+  ATOMIC_FETCH_INC_FULL(&_tinystm.parked);
+  if (LOCK_GET_OWNED(ATOMIC_LOAD_ACQ(tx->c_lock))) {
+    to.tv_sec = usec / 1000000;
+    to.tv_nsec = (usec % 1000000) * 1000;
+    /* Returns on wake-up, timeout, signal or if seq has changed (x86: low 32 bits) */
+    syscall(SYS_futex, (int *)&ps->seq, FUTEX_WAIT_PRIVATE, seq, &to, NULL, 0);
+    parked = 1;
+  }
+  ATOMIC_FETCH_DEC_FULL(&_tinystm.parked);
+  ATOMIC_FETCH_DEC_FULL(&ps->waiters);
+  return parked;
+}
+
+/*
+ * Wake up threads parked on the locks released by the transaction, once
+ * per stripe (several entries share a lock or a stripe).  The release is
+ * not fenced against the check of parked threads: a missed wake-up only
+ * delays the waiter until its timeout (the backoff).
+ */
+static NOINLINE void
+stm_wake_stripes(stm_tx_t *tx)
+{
+  unsigned long woken[PARK_STRIPES / PARK_WORD_BITS];
+  park_stripe_t *ps;
+  w_entry_t *w;
+  stm_word_t idx;
+  int i;
+
+  memset(woken, 0, sizeof(woken));
+  w = tx->w_set.entries;
+  for (i = tx->w_set.nb_entries; i > 0; i--, w++) {
+    idx = PARK_IDX(w->lock);
+    if (woken[idx / PARK_WORD_BITS] & (1UL << (idx % PARK_WORD_BITS)))
+      continue;
+    woken[idx / PARK_WORD_BITS] |= 1UL << (idx % PARK_WORD_BITS);
+    ps = &_tinystm.park[idx];
+    if (ATOMIC_LOAD(&ps->waiters) != 0) {
+      ATOMIC_FETCH_INC_FULL(&ps->seq);
+      syscall(SYS_futex, (int *)&ps->seq, FUTEX_WAKE_PRIVATE, INT_MAX, NULL, NULL, 0);
+    }
+  }
+}
+
+/*
+ * Wait for an admission slot, parked on a futex while all slots are
+ * taken (the timeout bounds the cost of a missed wake-up).
+ */
+static NOINLINE void
+stm_admit(stm_tx_t *tx)
+{
+  struct timespec to;
+  unsigned long long t;
+  stm_word_t cap, a;
+  int seq;
+
+  for (;;) {
+    cap = ATOMIC_LOAD(&_tinystm.adm_cap);
+    if (cap >= ATOMIC_LOAD(&_tinystm.threads_nb))
+      break;
+    a = ATOMIC_LOAD(&_tinystm.adm_active);
+    if (a < cap) {
+      if (ATOMIC_CAS_FULL(&_tinystm.adm_active, a, a + 1) != 0) {
+        tx->admitted = 1;
+        break;
+      }
+      continue;
+    }
+    /* Futex value must be read before checking the slots */
+    seq = (int)ATOMIC_LOAD_ACQ(&_tinystm.adm_seq);
+    ATOMIC_FETCH_INC_FULL(&_tinystm.adm_waiters);
+    if (ATOMIC_LOAD(&_tinystm.adm_active) >= cap) {
+      to.tv_sec = 0;
+      to.tv_nsec = ADM_PARK_USEC * 1000;
+      t = RDTSC();
+      syscall(SYS_futex, (int *)&_tinystm.adm_seq, FUTEX_WAIT_PRIVATE, seq, &to, NULL, 0);
+      t = RDTSC() - t;
+      if (tsc_khz > 0) {
+        /* Published like backoff sleeps (energy model) */
+        tx->bo_slept += t * 1000 / tsc_khz;
+        ATOMIC_STORE(&tx->stats->slept, tx->stats->slept + t * 1000 / tsc_khz);
+      }
+      TRACE_EVENT(&tx->trace, TR_ADMIT, 0, 0, (uint32_t)t);
+    }
+    ATOMIC_FETCH_DEC_FULL(&_tinystm.adm_waiters);
+  }
+}
+
+/*
+ * Free the admission slot of the transaction (if any).
+ */
+static INLINE void
+stm_admit_release(stm_tx_t *tx)
+{
+  if (likely(!tx->admitted))
+    return;
+  tx->admitted = 0;
+  ATOMIC_FETCH_DEC_FULL(&_tinystm.adm_active);
+  if (ATOMIC_LOAD(&_tinystm.adm_waiters) != 0) {
+    ATOMIC_FETCH_INC_FULL(&_tinystm.adm_seq);
+    syscall(SYS_futex, (int *)&_tinystm.adm_seq, FUTEX_WAKE_PRIVATE, 1, NULL, NULL, 0);
+  }
+}
+
+static INLINE void
+stm_wake_parked(stm_tx_t *tx)
+{
+  if (likely(ATOMIC_LOAD(&_tinystm.parked) == 0))
+    return;
+  stm_wake_stripes(tx);
+}
+
+static INLINE void
+bo_site_init(bo_site_t *s, stm_word_t key)
+{
+  s->key = key;
+  s->floor = MIN_BACKOFF;
+  s->scale = BO_SCALE_ONE;
+  s->spun = 0;
+  s->commits = s->aborts = 0;
+  s->latency = 0;
+  s->escalations = 0;
+  s->enemy = NULL;
+  s->heat = 0;
+  s->queued = 0;
+}
+
+/*
+ * Find the backoff state of an atomic block, identified by its
+ * transaction id or else by the address from which it was started
+ * (the home slot is recycled when the table is full).
+ */
+static INLINE bo_site_t *
+bo_site_lookup(stm_tx_t *tx, stm_word_t key)
+{
+  bo_site_t *s;
+  unsigned int h, i;
+
+  if (likely(tx->bo_site->key == key))
+    return tx->bo_site;
+  h = (unsigned int)((key * 0x9E3779B97F4A7C15ULL) >> 32) & (BO_SITES - 1);
+  for (i = 0; i < BO_SITES; i++) {
+    s = &tx->bo_sites[(h + i) & (BO_SITES - 1)];
+    if (s->key == key)
+      return s;
+    if (s->key == 0) {
+      bo_site_init(s, key);
+      return s;
+    }
+  }
+  s = &tx->bo_sites[h];
+  bo_site_init(s, key);
+  return s;
+}
+
+/*
+ * Spin-to-sleep threshold of the current atomic block.
+ */
+static INLINE unsigned long
+bo_site_threshold(stm_tx_t *tx)
+{
+  return (unsigned long)(((unsigned long long)backoff_threshold * tx->bo_site->scale) / BO_SCALE_ONE);
+}
+
+/*
+ * Abort of the current atomic block: if spinning did not outlast the
+ * conflict, sleep earlier next time.
+ */
+static INLINE void
+bo_site_abort(stm_tx_t *tx)
+{
+  bo_site_t *s = tx->bo_site;
+
+  s->aborts++;
+  if (s->spun) {
+    s->scale -= s->scale >> 3;
+    if (s->scale < BO_SCALE_MIN)
+      s->scale = BO_SCALE_MIN;
+    s->spun = 0;
+  }
+}
+
+/*
+ * Commit of the current atomic block: a successful retry after spinning
+ * moves the threshold up again (slower than it moves down), and the
+ * initial window follows half of the window that succeeded.  Commits
+ * without aborts let the window decay back to MIN_BACKOFF.
+ */
+static INLINE void
+bo_site_commit(stm_tx_t *tx)
+{
+  bo_site_t *s = tx->bo_site;
+
+  s->commits++;
+  if (unlikely(tx->_retries != 0)) {
+    if (s->spun) {
+      s->scale += s->scale >> 5;
+      if (s->scale > BO_SCALE_MAX)
+        s->scale = BO_SCALE_MAX;
+      s->spun = 0;
+    }
+    s->floor = (s->floor + (tx->backoff >> 1)) >> 1;
+    if (s->floor < MIN_BACKOFF)
+      s->floor = MIN_BACKOFF;
+  } else {
+    if (unlikely(s->floor > MIN_BACKOFF))
+      s->floor -= s->floor >> 4;
+    /* Forget the enemy of the block as it stops conflicting */
+    s->heat >>= 1;
+  }
+  {
+    long long d = (long long)(RDTSC() - tx->bo_attempt) - (long long)s->latency;
+    s->latency = (s->latency == 0 ? s->latency + d : s->latency + d / 8);
+  }
+}
+
+# ifdef IRREVOCABLE_ENABLED
+/*
+ * Starvation guard: a transaction that has aborted starve_threshold
+ * times in a row runs its next attempt alone in serial irrevocable mode
+ * (the bound is tuned with the other backoff parameters). Past half the
+ * bound, it also escalates once its aborted attempts took starve_threshold
+ * times the usual duration of a committed attempt of its atomic block (the
+ * backoff waits are not counted): a single long attempt, e.g. when the
+ * thread was preempted, is not enough.
+ */
+static INLINE int
+bo_starving(stm_tx_t *tx)
+{
+  unsigned long bound = ATOMIC_LOAD(&starve_threshold);
+
+  if (bound == 0 || tx->irrevocable != 0)
+    return 0;
+  if (tx->_retries + 1 >= bound)
+    return 1;
+  if (tx->_retries + 1 < bound / 2)
+    return 0;
+  return tx->bo_site->latency != 0 && tx->bo_wasted > bound * tx->bo_site->latency;
+}
+# endif /* IRREVOCABLE_ENABLED */
+
+# ifdef CONFLICT_SCHED
+/*
+ * Conflict-aware scheduling: each atomic block elects the thread it
+ * keeps losing against (majority vote over the owners of the locks
+ * that made it abort, forgotten as the block commits without aborts).
+ * Once the enemy has sched_threshold votes, a retry caused by a lock of
+ * that thread is queued behind its transaction: parked on the lock
+ * until it commits or aborts instead of backing off for a random
+ * delay.  Conflicts with other threads still back off, and independent
+ * transactions are not affected.
+ *
+ * The owner is read from the write set entry that the lock points to,
+ * which the epoch of the aborting transaction keeps from being freed
+ * (as with CONFLICT_TRACKING): this must be done before leaving it.
+ */
+static INLINE int
+sched_conflict(stm_tx_t *tx)
+{
+  bo_site_t *s = tx->bo_site;
+  tx_stats_t *e;
+  stm_word_t l;
+
+  if (ATOMIC_LOAD(&sched_threshold) == 0 || tx->c_lock == NULL)
+    return 0;
+  l = ATOMIC_LOAD_ACQ(tx->c_lock);
+#  ifdef UNIT_TX
+  if (l == LOCK_UNIT)
+    return 0;
+#  endif /* UNIT_TX */
+  /* Released in the meantime: nothing to wait for */
+  if (!LOCK_GET_OWNED(l))
+    return 0;
+  /* Thread counters outlive the descriptors */
+  e = ((w_entry_t *)LOCK_GET_ADDR(l))->tx->stats;
+  if (s->enemy == e) {
+    s->heat++;
+  } else if (s->heat > 0) {
+    s->heat--;
+    return 0;
+  } else {
+    s->enemy = e;
+    s->heat = 1;
+  }
+  return s->heat >= sched_threshold;
+}
+# endif /* CONFLICT_SCHED */
+#endif /* GREEN_BACKOFF */
+
+#include "validate.h"
 
 #if DESIGN == WRITE_BACK_ETL
 # include "stm_wbetl.h"
@@ -940,7 +1777,7 @@ stm_drop(stm_tx_t *tx)
      * transaction could reuse the same entry after having been killed
      * and restarted, and another slow transaction could steal the lock
      * using CAS without noticing the restart) */
-    gc_free(tx->w_set.entries, tx->start);
+    gc_free(tx->w_set.entries, tx->w_set.size * sizeof(w_entry_t), tx->start);
     stm_allocate_ws_entries(tx, 0);
   }
 }
@@ -959,6 +1796,12 @@ int_stm_prepare(stm_tx_t *tx)
     tx->attr.read_only = 0;
   }
 #endif /* CM == CM_MODULAR */
+#ifdef TM_STATISTICS
+  tx->hist_attempt = RDTSC();
+#endif /* TM_STATISTICS */
+#ifdef GREEN_BACKOFF
+  tx->bo_attempt = RDTSC();
+#endif /* GREEN_BACKOFF */
 
   /* Read/write set */
   /* has_writes / nb_acquired are the same field. */
@@ -969,8 +1812,17 @@ int_stm_prepare(stm_tx_t *tx)
 #endif /* USE_BLOOM_FILTER */
   tx->w_set.nb_entries = 0;
   tx->r_set.nb_entries = 0;
+  set_index_reset(&tx->w_set.index);
+  set_index_reset(&tx->r_set.index);
 
  start:
+#ifdef EPOCH_GC
+  /* The slot is cleared between transactions: publish a lower bound and
+   * fence before taking the start timestamp, so that a concurrent scan
+   * either sees it or computes a minimum no greater than that timestamp */
+  gc_set_epoch(GET_CLOCK);
+  ATOMIC_MB_FULL;
+#endif /* EPOCH_GC */
   /* Start timestamp */
   tx->start = tx->end = GET_CLOCK; /* OPT: Could be delayed until first read/write */
   if (unlikely(tx->start >= VERSION_MAX)) {
@@ -983,10 +1835,6 @@ int_stm_prepare(stm_tx_t *tx)
     tx->timestamp = tx->start;
 #endif /* CM == CM_MODULAR */
 
-#ifdef EPOCH_GC
-  gc_set_epoch(tx->start);
-#endif /* EPOCH_GC */
-
 #ifdef IRREVOCABLE_ENABLED
   if (unlikely(tx->irrevocable != 0)) {
     assert(!IS_ACTIVE(tx->status));
@@ -1002,17 +1850,43 @@ int_stm_prepare(stm_tx_t *tx)
   stm_check_quiesce(tx);
 }
 
-static inline volatile long long RDTSC() {
-   register long long TSC asm("eax");
-   asm volatile (".byte 15, 49" : : : "eax", "edx");
-   return TSC;
-}
-
 static inline void spin(unsigned long spinning){
 	unsigned long x;
 	for (x = 0; x < spinning; x++) __asm__ ("nop");
 }
 
+#ifdef GREEN_BACKOFF
+/*
+ * Spin for as long as the given number of spin() iterations took at
+ * calibration.  The TSC modes wait against a deadline, so that the time
+ * does not stretch on a down-clocked core.
+ */
+static INLINE void
+spin_wait(unsigned long iterations, int mode)
+{
+# if defined(__x86_64__) || defined(__i386__)
+  unsigned long long deadline;
+
+  if (mode == SPIN_MODE_NOP) {
+    spin(iterations);
+    return;
+  }
+  deadline = RDTSC() + (((unsigned long long)iterations * spin_tsc_mult) >> 16);
+  if (mode == SPIN_MODE_TPAUSE) {
+    /* TPAUSE returns early on interrupts or at the OS time limit */
+    while (RDTSC() < deadline)
+      __asm__ __volatile__ (".byte 0x66, 0x0f, 0xae, 0xf1" /* tpause %ecx (C0.2) */
+                            : : "c" (0), "a" ((unsigned int)deadline), "d" ((unsigned int)(deadline >> 32)) : "cc");
+  } else {
+    while (RDTSC() < deadline)
+      __asm__ __volatile__ ("pause");
+  }
+# else /* ! (defined(__x86_64__) || defined(__i386__)) */
+  spin(iterations);
+# endif /* ! (defined(__x86_64__) || defined(__i386__)) */
+}
+#endif /* GREEN_BACKOFF */
+
 /*
  * Rollback transaction.
  */
@@ -1020,11 +1894,17 @@ static NOINLINE void
 stm_rollback(stm_tx_t *tx, unsigned int reason)
 {
 //stick_this_thread_to_core(16);
-#if CM == CM_BACKOFF
+#ifdef GREEN_BACKOFF
   //stick_this_thread_to_core(16);
-  unsigned long wait;
-  volatile int j;
-#endif /* CM == CM_BACKOFF */
+  unsigned long wait, spun, slept;
+# ifdef TM_STATISTICS
+  unsigned long long t0;
+# endif /* TM_STATISTICS */
+  const bo_policy_t *bo;
+#endif /* GREEN_BACKOFF */
+#ifdef CONFLICT_SCHED
+  int queued;
+#endif /* CONFLICT_SCHED */
 #if CM == CM_MODULAR
   stm_word_t t;
 #endif /* CM == CM_MODULAR */
@@ -1069,10 +1949,13 @@ stm_rollback(stm_tx_t *tx, unsigned int reason)
  dropped:
 #endif /* CM == CM_MODULAR */
 
+  stats_abort(tx->stats, reason);
+  TRACE_EVENT(&tx->trace, TR_ABORT, 0, tx->attr.id, reason);
 #if CM == CM_MODULAR || defined(TM_STATISTICS)
   tx->stat_retries++;
 #endif /* CM == CM_MODULAR || defined(TM_STATISTICS) */
 #ifdef TM_STATISTICS
+  hist_record(&tx->hist[HIST_ATTEMPT], RDTSC() - tx->hist_attempt);
   tx->stat_aborts++;
   if (tx->stat_retries_max < tx->stat_retries)
     tx->stat_retries_max = tx->stat_retries;
@@ -1104,7 +1987,48 @@ stm_rollback(stm_tx_t *tx, unsigned int reason)
       _tinystm.abort_cb[cb].f(_tinystm.abort_cb[cb].arg);
   }
 
-#if CM == CM_BACKOFF
+#ifdef CONFLICT_SCHED
+  queued = sched_conflict(tx);
+#endif /* CONFLICT_SCHED */
+
+#ifdef EPOCH_GC
+  /* Do not hold back collection while waiting */
+  gc_clear_epoch();
+#endif /* EPOCH_GC */
+
+#ifdef GREEN_BACKOFF
+  bo_site_abort(tx);
+# ifdef IRREVOCABLE_ENABLED
+  tx->bo_wasted += RDTSC() - tx->bo_attempt;
+  /* Explicit aborts are not contention: an irrevocable attempt could not honour them */
+  if (unlikely(bo_starving(tx)) && !tx->attr.no_retry && (reason & STM_ABORT_EXPLICIT) == 0) {
+    /* Restart alone instead of backing off (irrevocability is acquired in int_stm_prepare) */
+    tx->irrevocable = 1 + 0x08;
+    tx->bo_site->escalations++;
+    ATOMIC_STORE(&tx->stats->escalations, tx->stats->escalations + 1);
+    TRACE_EVENT(&tx->trace, TR_ESCALATE, 0, tx->attr.id, tx->_retries);
+    tx->_retries += 1;
+    tx->c_lock = NULL;
+    goto waited;
+  }
+# endif /* IRREVOCABLE_ENABLED */
+# ifdef CONFLICT_SCHED
+  if (queued && !tx->attr.no_retry && (reason & STM_ABORT_NO_RETRY) != STM_ABORT_NO_RETRY) {
+    /* Wait for the enemy, the backoff window is left as is */
+    tx->bo_site->queued++;
+    TRACE_EVENT(&tx->trace, TR_QUEUE, 0, tx->attr.id, tx->bo_site->heat);
+#  ifdef TM_STATISTICS
+    t0 = RDTSC();
+    stm_park(tx, SCHED_PARK_USEC);
+    hist_record(&tx->hist[HIST_SLEEP], RDTSC() - t0);
+#  else /* ! TM_STATISTICS */
+    stm_park(tx, SCHED_PARK_USEC);
+#  endif /* ! TM_STATISTICS */
+    tx->_retries += 1;
+    tx->c_lock = NULL;
+    goto waited;
+  }
+# endif /* CONFLICT_SCHED */
   /* Simple RNG (good enough for backoff) */
   tx->seed ^= (tx->seed << 17);
   tx->seed ^= (tx->seed >> 13);
@@ -1120,27 +2044,7 @@ stm_rollback(stm_tx_t *tx, unsigned int reason)
   //for (j = 0; j < wait; j++) {
     /* Do nothing */
   //}
-     if (wait < 2000)
-        tx->stat_backoff_wait[0]++;
-     else if (wait < 20000)
-        tx->stat_backoff_wait[1]++;
-     else if (wait < 200000)
-        tx->stat_backoff_wait[2]++;
-     else if (wait < 1000000)
-        tx->stat_backoff_wait[3]++;
-     else if (wait < 2000000)
-        tx->stat_backoff_wait[4]++;
-     else if (wait < 10000000)
-        tx->stat_backoff_wait[5]++;
-     else if (wait < 20000000)
-        tx->stat_backoff_wait[6]++;
-     else if (wait < 100000000)
-        tx->stat_backoff_wait[7]++;
-     else if (wait < 200000000)
-        tx->stat_backoff_wait[8]++;
-     else
-        tx->stat_backoff_wait[9]++;
-
+     stats_wait(tx->stats, wait);
      if (wait > tx->maxbackoff)
      	tx->maxbackoff = wait;
      tx->backoffs += 1;
@@ -1148,425 +2052,28 @@ stm_rollback(stm_tx_t *tx, unsigned int reason)
      tx->totalbackoffs += wait;
 
 
-#if BO == SPIN || BO==ASYM_SPIN || BO==DASYM_SPIN
-/*if(wait>100000){
-	unsigned long pre = RDTSC();
-	unsigned int x;
-	for(x=0;x<20;x++){
-		spin(wait/20);
-		if((RDTSC()-pre)>=wait)
-			break;
-	}
-	printf("%d\n",x);
-}
-else
-	spin(wait);*/
-//if(wait>300000)
-//printf("%d\t%lu\t%lu\n",tx->cpu_id,wait,post-pre);
-
-//unsigned long pre = RDTSC();
-spin(wait);
-//if(wait>100000)
-//	printf("%f\n",((float)(RDTSC()-pre))/wait);
-#endif
-
-#if BO == SPIN_PAUSE
-wait = wait/4;
-for (j = 0; j < wait; j++) {
-                __asm__ ("pause");
-         }
-#endif
-
-
-#if BO == SLEEP || BO==ASYM_SLEEP || BO==DASYM_SLEEP || BO==DDASYM_SLEEP
-//if (wait>tx->backoff_threshold){
-	//if(tx->cpu_id==0)
-	//	printf("cpu %d, backing off for: %lu\n",tx->cpu_id,wait);
-/*
-if(tx->cpu_id == 0 || tx->cpu_id == 1 || tx->cpu_id == 8 || tx->cpu_id == 9 || tx->cpu_id == 16 || tx->cpu_id == 17 || tx->cpu_id == 24 || tx->cpu_id == 25 || tx->cpu_id == 32 || tx->cpu_id == 33 || tx->cpu_id == 40 || tx->cpu_id == 41 || tx->cpu_id == 48 || tx->cpu_id == 49 || tx->cpu_id == 56 || tx->cpu_id == 57)
-	wait = 0;
-if(wait>0){
-	if (wait > 1000000){
-                int iters = wait / 1000000;
-                int remaining = wait % 1000000;
-                sleep(iters);
-                usleep(wait);
-        }
-        else
-                usleep(wait);
-
-}
-*/
-//	if (wait > MIN_BACKOFF){
-		//int sleeping = wait/1400 - 100;
-		//if (sleeping<0)
-		//	sleeping = 0;
-//		usleep(wait);
-//	}
-//}
-//else
-//	usleep(0);
-
-
-        /*if (sleeping > 1000000){
-                int iters = sleeping / 1000000;
-                int remaining = sleeping % 1000000;
-                sleep(iters);
-                if (remaining > 50000){
-                        sleeping = remaining - 50000;
-                        usleep(sleeping);
-                }
-        }
-        else
-                usleep(sleeping);*/
-//if(wait>60000){
-        /*long sleeping = (wait-75000)/1.5;
-	//unsigned long sleeping = wait/1.5;
-	if(sleeping<0)
-		sleeping = 0;
-	struct timespec tim, tim2;
-        tim.tv_sec = 0;
-        //tim.tv_nsec = sleeping*1000;
-        if (sleeping > 1000000){
-                int iters = sleeping / 1000000;
-                int remaining = sleeping % 1000000;
-                tim.tv_sec = iters;
-                tim.tv_nsec = remaining;
-        }
-	 nanosleep(&tim , &tim2);*/
-//}
-//else
-//	usleep(0);
-
-//unsigned long sleeping = wait/1500;
-//usleep(sleeping);
-
-	long sleeping = wait-75000/1500;
-        if(sleeping<0)
-		sleeping=0;
-
-        struct timespec tim, tim2;
-        tim.tv_sec = 0;
-        tim.tv_nsec = sleeping *1000;
-        if (sleeping > 999999){
-                int iters = sleeping / 1000000;
-                int remaining = sleeping % 1000000;
-                tim.tv_sec = iters;
-                tim.tv_nsec = remaining*1000;
-        }
-	int err = nanosleep(&tim , &tim2);
-	if (err!=0)
-        	printf("sleeping: %d\n",err);
-	
-	//usleep(sleeping);
-#endif
-
-
-#if BO == ADPT || BO==ASYM_ADPT || BO==DASYM_ADPT || BO==DDASYM_ADPT || BO == ADPT_THRESH || BO == ASYM_ADPT_THRESH
-//unsigned long costofsleep = 150000/tx->spintosleep;
-//unsigned int converter = 2160/tx->spintosleep;
-//unsigned long costofsleep = 100000;
-//if(wait>backoff_threshold){
-if (wait>backoff_threshold){
-	//if(tx->cpu_id==2)
-	//printf("backing off for %lu\n",wait);
-	long sleeping = (wait-beta*spintosleep)/spintosleep;
-	if(sleeping<0)
-		sleeping = 0;
-	//unsigned long pre;
-	//if(sleeping>100000)
-	//	pre = RDTSC();
-	
-	/*if (sleeping > 1000000){
-		int iters = sleeping / 1000000;
-                int remaining = sleeping % 1000000;
-                sleep(iters);
-                if (remaining > 50000){
-                        sleeping = remaining - 50000;
-                        usleep(sleeping);
-                }
-	}
-	else
-		usleep(sleeping);*/
-
-
-	struct timespec tim, tim2;
-	tim.tv_sec = 0;
-	tim.tv_nsec = sleeping * 1000;
-	if (sleeping > 999999){
-                int iters = sleeping / 1000000;
-                int remaining = sleeping % 1000000;
-        	tim.tv_sec = iters;
-        	tim.tv_nsec = remaining * 1000;
-	}
-	nanosleep(&tim , &tim2);
-
-	//if (sleeping>100000)
-	//	printf("%lu\t%lu\t%lu\n",wait, sleeping,RDTSC()-pre);
-	/*struct timespec tim, tim2;
-        tim.tv_sec = 0;
-        tim.tv_nsec = wait*1000;
-	if (tim.tv_nsec > 10000){
-		int iters = tim.tv_nsec / 10000;
-		int remaining = tim.tv_nsec % 10000;
-		//printf("sleeping for %d, %d\n", iters, remaining);
-		int x = 0;
-		tim.tv_nsec = 10000;
-		for (x=0;x<iters;x++)
-			nanosleep(&tim , &tim2);
-		if (remaining > iters*150000){
-			tim.tv_nsec = remaining -  iters*150000;
-			nanosleep(&tim , &tim2);
-		}
-	}
-	else
-	        nanosleep(&tim , &tim2);*/
-}
-else{
-	spin(wait);
-	//unsigned long pre;
-        //pre = RDTSC();
-	//unsigned long x;
-	//unsigned long waiting = (wait * 750) + 50000;
-	//for (x = 0; x < wait; x++) {
-        //        __asm__ ("nop");
-        //}
-	//if(wait>100000){
-        //unsigned long post = RDTSC();
-	//float tc = (float)(post - pre);
-        //tx->spintosleep = tc/wait;
-	//if(tx->spintosleep>20||tx->spintosleep==0)
-	//	tx->spintosleep = 3;
-	//}
-}
-#endif
-#if BO==ASYM_ADPT || BO==ASYM_SPIN || BO==ASYM_SLEEP || BO==DASYM_ADPT || BO==DDASYM_ADPT || BO==DASYM_SLEEP || BO==DDASYM_SLEEP || BO==ASYM_ADPT_THRESH || BO==DASYM_SPIN
- if(tx->_retries < asym_threshold ){
- if (tx->backoff < MAX_BACKOFF){
-	if(ferraris >= 16){
-		if(tx->cpu_id == 0 || tx->cpu_id == 1 || tx->cpu_id == 8 || tx->cpu_id == 9 || tx->cpu_id == 16 || tx->cpu_id == 17 || tx->cpu_id == 24 || tx->cpu_id == 25 || tx->cpu_id == 32 || tx->cpu_id == 33 || tx->cpu_id == 40 || tx->cpu_id == 41 || tx->cpu_id == 48 || tx->cpu_id == 49 || tx->cpu_id == 56 || tx->cpu_id == 57)
-			 tx->backoff += 1000;
-		else
-			tx->backoff <<= 1;
-	}
-	else if(ferraris >= 15){
-                if(tx->cpu_id == 0 || tx->cpu_id == 1 || tx->cpu_id == 8 || tx->cpu_id == 9 || tx->cpu_id == 16 || tx->cpu_id == 17 || tx->cpu_id == 24 || tx->cpu_id == 25 || tx->cpu_id == 32 || tx->cpu_id == 33 || tx->cpu_id == 40 || tx->cpu_id == 41 || tx->cpu_id == 48 || tx->cpu_id == 49 || tx->cpu_id == 56)
-                         tx->backoff += 1000;
-                else
-                        tx->backoff <<= 1;
-        }
-        else if(ferraris >= 14){
-                if(tx->cpu_id == 0 || tx->cpu_id == 1 || tx->cpu_id == 8 || tx->cpu_id == 9 || tx->cpu_id == 16 || tx->cpu_id == 17 || tx->cpu_id == 24 || tx->cpu_id == 25 || tx->cpu_id == 32 || tx->cpu_id == 33 || tx->cpu_id == 40 || tx->cpu_id == 41 || tx->cpu_id == 48 || tx->cpu_id == 49)
-                         tx->backoff += 1000;
-                else
-                        tx->backoff <<= 1;
-        }
-        else if(ferraris >= 13){
-                if(tx->cpu_id == 0 || tx->cpu_id == 1 || tx->cpu_id == 8 || tx->cpu_id == 9 || tx->cpu_id == 16 || tx->cpu_id == 17 || tx->cpu_id == 24 || tx->cpu_id == 25 || tx->cpu_id == 32 || tx->cpu_id == 33 || tx->cpu_id == 40 || tx->cpu_id == 48 || tx->cpu_id == 49)
-                         tx->backoff += 1000;
-                else
-                        tx->backoff <<= 1;
-        }
-        else if(ferraris >= 12){
-		if(max_ferraris==16){
-                	if(tx->cpu_id == 0 || tx->cpu_id == 1 || tx->cpu_id == 8 || tx->cpu_id == 9 || tx->cpu_id == 16 || tx->cpu_id == 17 || tx->cpu_id == 24 || tx->cpu_id == 25 || tx->cpu_id == 32 || tx->cpu_id == 33 || tx->cpu_id == 48 || tx->cpu_id == 49)
-                         	tx->backoff += 1000;
-                        else
-                                tx->backoff <<= 1;
-		}
-		else if(max_ferraris==12){
-			if(tx->cpu_id == 0 || tx->cpu_id == 1 || tx->cpu_id == 8 || tx->cpu_id == 9 || tx->cpu_id == 16 || tx->cpu_id == 17 || tx->cpu_id == 24 || tx->cpu_id == 25 || tx->cpu_id == 32 || tx->cpu_id == 33 || tx->cpu_id == 40 || tx->cpu_id == 41)
-                         	tx->backoff += 1000;
-                        else
-                                tx->backoff <<= 1;
-		}
-                else
-                        tx->backoff <<= 1;
-        }
-        else if(ferraris >= 11){
-		if(max_ferraris==16){
-         		if(tx->cpu_id == 0 || tx->cpu_id == 1 || tx->cpu_id == 8 || tx->cpu_id == 9 || tx->cpu_id == 16 || tx->cpu_id == 17 || tx->cpu_id == 24 || tx->cpu_id == 32 || tx->cpu_id == 33 || tx->cpu_id == 48 || tx->cpu_id == 49)
-                        	tx->backoff += 1000;
-			else
-                        	tx->backoff <<= 1;	
-		}
-		else if(max_ferraris==12){
-                        if(tx->cpu_id == 0 || tx->cpu_id == 1 || tx->cpu_id == 8 || tx->cpu_id == 9 || tx->cpu_id == 16 || tx->cpu_id == 17 || tx->cpu_id == 24 || tx->cpu_id == 25 || tx->cpu_id == 32 || tx->cpu_id == 33 || tx->cpu_id == 40)
-                                tx->backoff += 1000;
-                        else
-                                tx->backoff <<= 1;
-		}
-                else
-                        tx->backoff <<= 1;
-        }
-        else if(ferraris >= 10){
-		if(max_ferraris==16){
-                	if(tx->cpu_id == 0 || tx->cpu_id == 1 || tx->cpu_id == 8 || tx->cpu_id == 9 || tx->cpu_id == 16 || tx->cpu_id == 17 || tx->cpu_id == 32 || tx->cpu_id == 33 || tx->cpu_id == 48 || tx->cpu_id == 49)
-                         	tx->backoff += 1000;
-                        else
-                                tx->backoff <<= 1;
-		}
-		else if(max_ferraris==12){
-			if(tx->cpu_id == 0 || tx->cpu_id == 1 || tx->cpu_id == 8 || tx->cpu_id == 9 || tx->cpu_id == 16 || tx->cpu_id == 17 || tx->cpu_id == 24 || tx->cpu_id == 25 || tx->cpu_id == 32 || tx->cpu_id == 33)
-                                tx->backoff += 1000;
-                        else
-                                tx->backoff <<= 1;
-		}
-                else
-                        tx->backoff <<= 1;
-        }
-        else if(ferraris >= 9){
-		if(max_ferraris==16){
-                	if(tx->cpu_id == 0 || tx->cpu_id == 1 || tx->cpu_id == 8 || tx->cpu_id == 16 || tx->cpu_id == 17 || tx->cpu_id == 32 || tx->cpu_id == 33 || tx->cpu_id == 48 || tx->cpu_id == 49)
-                         	tx->backoff += 1000;
-                        else
-                                tx->backoff <<= 1;
-		}
-		else if(max_ferraris==12){
-			if(tx->cpu_id == 0 || tx->cpu_id == 1 || tx->cpu_id == 8 || tx->cpu_id == 9 || tx->cpu_id == 16 || tx->cpu_id == 17 || tx->cpu_id == 24 || tx->cpu_id == 32 || tx->cpu_id == 33)
-                                tx->backoff += 1000;
-                        else
-                                tx->backoff <<= 1;
-		}
-                else
-                        tx->backoff <<= 1;
-        }
-        else if(ferraris >= 8){
-		if(max_ferraris==16){
-                	if(tx->cpu_id == 0 || tx->cpu_id == 1 || tx->cpu_id == 16 || tx->cpu_id == 17 || tx->cpu_id == 32 || tx->cpu_id == 33 || tx->cpu_id == 48 || tx->cpu_id == 49)
-                        	 tx->backoff += 1000;
-                        else
-                                tx->backoff <<= 1;
-		}
-		else if(max_ferraris==12){
-                        if(tx->cpu_id == 0 || tx->cpu_id == 1 || tx->cpu_id == 8 || tx->cpu_id == 9 || tx->cpu_id == 16 || tx->cpu_id == 17 || tx->cpu_id == 32 || tx->cpu_id == 33)
-                                 tx->backoff += 1000;
-                        else
-                                tx->backoff <<= 1;
-		}
-                else if(max_ferraris==8){
-                        if(tx->cpu_id == 0 || tx->cpu_id == 1 || tx->cpu_id == 8 || tx->cpu_id == 9 || tx->cpu_id == 16 || tx->cpu_id == 17 || tx->cpu_id == 24 || tx->cpu_id == 25)
-                                 tx->backoff += 1000;
-                	else
-                                tx->backoff <<= 1;
-		}
-                else
-                        tx->backoff <<= 1;
-        }
-        else if(ferraris >= 7){
-		if(max_ferraris==16){
-	                if(tx->cpu_id == 0 || tx->cpu_id == 1 || tx->cpu_id == 16 || tx->cpu_id == 17 || tx->cpu_id == 32 || tx->cpu_id == 33 || tx->cpu_id == 48)
-                         	tx->backoff += 1000;
-                        else
-                                tx->backoff <<= 1;
-		}
-		else if(max_ferraris==12){
-                        if(tx->cpu_id == 0 || tx->cpu_id == 1 || tx->cpu_id == 8 || tx->cpu_id == 16 || tx->cpu_id == 17 || tx->cpu_id == 32 || tx->cpu_id == 33)
-                                 tx->backoff += 1000;
-                        else
-                                tx->backoff <<= 1;
-		}
-                else if(max_ferraris==8){
-			 if(tx->cpu_id == 0 || tx->cpu_id == 1 || tx->cpu_id == 8 || tx->cpu_id == 9 || tx->cpu_id == 16 || tx->cpu_id == 17 || tx->cpu_id == 24)
-                                 tx->backoff += 1000;
-                        else
-                                tx->backoff <<= 1;
-		}
-                else
-                        tx->backoff <<= 1;
-        }
-        else if(ferraris >= 6){
-		if(max_ferraris>=12){
-	                if(tx->cpu_id == 0 || tx->cpu_id == 1 || tx->cpu_id == 16 || tx->cpu_id == 17 || tx->cpu_id == 32 || tx->cpu_id == 33)
-        	                 tx->backoff += 1000;
-                        else
-                                tx->backoff <<= 1;
-		}
-                else if(max_ferraris==8){
-			if(tx->cpu_id == 0 || tx->cpu_id == 1 || tx->cpu_id == 8 || tx->cpu_id == 9 || tx->cpu_id == 16 || tx->cpu_id == 17)
-                                 tx->backoff += 1000;
-                        else
-                                tx->backoff <<= 1;
-                }
-                else
-                        tx->backoff <<= 1;
-        }
-        else if(ferraris >= 5){
-		if(max_ferraris>=12){
-    	        	if(tx->cpu_id == 0 || tx->cpu_id == 1 || tx->cpu_id == 16 || tx->cpu_id == 17 || tx->cpu_id == 32)
-                        	 tx->backoff += 1000;
-                        else
-                                tx->backoff <<= 1;
-		}
-                else if(max_ferraris==8){
-			if(tx->cpu_id == 0 || tx->cpu_id == 1 || tx->cpu_id == 8 || tx->cpu_id == 16 || tx->cpu_id == 17)
-                                 tx->backoff += 1000;
-                        else
-                                tx->backoff <<= 1;
-                }
-                else
-                        tx->backoff <<= 1;
-        }
-        else if(ferraris >= 4){
-		if(max_ferraris>=8){
-	                if(tx->cpu_id == 0 || tx->cpu_id == 1 || tx->cpu_id == 16 || tx->cpu_id == 17 )
-        	                 tx->backoff += 1000;
-                        else
-                                tx->backoff <<= 1;
-		}
-		else if(max_ferraris>=4){
-			if(tx->cpu_id == 0 || tx->cpu_id == 1 || tx->cpu_id == 8 || tx->cpu_id == 9 )
-                                 tx->backoff += 1000;
-                        else
-                                tx->backoff <<= 1;
-		}
-                else
-                        tx->backoff <<= 1;
-        }
-        else if(ferraris >= 3){
-                if(max_ferraris>=8){
-                        if(tx->cpu_id == 0 || tx->cpu_id == 1 || tx->cpu_id == 16 )
-                                 tx->backoff += 1000;
-                        else
-                                tx->backoff <<= 1;
-                }
-                else if(max_ferraris>=4){
-			if(tx->cpu_id == 0 || tx->cpu_id == 1 || tx->cpu_id == 8 )
-                                 tx->backoff += 1000;
-
-                        else
-                                tx->backoff <<= 1;
-                }
-		else
-                        tx->backoff <<= 1;
-        }
-        else if(ferraris >= 2){
-                if(tx->cpu_id == 0 || tx->cpu_id == 1)
-                        tx->backoff += 1000;
-		else
-                        tx->backoff <<= 1;
-        }
-        else if(ferraris >= 1){
-                if(tx->cpu_id == 0)
-                	tx->backoff += 1000;
-        	else        
-	        	tx->backoff <<= 1;
-        }
-	else
-		tx->backoff <<= 1;
-   }
-}
-else{
-	if (tx->backoff < MAX_BACKOFF)
-          tx->backoff <<= 1;
-}
-#else
-      if (tx->backoff < MAX_BACKOFF)
-    	  tx->backoff <<= 1;
-#endif
-#endif /* CM == CM_BACKOFF */
+  /* Wait according to the backoff policy, then grow the backoff window */
+  bo = _tinystm.backoff_policy;
+  spun = tx->bo_spun;
+  slept = tx->bo_slept;
+# ifdef TM_STATISTICS
+  t0 = RDTSC();
+  bo->wait(tx, wait);
+  if (wait != 0)
+    hist_record(&tx->hist[tx->bo_spun != spun ? HIST_SPIN : HIST_SLEEP], RDTSC() - t0);
+# else /* ! TM_STATISTICS */
+  bo->wait(tx, wait);
+# endif /* ! TM_STATISTICS */
+  bo->on_abort(tx);
+  ATOMIC_STORE(&tx->stats->spun, tx->stats->spun + tx->bo_spun - spun);
+  ATOMIC_STORE(&tx->stats->slept, tx->stats->slept + tx->bo_slept - slept);
+  tx->c_lock = NULL;
+# if defined(IRREVOCABLE_ENABLED) || defined(CONFLICT_SCHED)
+ waited:
+# endif /* defined(IRREVOCABLE_ENABLED) || defined(CONFLICT_SCHED) */
+#endif /* GREEN_BACKOFF */
 
-#if CM == CM_DELAY || CM == CM_MODULAR
+#if CM == CM_DELAY || (CM == CM_MODULAR && ! defined(GREEN_BACKOFF))
   /*stick this thread to wait core*/
   //stick_this_thread_to_core(16);
 
@@ -1584,9 +2091,12 @@ else{
     }
     tx->c_lock = NULL;
   }
-#endif /* CM == CM_DELAY || CM == CM_MODULAR */
+#endif /* CM == CM_DELAY || (CM == CM_MODULAR && ! defined(GREEN_BACKOFF)) */
   /* Don't prepare a new transaction if no retry. */
   if (tx->attr.no_retry || (reason & STM_ABORT_NO_RETRY) == STM_ABORT_NO_RETRY) {
+#ifdef GREEN_BACKOFF
+    stm_admit_release(tx);
+#endif /* GREEN_BACKOFF */
     tx->nesting = 0;
     return;
   }
@@ -1752,7 +2262,7 @@ cpu_set_t cpuset;
         tx->this_thread = pthread_self();
           pthread_getaffinity_np(tx->this_thread, sizeof(cpu_set_t), &cpuset);
 
-           for (j = 0; j < 64; j++){
+           for (j = 0; j < MAX_CPUS; j++){
                if (CPU_ISSET(j, &cpuset)){
 		   thread_status[j] = 1;
                    tx->cpu_id = j;
@@ -1769,6 +2279,7 @@ cpu_set_t cpuset;
   tx->r_set.nb_entries = 0;
   tx->r_set.size = RW_SET_SIZE;
   stm_allocate_rs_entries(tx, 0);
+  memset(&tx->r_set.index, 0, sizeof(tx->r_set.index));
   /* Write set */
   tx->w_set.nb_entries = 0;
   tx->w_set.size = RW_SET_SIZE;
@@ -1779,6 +2290,7 @@ cpu_set_t cpuset;
   tx->w_set.bloom = 0;
 #endif /* USE_BLOOM_FILTER */
   stm_allocate_ws_entries(tx, 0);
+  memset(&tx->w_set.index, 0, sizeof(tx->w_set.index));
   /* Nesting level */
   tx->nesting = 0;
   /* Transaction-specific data */
@@ -1787,24 +2299,30 @@ cpu_set_t cpuset;
   /* Thread identifier */
   tx->thread_id = pthread_self();
 #endif /* CONFLICT_TRACKING */
-#if CM == CM_DELAY || CM == CM_MODULAR
+#if CM == CM_DELAY || CM == CM_MODULAR || defined(GREEN_BACKOFF)
   /* Contented lock */
   tx->c_lock = NULL;
-#endif /* CM == CM_DELAY || CM == CM_MODULAR */
-#if CM == CM_BACKOFF
+#endif /* CM == CM_DELAY || CM == CM_MODULAR || defined(GREEN_BACKOFF) */
+#ifdef GREEN_BACKOFF
   /* Backoff */
   //tx->backoff_asym_threshold = atoi(getenv("ASYM_THRESHOLD"));
   //tx->backoff_threshold = atoi(getenv("THRESHOLD"));
   int xx;
-  for(xx = 0;xx < 10; xx++)
-	tx->stat_backoff_wait[xx] = 0;
   tx->maxbackoff = MIN_BACKOFF;
   tx->backoffs = 0;
   //tx->spintosleep = 3.0;
   tx->totalbackoffs = 0;
   tx->backoff = MIN_BACKOFF;
   tx->seed = 123456789UL;
-#endif /* CM == CM_BACKOFF */
+  tx->bo_spun = tx->bo_slept = 0;
+  for (xx = 0; xx < BO_SITES; xx++)
+    bo_site_init(&tx->bo_sites[xx], 0);
+  tx->bo_site = &tx->bo_sites[0];
+  tx->admitted = 0;
+#endif /* GREEN_BACKOFF */
+#ifdef TM_TRACE
+  trace_thread(&tx->trace, TR_KIND_TX, tx->cpu_id);
+#endif /* TM_TRACE */
 #if CM == CM_MODULAR
   tx->visible_reads = 0;
   tx->timestamp = 0;
@@ -1817,6 +2335,7 @@ cpu_set_t cpuset;
   tx->stat_commits = 0;
   tx->stat_aborts = 0;
   tx->stat_retries_max = 0;
+  memset(tx->hist, 0, sizeof(tx->hist));
 #endif /* TM_STATISTICS */
 #ifdef TM_STATISTICS2
   tx->stat_aborts_1 = 0;
@@ -1830,6 +2349,11 @@ cpu_set_t cpuset;
 #ifdef IRREVOCABLE_ENABLED
   tx->irrevocable = 0;
 #endif /* IRREVOCABLE_ENABLED */
+  tx->stats = stats_acquire();
+#if CLOCK_SCHEME == CLOCK_HIER
+  tx->clock_group = &_tinystm.clock_groups[_tinystm.clock_group_of[tx->cpu_id]];
+#endif /* CLOCK_SCHEME == CLOCK_HIER */
+  ATOMIC_STORE(&tx->stats->cpu, tx->cpu_id);
   /* Store as thread-local data */
   tls_set_tx(tx);
   stm_quiesce_enter_thread(tx);
@@ -1852,12 +2376,9 @@ thread_status[tx->cpu_id] = 0;
 #ifdef EPOCH_GC
   stm_word_t t;
 #endif /* EPOCH_GC */
-  #if CM==CM_BACKOFF
-
-  int backoff_index;
-  for (backoff_index=0;backoff_index<10;backoff_index++)
-     fprintf(stderr,"thread\t%d\t%d\t%d\n",tx->cpu_id,backoff_index,tx->stat_backoff_wait[backoff_index]);
-  #endif
+#ifdef TM_STATISTICS
+  int i;
+#endif /* TM_STATISTICS */
   //printf("this is %d\n",tx->cpu_id);
   PRINT_DEBUG("==> stm_exit_thread(%p[%lu-%lu])\n", tx, (unsigned long)tx->start, (unsigned long)tx->end);
 
@@ -1882,20 +2403,37 @@ thread_status[tx->cpu_id] = 0;
     if (tx->stat_commits)
       avg_aborts = (double)tx->stat_aborts / tx->stat_commits;
     printf("Thread %p | commits:%12u avg_aborts:%12.2f max_retries:%12u\n", (void *)pthread_self(), tx->stat_commits, avg_aborts, tx->stat_retries_max);
+# ifdef GREEN_BACKOFF
+    for (i = 0; i < BO_SITES; i++) {
+      bo_site_t *s = &tx->bo_sites[i];
+      if (s->key != 0)
+        printf("  site %#lx | commits:%12lu aborts:%12lu floor:%10lu threshold:%10lu escalations:%10lu queued:%10lu\n", (unsigned long)s->key, s->commits, s->aborts, s->floor, (unsigned long)(((unsigned long long)backoff_threshold * s->scale) / BO_SCALE_ONE), s->escalations, s->queued);
+    }
+# endif /* GREEN_BACKOFF */
   }
+  /* Keep the histograms for the report of stm_exit */
+  pthread_mutex_lock(&_tinystm.quiesce_mutex);
+  for (i = 0; i < HIST_NB; i++)
+    hist_merge(&_tinystm.hist[i], &tx->hist[i]);
+  pthread_mutex_unlock(&_tinystm.quiesce_mutex);
 #endif /* TM_STATISTICS */
 
   stm_quiesce_exit_thread(tx);
+  stats_release(tx->stats);
+  set_index_free(&tx->r_set.index);
+  set_index_free(&tx->w_set.index);
 
 
 #ifdef EPOCH_GC
   t = GET_CLOCK;
-  gc_free(tx->r_set.entries, t);
-  gc_free(tx->w_set.entries, t);
-  gc_free(tx, t);
+  gc_free(tx->r_set.locks, tx->r_set.size * sizeof(stm_word_t *), t);
+  gc_free(tx->r_set.versions, tx->r_set.size * sizeof(stm_word_t), t);
+  gc_free(tx->w_set.entries, tx->w_set.size * sizeof(w_entry_t), t);
+  gc_free(tx, sizeof(stm_tx_t), t);
   gc_exit_thread();
 #else /* ! EPOCH_GC */
-  xfree(tx->r_set.entries);
+  xfree(tx->r_set.locks);
+  xfree(tx->r_set.versions);
   xfree(tx->w_set.entries);
   xfree(tx);
 #endif /* ! EPOCH_GC */
@@ -1919,9 +2457,21 @@ int_stm_start(stm_tx_t *tx, stm_tx_attr_t attr)
 
   /* Attributes */
   tx->attr = attr;
-  #if CM == CM_BACKOFF
+#ifdef TM_STATISTICS
+  tx->hist_first = RDTSC();
+#endif /* TM_STATISTICS */
+  #ifdef GREEN_BACKOFF
   tx->_retries = 0;
+  tx->bo_wasted = 0;
+  /* Each atomic block has its own backoff state (the return address
+   * identifies the block when no id is given) */
+  tx->bo_site = bo_site_lookup(tx, attr.id != 0 ? (stm_word_t)attr.id : (stm_word_t)__builtin_return_address(0));
+  tx->backoff = tx->bo_site->floor;
+  /* Admission control (the gate is open unless the abort rate is too high) */
+  if (unlikely(ATOMIC_LOAD(&_tinystm.adm_cap) < ATOMIC_LOAD(&_tinystm.threads_nb)))
+    stm_admit(tx);
   #endif
+  TRACE_EVENT(&tx->trace, TR_BEGIN, 0, attr.id, 0);
   /* Initialize transaction descriptor */
   int_stm_prepare(tx);
 
@@ -1989,17 +2539,33 @@ int_stm_commit(stm_tx_t *tx)
 #endif /* DESIGN == MODULAR */
 
  end:
+  stats_inc(tx->stats, &tx->stats->commits);
+#ifdef GREEN_BACKOFF
+  TRACE_EVENT(&tx->trace, TR_COMMIT, 0, tx->attr.id, tx->_retries);
+#else /* ! GREEN_BACKOFF */
+  TRACE_EVENT(&tx->trace, TR_COMMIT, 0, tx->attr.id, 0);
+#endif /* ! GREEN_BACKOFF */
 #ifdef TM_STATISTICS
+  {
+    unsigned long long now = RDTSC();
+
+    hist_record(&tx->hist[HIST_COMMIT], now - tx->hist_first);
+    hist_record(&tx->hist[HIST_ATTEMPT], now - tx->hist_attempt);
+    hist_record(&tx->hist[HIST_RETRIES], tx->stat_retries);
+  }
   tx->stat_commits++;
 #endif /* TM_STATISTICS */
 #if CM == CM_MODULAR || defined(TM_STATISTICS)
   tx->stat_retries = 0;
 #endif /* CM == CM_MODULAR || defined(TM_STATISTICS) */
 
-#if CM == CM_BACKOFF
-  /* Reset backoff */
-  tx->backoff = MIN_BACKOFF;
-#endif /* CM == CM_BACKOFF */
+#ifdef GREEN_BACKOFF
+  bo_site_commit(tx);
+  /* Reset backoff (only needed if the transaction has aborted) */
+  if (unlikely(tx->_retries != 0))
+    _tinystm.backoff_policy->on_commit(tx);
+  stm_admit_release(tx);
+#endif /* GREEN_BACKOFF */
 
 #if CM == CM_MODULAR
   tx->visible_reads = 0;
@@ -2024,6 +2590,10 @@ int_stm_commit(stm_tx_t *tx)
       _tinystm.commit_cb[cb].f(_tinystm.commit_cb[cb].arg);
   }
 
+#ifdef EPOCH_GC
+  gc_clear_epoch();
+#endif /* EPOCH_GC */
+
   return 1;
 }
 
@@ -2134,6 +2704,37 @@ int_stm_get_stats(stm_tx_t *tx, const char *name, void *val)
     *(unsigned int *)val = tx->stat_retries_max;
     return 1;
   }
+  /* Histograms (stm_hist_t), durations in TSC ticks */
+  if (strcmp("commit_latency", name) == 0) {
+    *(stm_hist_t *)val = tx->hist[HIST_COMMIT];
+    return 1;
+  }
+  if (strcmp("attempt_duration", name) == 0) {
+    *(stm_hist_t *)val = tx->hist[HIST_ATTEMPT];
+    return 1;
+  }
+  if (strcmp("spin_wait", name) == 0) {
+    *(stm_hist_t *)val = tx->hist[HIST_SPIN];
+    return 1;
+  }
+  if (strcmp("sleep_wait", name) == 0) {
+    *(stm_hist_t *)val = tx->hist[HIST_SLEEP];
+    return 1;
+  }
+  if (strcmp("retries_per_commit", name) == 0) {
+    *(stm_hist_t *)val = tx->hist[HIST_RETRIES];
+    return 1;
+  }
+  if (strcmp("tsc_khz", name) == 0) {
+    *(unsigned long *)val = tsc_khz;
+    return 1;
+  }
+# ifdef GREEN_BACKOFF
+  if (strcmp("nb_escalations", name) == 0) {
+    *(unsigned long *)val = tx->stats->escalations;
+    return 1;
+  }
+# endif /* GREEN_BACKOFF */
 #endif /* TM_STATISTICS */
 #ifdef TM_STATISTICS2
   if (strcmp("nb_aborts_1", name) == 0) {
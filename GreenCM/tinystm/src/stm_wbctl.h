@@ -29,17 +29,16 @@
 static INLINE int
 stm_wbctl_validate(stm_tx_t *tx)
 {
-  r_entry_t *r;
-  int i;
+  unsigned int i, n;
   stm_word_t l;
 
   PRINT_DEBUG("==> stm_wbctl_validate(%p[%lu-%lu])\n", tx, (unsigned long)tx->start, (unsigned long)tx->end);
 
-  /* Validate reads */
-  r = tx->r_set.entries;
-  for (i = tx->r_set.nb_entries; i > 0; i--, r++) {
+  /* Validate reads (skipping unlocked entries with the same version) */
+  n = tx->r_set.nb_entries;
+  for (i = 0; (i = _tinystm.rs_scan(tx->r_set.locks, tx->r_set.versions, i, n)) < n; i++) {
     /* Read lock */
-    l = ATOMIC_LOAD(r->lock);
+    l = ATOMIC_LOAD(tx->r_set.locks[i]);
     /* Unlocked and still the same version? */
     if (LOCK_GET_OWNED(l)) {
       /* Do we own the lock? */
@@ -64,12 +63,12 @@ stm_wbctl_validate(stm_tx_t *tx)
         return 0;
       }
       /* We own the lock: OK */
-      if (w->version != r->version) {
+      if (w->version != tx->r_set.versions[i]) {
         /* Other version: cannot validate */
         return 0;
       }
     } else {
-      if (LOCK_GET_TIMESTAMP(l) != r->version) {
+      if (LOCK_GET_TIMESTAMP(l) != tx->r_set.versions[i]) {
         /* Other version: cannot validate */
         return 0;
       }
@@ -101,6 +100,13 @@ stm_wbctl_extend(stm_tx_t *tx)
     /* Clock overflow */
     return 0;
   }
+#ifdef INCREMENTAL_VALIDATION
+  /* No need to validate if the commits since tx->end did not write our reads */
+  if (commit_ring_check(tx, tx->end, now)) {
+    tx->end = now;
+    return 1;
+  }
+#endif /* INCREMENTAL_VALIDATION */
   /* Try to validate read set */
   if (stm_wbctl_validate(tx)) {
     /* It works: we can extend until now */
@@ -132,6 +138,9 @@ stm_wbctl_rollback(stm_tx_t *tx)
         }
       }
     } while (tx->w_set.nb_acquired > 0);
+#ifdef GREEN_BACKOFF
+    stm_wake_parked(tx);
+#endif /* GREEN_BACKOFF */
   }
 }
 
@@ -140,7 +149,6 @@ stm_wbctl_read(stm_tx_t *tx, volatile stm_word_t *addr)
 {
   volatile stm_word_t *lock;
   stm_word_t l, l2, value, version;
-  r_entry_t *r;
   w_entry_t *written = NULL;
 
   PRINT_DEBUG2("==> stm_wbctl_read(t=%p[%lu-%lu],a=%p)\n", tx, (unsigned long)tx->start, (unsigned long)tx->end, addr);
@@ -218,15 +226,14 @@ stm_wbctl_read(stm_tx_t *tx, volatile stm_word_t *addr)
 #endif /* READ_LOCKED_DATA */
   if (!tx->attr.read_only) {
 #ifdef NO_DUPLICATES_IN_RW_SETS
-    if (stm_has_read(tx, lock) != NULL)
+    if (stm_has_read(tx, lock) >= 0)
       goto return_value;
 #endif /* NO_DUPLICATES_IN_RW_SETS */
     /* Add address and version to read set */
     if (tx->r_set.nb_entries == tx->r_set.size)
       stm_allocate_rs_entries(tx, 1);
-    r = &tx->r_set.entries[tx->r_set.nb_entries++];
-    r->version = version;
-    r->lock = lock;
+    tx->r_set.versions[tx->r_set.nb_entries] = version;
+    tx->r_set.locks[tx->r_set.nb_entries++] = lock;
   }
  return_value:
   return value;
@@ -277,7 +284,7 @@ stm_wbctl_write(stm_tx_t *tx, volatile stm_word_t *addr, stm_word_t value, stm_w
       return NULL;
     }
 #endif /* UNIT_TX */
-    if (stm_has_read(tx, lock) != NULL) {
+    if (stm_has_read(tx, lock) >= 0) {
       /* Read version must be older (otherwise, tx->end >= version) */
       /* Not much we can do: abort */
       stm_rollback(tx, STM_ABORT_VAL_WRITE);
@@ -362,7 +369,7 @@ stm_wbctl_commit(stm_tx_t *tx)
 {
   w_entry_t *w;
   stm_word_t t;
-  int i;
+  int i, validate;
   stm_word_t l, value;
 
   PRINT_DEBUG("==> stm_wbctl_commit(%p[%lu-%lu])\n", tx, (unsigned long)tx->start, (unsigned long)tx->end);
@@ -381,9 +388,9 @@ stm_wbctl_commit(stm_tx_t *tx)
         continue;
       }
       /* Conflict: CM kicks in */
-# if CM == CM_DELAY
+# if CM == CM_DELAY || defined(GREEN_BACKOFF)
       tx->c_lock = w->lock;
-# endif /* CM == CM_DELAY */
+# endif /* CM == CM_DELAY || defined(GREEN_BACKOFF) */
 
 #ifdef IRREVOCABLE_ENABLED
       if (tx->irrevocable) {
@@ -432,7 +439,12 @@ stm_wbctl_commit(stm_tx_t *tx)
 #endif /* IRREVOCABLE_ENABLED */
 
   /* Get commit timestamp (may exceed VERSION_MAX by up to MAX_THREADS) */
-  t = FETCH_INC_CLOCK + 1;
+  t = clock_commit(tx, &validate);
+#ifdef INCREMENTAL_VALIDATION
+  commit_ring_publish(tx, t);
+  if (validate && commit_ring_check(tx, tx->end, t - 1))
+    validate = 0;
+#endif /* INCREMENTAL_VALIDATION */
 
 #ifdef IRREVOCABLE_ENABLED
   if (unlikely(tx->irrevocable))
@@ -440,7 +452,7 @@ stm_wbctl_commit(stm_tx_t *tx)
 #endif /* IRREVOCABLE_ENABLED */
 
   /* Try to validate (only if a concurrent transaction has committed since tx->start) */
-  if (unlikely(tx->start != t - 1 && !stm_wbctl_validate(tx))) {
+  if (unlikely(validate && !stm_wbctl_validate(tx))) {
     /* Cannot commit */
     stm_rollback(tx, STM_ABORT_VALIDATE);
     return 0;
@@ -463,6 +475,9 @@ stm_wbctl_commit(stm_tx_t *tx)
     if (!w->no_drop)
       ATOMIC_STORE_REL(w->lock, LOCK_SET_TIMESTAMP(t));
   }
+#ifdef GREEN_BACKOFF
+  stm_wake_parked(tx);
+#endif /* GREEN_BACKOFF */
 
  end:
   return 1;
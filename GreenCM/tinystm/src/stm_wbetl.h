@@ -39,17 +39,16 @@ static NOINLINE int stm_kill(stm_tx_t *tx, stm_tx_t *other, stm_word_t status);
 static INLINE int
 stm_wbetl_validate(stm_tx_t *tx)
 {
-    r_entry_t *r;
-    int i;
+    unsigned int i, n;
     stm_word_t l;
 
     PRINT_DEBUG("==> stm_wbetl_validate(%p[%lu-%lu])\n", tx, (unsigned long)tx->start, (unsigned long)tx->end);
 
-    /* Validate reads */
-    r = tx->r_set.entries;
-    for (i = tx->r_set.nb_entries; i > 0; i--, r++) {
+    /* Validate reads (skipping unlocked entries with the same version) */
+    n = tx->r_set.nb_entries;
+    for (i = 0; (i = _tinystm.rs_scan(tx->r_set.locks, tx->r_set.versions, i, n)) < n; i++) {
         /* Read lock */
-        l = ATOMIC_LOAD(r->lock);
+        l = ATOMIC_LOAD(tx->r_set.locks[i]);
         /* Unlocked and still the same version? */
         if (LOCK_GET_OWNED(l)) {
             /* Do we own the lock? */
@@ -75,7 +74,7 @@ stm_wbetl_validate(stm_tx_t *tx)
             }
             /* We own the lock: OK */
         } else {
-            if (LOCK_GET_TIMESTAMP(l) != r->version) {
+            if (LOCK_GET_TIMESTAMP(l) != tx->r_set.versions[i]) {
                 /* Other version: cannot validate */
                 return 0;
             }
@@ -107,6 +106,13 @@ stm_wbetl_extend(stm_tx_t *tx)
         /* Clock overflow */
         return 0;
     }
+#ifdef INCREMENTAL_VALIDATION
+    /* No need to validate if the commits since tx->end did not write our reads */
+    if (commit_ring_check(tx, tx->end, now)) {
+        tx->end = now;
+        return 1;
+    }
+#endif /* INCREMENTAL_VALIDATION */
     /* Try to validate read set */
     if (stm_wbetl_validate(tx)) {
         /* It works: we can extend until now */
@@ -124,10 +130,6 @@ stm_wbetl_rollback(stm_tx_t *tx)
 #if CM == CM_MODULAR
     stm_word_t t;
 #endif /* CM == CM_MODULAR */
-#if CM == CM_BACKOFF
-    unsigned long wait;
-    volatile int j;
-#endif /* CM == CM_BACKOFF */
 
     PRINT_DEBUG("==> stm_wbetl_rollback(%p[%lu-%lu])\n", tx, (unsigned long)tx->start, (unsigned long)tx->end);
 
@@ -156,6 +158,9 @@ stm_wbetl_rollback(stm_tx_t *tx)
         }
         /* Make sure that all lock releases become visible */
         ATOMIC_MB_WRITE;
+#ifdef GREEN_BACKOFF
+        stm_wake_parked(tx);
+#endif /* GREEN_BACKOFF */
     }
 }
 
@@ -167,7 +172,6 @@ stm_wbetl_read_invisible(stm_tx_t *tx, volatile stm_word_t *addr)
 {
     volatile stm_word_t *lock;
     stm_word_t l, l2, value, version;
-    r_entry_t *r;
     w_entry_t *w;
 #if CM == CM_MODULAR
     stm_word_t t;
@@ -264,6 +268,8 @@ stm_wbetl_read_invisible(stm_tx_t *tx, volatile stm_word_t *addr)
                     /* Data concurrently modified: a new version might be available => retry */
                     goto restart;
                 }
+                if (version > tx->end)
+                    clock_observe(version);
                 if (version >= tx->start && (version <= tx->end || (!tx->attr.read_only && stm_wbetl_extend(tx)))) {
                     /* Success */
 #  ifdef TM_STATISTICS2
@@ -305,11 +311,16 @@ stm_wbetl_read_invisible(stm_tx_t *tx, volatile stm_word_t *addr)
             goto restart_no_load;
         }
         /* Kill self */
+#  ifdef GREEN_BACKOFF
+        /* The backoff policy decides whether to wait for the lock */
+        tx->c_lock = lock;
+#  else /* ! GREEN_BACKOFF */
         if ((decision & DELAY_RESTART) != 0)
             tx->c_lock = lock;
-# elif CM == CM_DELAY
+#  endif /* ! GREEN_BACKOFF */
+# elif CM == CM_DELAY || defined(GREEN_BACKOFF)
         tx->c_lock = lock;
-# endif /* CM == CM_DELAY */
+# endif /* CM == CM_DELAY || defined(GREEN_BACKOFF) */
         /* Abort */
 # ifdef CONFLICT_TRACKING
         if (_tinystm.conflict_cb != NULL) {
@@ -350,6 +361,7 @@ stm_wbetl_read_invisible(stm_tx_t *tx, volatile stm_word_t *addr)
 #endif /* CM != CM_MODULAR */
         /* Valid version? */
         if (unlikely(version > tx->end)) {
+            clock_observe(version);
             /* No: try to extend first (except for read-only transactions: no read set) */
             if (tx->attr.read_only || !stm_wbetl_extend(tx)) {
                 /* Not much we can do: abort */
@@ -385,15 +397,14 @@ stm_wbetl_read_invisible(stm_tx_t *tx, volatile stm_word_t *addr)
 #endif /* READ_LOCKED_DATA */
     if (!tx->attr.read_only) {
 #ifdef NO_DUPLICATES_IN_RW_SETS
-        if (stm_has_read(tx, lock) != NULL)
+        if (stm_has_read(tx, lock) >= 0)
             goto return_value;
 #endif /* NO_DUPLICATES_IN_RW_SETS */
         /* Add address and version to read set */
         if (tx->r_set.nb_entries == tx->r_set.size)
             stm_allocate_rs_entries(tx, 1);
-        r = &tx->r_set.entries[tx->r_set.nb_entries++];
-        r->version = version;
-        r->lock = lock;
+        tx->r_set.versions[tx->r_set.nb_entries] = version;
+        tx->r_set.locks[tx->r_set.nb_entries++] = lock;
     }
     return_value:
     return value;
@@ -503,8 +514,13 @@ stm_wbetl_read_visible(stm_tx_t *tx, volatile stm_word_t *addr)
             goto acquire;
         }
         /* Kill self */
+#  ifdef GREEN_BACKOFF
+        /* The backoff policy decides whether to wait for the lock */
+        tx->c_lock = lock;
+#  else /* ! GREEN_BACKOFF */
         if ((decision & DELAY_RESTART) != 0)
             tx->c_lock = lock;
+#  endif /* ! GREEN_BACKOFF */
         /* Abort */
 # ifdef CONFLICT_TRACKING
         if (_tinystm.conflict_cb != NULL) {
@@ -686,11 +702,16 @@ stm_wbetl_write(stm_tx_t *tx, volatile stm_word_t *addr, stm_word_t value, stm_w
             goto acquire;
         }
         /* Kill self */
+# ifdef GREEN_BACKOFF
+        /* The backoff policy decides whether to wait for the lock */
+        tx->c_lock = lock;
+# else /* ! GREEN_BACKOFF */
         if ((decision & DELAY_RESTART) != 0)
             tx->c_lock = lock;
-#elif CM == CM_DELAY
+# endif /* ! GREEN_BACKOFF */
+#elif CM == CM_DELAY || defined(GREEN_BACKOFF)
         tx->c_lock = lock;
-#endif /* CM == CM_DELAY */
+#endif /* CM == CM_DELAY || defined(GREEN_BACKOFF) */
         /* Abort */
 #ifdef CONFLICT_TRACKING
         if (_tinystm.conflict_cb != NULL) {
@@ -713,11 +734,15 @@ stm_wbetl_write(stm_tx_t *tx, volatile stm_word_t *addr, stm_word_t value, stm_w
     version = LOCK_GET_TIMESTAMP(l);
 #ifdef IRREVOCABLE_ENABLED
     /* In irrevocable mode, no need to revalidate */
-    if (unlikely(tx->irrevocable))
+    if (unlikely(tx->irrevocable)) {
+        clock_observe(version);
         goto acquire_no_check;
+    }
 #endif /* IRREVOCABLE_ENABLED */
     acquire:
     if (unlikely(version > tx->end)) {
+        /* The commit timestamp must be newer than the version we replace */
+        clock_observe(version);
         /* We might have read an older version previously */
 #ifdef UNIT_TX
         if (unlikely(tx->attr.no_extend)) {
@@ -725,7 +750,7 @@ stm_wbetl_write(stm_tx_t *tx, volatile stm_word_t *addr, stm_word_t value, stm_w
             return NULL;
         }
 #endif /* UNIT_TX */
-        if (unlikely(stm_has_read(tx, lock) != NULL)) {
+        if (unlikely(stm_has_read(tx, lock) >= 0)) {
             /* Read version must be older (otherwise, tx->end >= version) */
             /* Not much we can do: abort */
 #if CM == CM_MODULAR
@@ -857,7 +882,7 @@ stm_wbetl_commit(stm_tx_t *tx)
 {
     w_entry_t *w;
     stm_word_t t;
-    int i;
+    int i, validate;
 
     PRINT_DEBUG("==> stm_wbetl_commit(%p[%lu-%lu])\n", tx, (unsigned long)tx->start, (unsigned long)tx->end);
 
@@ -901,14 +926,19 @@ stm_wbetl_commit(stm_tx_t *tx)
 #endif /* IRREVOCABLE_ENABLED */
 
     /* Get commit timestamp (may exceed VERSION_MAX by up to MAX_THREADS) */
-    t = FETCH_INC_CLOCK + 1;
+    t = clock_commit(tx, &validate);
+#ifdef INCREMENTAL_VALIDATION
+    commit_ring_publish(tx, t);
+    if (validate && commit_ring_check(tx, tx->end, t - 1))
+        validate = 0;
+#endif /* INCREMENTAL_VALIDATION */
 #ifdef IRREVOCABLE_ENABLED
     if (unlikely(tx->irrevocable))
         goto release_locks;
 #endif /* IRREVOCABLE_ENABLED */
 
     /* Try to validate (only if a concurrent transaction has committed since tx->start) */
-    if (unlikely(tx->start != t - 1 && !stm_wbetl_validate(tx))) {
+    if (unlikely(validate && !stm_wbetl_validate(tx))) {
         /* Cannot commit */
 #if CM == CM_MODULAR
         /* Abort caused by invisible reads */
@@ -938,6 +968,9 @@ stm_wbetl_commit(stm_tx_t *tx)
                 ATOMIC_STORE_REL(w->lock, LOCK_SET_TIMESTAMP(t));
         }
     }
+#ifdef GREEN_BACKOFF
+    stm_wake_parked(tx);
+#endif /* GREEN_BACKOFF */
 
     end:
     return 1;
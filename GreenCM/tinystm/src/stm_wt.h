@@ -29,17 +29,16 @@
 static INLINE int
 stm_wt_validate(stm_tx_t *tx)
 {
-  r_entry_t *r;
-  int i;
+  unsigned int i, n;
   stm_word_t l;
 
   PRINT_DEBUG("==> stm_wt_validate(%p[%lu-%lu])\n", tx, (unsigned long)tx->start, (unsigned long)tx->end);
 
-  /* Validate reads */
-  r = tx->r_set.entries;
-  for (i = tx->r_set.nb_entries; i > 0; i--, r++) {
+  /* Validate reads (skipping unlocked entries with the same version) */
+  n = tx->r_set.nb_entries;
+  for (i = 0; (i = _tinystm.rs_scan(tx->r_set.locks, tx->r_set.versions, i, n)) < n; i++) {
     /* Read lock */
-    l = ATOMIC_LOAD(r->lock);
+    l = ATOMIC_LOAD(tx->r_set.locks[i]);
     /* Unlocked and still the same version? */
     if (LOCK_GET_OWNED(l)) {
       /* Do we own the lock? */
@@ -65,7 +64,7 @@ stm_wt_validate(stm_tx_t *tx)
       }
       /* We own the lock: OK */
     } else {
-      if (LOCK_GET_TIMESTAMP(l) != r->version) {
+      if (LOCK_GET_TIMESTAMP(l) != tx->r_set.versions[i]) {
         /* Other version: cannot validate */
         return 0;
       }
@@ -97,6 +96,13 @@ stm_wt_extend(stm_tx_t *tx)
     /* Clock overflow */
     return 0;
   }
+#ifdef INCREMENTAL_VALIDATION
+  /* No need to validate if the commits since tx->end did not write our reads */
+  if (commit_ring_check(tx, tx->end, now)) {
+    tx->end = now;
+    return 1;
+  }
+#endif /* INCREMENTAL_VALIDATION */
   /* Try to validate read set */
   if (stm_wt_validate(tx)) {
     /* It works: we can extend until now */
@@ -143,28 +149,28 @@ stm_wt_rollback(stm_tx_t *tx)
   }
   /* Make sure that all lock releases become visible */
   ATOMIC_MB_WRITE;
+#ifdef GREEN_BACKOFF
+  stm_wake_parked(tx);
+#endif /* GREEN_BACKOFF */
 }
 
 static INLINE void
 stm_wt_add_to_rs(stm_tx_t *tx, stm_word_t version, volatile stm_word_t *lock)
 {
-  r_entry_t *r;
-
   /* No need to add to read set for read-only transaction */
   if (tx->attr.read_only)
     return;
 
 #ifdef NO_DUPLICATES_IN_RW_SETS
-  if (stm_has_read(tx, lock) != NULL)
-    return value;
+  if (stm_has_read(tx, lock) >= 0)
+    return;
 #endif /* NO_DUPLICATES_IN_RW_SETS */
 
   /* Add address and version to read set */
   if (tx->r_set.nb_entries == tx->r_set.size)
     stm_allocate_rs_entries(tx, 1);
-  r = &tx->r_set.entries[tx->r_set.nb_entries++];
-  r->version = version;
-  r->lock = lock;
+  tx->r_set.versions[tx->r_set.nb_entries] = version;
+  tx->r_set.locks[tx->r_set.nb_entries++] = lock;
 }
 
 static INLINE stm_word_t
@@ -255,9 +261,9 @@ stm_wt_read(stm_tx_t *tx, volatile stm_word_t *addr)
       goto restart;
     }
 # endif /* defined(IRREVOCABLE_ENABLED) */
-# if CM == CM_DELAY
+# if CM == CM_DELAY || defined(GREEN_BACKOFF)
     tx->c_lock = lock;
-# endif /* CM == CM_DELAY */
+# endif /* CM == CM_DELAY || defined(GREEN_BACKOFF) */
 
     /* Abort */
 # ifdef CONFLICT_TRACKING
@@ -355,9 +361,9 @@ stm_wt_write(stm_tx_t *tx, volatile stm_word_t *addr, stm_word_t value, stm_word
       goto restart;
     }
 # endif /* defined(IRREVOCABLE_ENABLED) */
-# if CM == CM_DELAY
+# if CM == CM_DELAY || defined(GREEN_BACKOFF)
     tx->c_lock = lock;
-# endif /* CM == CM_DELAY */
+# endif /* CM == CM_DELAY || defined(GREEN_BACKOFF) */
 
     /* Abort */
 # ifdef CONFLICT_TRACKING
@@ -394,7 +400,7 @@ stm_wt_write(stm_tx_t *tx, volatile stm_word_t *addr, stm_word_t value, stm_word
       return NULL;
     }
 #endif /* UNIT_TX */
-    if (stm_has_read(tx, lock) != NULL) {
+    if (stm_has_read(tx, lock) >= 0) {
       /* Read version must be older (otherwise, tx->end >= version) */
       /* Not much we can do: abort */
       stm_rollback(tx, STM_ABORT_VAL_WRITE);
@@ -509,7 +515,7 @@ stm_wt_commit(stm_tx_t *tx)
 {
   w_entry_t *w;
   stm_word_t t;
-  int i;
+  int i, validate;
 
   PRINT_DEBUG("==> stm_wt_commit(%p[%lu-%lu])\n", tx, (unsigned long)tx->start, (unsigned long)tx->end);
 
@@ -537,7 +543,12 @@ stm_wt_commit(stm_tx_t *tx)
 #endif /* IRREVOCABLE_ENABLED */
 
   /* Get commit timestamp (may exceed VERSION_MAX by up to MAX_THREADS) */
-  t = FETCH_INC_CLOCK + 1;
+  t = clock_commit(tx, &validate);
+#ifdef INCREMENTAL_VALIDATION
+  commit_ring_publish(tx, t);
+  if (validate && commit_ring_check(tx, tx->end, t - 1))
+    validate = 0;
+#endif /* INCREMENTAL_VALIDATION */
 
 #ifdef IRREVOCABLE_ENABLED
   if (unlikely(tx->irrevocable))
@@ -545,7 +556,7 @@ stm_wt_commit(stm_tx_t *tx)
 #endif /* IRREVOCABLE_ENABLED */
 
   /* Try to validate (only if a concurrent transaction has committed since tx->start) */
-  if (unlikely(tx->start != t - 1 && !stm_wt_validate(tx))) {
+  if (unlikely(validate && !stm_wt_validate(tx))) {
     /* Cannot commit */
     stm_rollback(tx, STM_ABORT_VALIDATE);
     return 0;
@@ -568,6 +579,9 @@ stm_wt_commit(stm_tx_t *tx)
   /* Make sure that all lock releases become visible */
   /* TODO: is ATOMIC_MB_WRITE required? */
   ATOMIC_MB_WRITE;
+#ifdef GREEN_BACKOFF
+  stm_wake_parked(tx);
+#endif /* GREEN_BACKOFF */
 end:
   return 1;
 }
@@ -0,0 +1,334 @@
+/*
+ * File:
+ *   topology.h
+ * Description:
+ *   CPU topology discovery, thread placement and fast-core set for
+ *   asymmetric backoff.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation, version 2
+ * of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#ifndef _TOPOLOGY_H_
+#define _TOPOLOGY_H_
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <dirent.h>
+
+#include "stm_internal.h"
+
+#ifndef TOPO_SYSFS
+# define TOPO_SYSFS                     "/sys/devices/system/cpu"
+#endif /* ! TOPO_SYSFS */
+#define FC_WORD_BITS                    (8 * sizeof(unsigned long))
+
+typedef struct cpu_topo {               /* Location of a CPU */
+  int cpu;                              /* Logical CPU number */
+  int package;                          /* Physical package (socket) */
+  int node;                             /* NUMA node (die on multi-die packages) */
+  int group;                            /* First CPU of the core/module (SMT or CMT siblings) */
+  int node_rank;                        /* Index of the node within its package */
+  int group_rank;                       /* Index of the group within its node */
+  int smt_rank;                         /* Index of the CPU within its group */
+} cpu_topo_t;
+
+typedef struct fc_order {               /* Fast-core ordering policy */
+  const char *name;
+  int (*cmp)(const void *, const void *);
+} fc_order_t;
+
+/* Online CPUs, sorted in the order in which they become fast cores */
+static cpu_topo_t topo_cpus[MAX_CPUS];
+static int topo_nb_cpus = 0;
+
+/* Thread placement policy (NULL if threads are not placed by the STM) */
+static const char *topo_placement = NULL;
+
+/* Current fast cores (one bit per CPU, tested on every abort) */
+static volatile unsigned long fast_cores[MAX_CPUS / FC_WORD_BITS] ALIGNED;
+
+/*
+ * Read an integer from a topology file of a CPU (-1 if not available).
+ */
+static int
+topo_read_int(int cpu, const char *file)
+{
+  char path[128];
+  FILE *f;
+  int v;
+
+  snprintf(path, sizeof(path), TOPO_SYSFS "/cpu%d/%s", cpu, file);
+  if ((f = fopen(path, "r")) == NULL)
+    return -1;
+  if (fscanf(f, "%d", &v) != 1)
+    v = -1;
+  fclose(f);
+  return v;
+}
+
+/*
+ * NUMA node of a CPU (the "nodeX" link in its sysfs directory).
+ */
+static int
+topo_read_node(int cpu)
+{
+  char path[128];
+  struct dirent *e;
+  DIR *d;
+  int node = -1;
+
+  snprintf(path, sizeof(path), TOPO_SYSFS "/cpu%d", cpu);
+  if ((d = opendir(path)) == NULL)
+    return -1;
+  while ((e = readdir(d)) != NULL) {
+    if (strncmp(e->d_name, "node", 4) == 0 && e->d_name[4] >= '0' && e->d_name[4] <= '9') {
+      node = atoi(e->d_name + 4);
+      break;
+    }
+  }
+  closedir(d);
+  return node;
+}
+
+/*
+ * Spread: first core/module of every node of every package, then the
+ * second one, etc. (e.g., 0,1,16,17,32,33,48,49,8,9,... on a 4-socket
+ * machine with 2 dies per socket and 2-core modules).
+ */
+static int
+fc_cmp_spread(const void *a, const void *b)
+{
+  const cpu_topo_t *x = (const cpu_topo_t *)a, *y = (const cpu_topo_t *)b;
+
+  if (x->group_rank != y->group_rank)
+    return x->group_rank - y->group_rank;
+  if (x->node_rank != y->node_rank)
+    return x->node_rank - y->node_rank;
+  if (x->package != y->package)
+    return x->package - y->package;
+  return x->cpu - y->cpu;
+}
+
+/*
+ * Compact: fill a node, then a package, before moving to the next one.
+ */
+static int
+fc_cmp_compact(const void *a, const void *b)
+{
+  const cpu_topo_t *x = (const cpu_topo_t *)a, *y = (const cpu_topo_t *)b;
+
+  if (x->package != y->package)
+    return x->package - y->package;
+  if (x->node != y->node)
+    return x->node - y->node;
+  if (x->group != y->group)
+    return x->group - y->group;
+  return x->cpu - y->cpu;
+}
+
+static const fc_order_t fc_orders[] = {
+  { "spread", fc_cmp_spread },
+  { "compact", fc_cmp_compact },
+  { NULL, NULL }
+};
+
+/*
+ * Scatter: like spread, but SMT/CMT siblings only once every core or
+ * module has a CPU.
+ */
+static int
+pl_cmp_scatter(const void *a, const void *b)
+{
+  const cpu_topo_t *x = (const cpu_topo_t *)a, *y = (const cpu_topo_t *)b;
+
+  if (x->smt_rank != y->smt_rank)
+    return x->smt_rank - y->smt_rank;
+  return fc_cmp_spread(a, b);
+}
+
+/*
+ * Core: like compact, but one CPU per core or module first.
+ */
+static int
+pl_cmp_core(const void *a, const void *b)
+{
+  const cpu_topo_t *x = (const cpu_topo_t *)a, *y = (const cpu_topo_t *)b;
+
+  if (x->smt_rank != y->smt_rank)
+    return x->smt_rank - y->smt_rank;
+  return fc_cmp_compact(a, b);
+}
+
+/* Thread placement policies ("fast" keeps the fast core order) */
+static const fc_order_t pl_orders[] = {
+  { "compact", fc_cmp_compact },
+  { "scatter", pl_cmp_scatter },
+  { "core", pl_cmp_core },
+  { "fast", NULL },
+  { NULL, NULL }
+};
+
+/*
+ * Discover online CPUs and their package/node/module (return number of CPUs).
+ */
+static int
+topo_discover(void)
+{
+  cpu_topo_t *t, *u;
+  int cpu, i, j;
+
+  topo_nb_cpus = 0;
+  for (cpu = 0; cpu < MAX_CPUS; cpu++) {
+    /* The topology directory only exists for online CPUs */
+    if ((i = topo_read_int(cpu, "topology/physical_package_id")) < 0)
+      continue;
+    t = &topo_cpus[topo_nb_cpus++];
+    t->cpu = cpu;
+    t->package = i;
+    t->node = topo_read_node(cpu);
+    /* First CPU in the sibling list identifies the core/module */
+    if ((t->group = topo_read_int(cpu, "topology/thread_siblings_list")) < 0)
+      t->group = cpu;
+  }
+  if (topo_nb_cpus == 0) {
+    /* No sysfs: assume a flat machine */
+    j = sysconf(_SC_NPROCESSORS_ONLN);
+    for (cpu = 0; cpu < j && cpu < MAX_CPUS; cpu++) {
+      t = &topo_cpus[topo_nb_cpus++];
+      t->cpu = t->group = cpu;
+      t->package = t->node = 0;
+    }
+  }
+
+  /* Rank nodes within packages and groups within nodes */
+  qsort(topo_cpus, topo_nb_cpus, sizeof(cpu_topo_t), fc_cmp_compact);
+  for (i = 0; i < topo_nb_cpus; i++) {
+    t = &topo_cpus[i];
+    u = (i > 0 ? &topo_cpus[i - 1] : NULL);
+    if (u == NULL || u->package != t->package) {
+      t->node_rank = t->group_rank = 0;
+    } else if (u->node != t->node) {
+      t->node_rank = u->node_rank + 1;
+      t->group_rank = 0;
+    } else {
+      t->node_rank = u->node_rank;
+      t->group_rank = u->group_rank + (u->group != t->group);
+    }
+    t->smt_rank = (u != NULL && u->group == t->group ? u->smt_rank + 1 : 0);
+  }
+  return topo_nb_cpus;
+}
+
+/*
+ * Order CPUs according to a policy name or an explicit list of CPUs
+ * (e.g., "0,1,8,9"; unlisted CPUs follow in spread order).
+ */
+static int
+topo_order(const char *order)
+{
+  cpu_topo_t tmp;
+  const char *s;
+  char *end;
+  int i, j, n, cpu;
+
+  for (i = 0; fc_orders[i].name != NULL; i++) {
+    if (strcasecmp(fc_orders[i].name, order) == 0) {
+      qsort(topo_cpus, topo_nb_cpus, sizeof(cpu_topo_t), fc_orders[i].cmp);
+      return 1;
+    }
+  }
+
+  qsort(topo_cpus, topo_nb_cpus, sizeof(cpu_topo_t), fc_cmp_spread);
+  n = 0;
+  for (s = order; *s != '\0'; s = end) {
+    cpu = (int)strtol(s, &end, 10);
+    if (end == s)
+      return 0;
+    for (j = n; j < topo_nb_cpus; j++) {
+      if (topo_cpus[j].cpu == cpu) {
+        /* Move to front, keeping the order of the others */
+        tmp = topo_cpus[j];
+        memmove(&topo_cpus[n + 1], &topo_cpus[n], (j - n) * sizeof(cpu_topo_t));
+        topo_cpus[n++] = tmp;
+        break;
+      }
+    }
+    if (*end == ',')
+      end++;
+  }
+  return 1;
+}
+
+/*
+ * Place the application threads: thread i runs on the i-th CPU of the
+ * order (modulo the number of CPUs), so the fast cores are the CPUs of
+ * the first threads whatever the policy.
+ */
+static int
+topo_place(const char *policy)
+{
+  int i;
+
+  for (i = 0; pl_orders[i].name != NULL; i++) {
+    if (strcasecmp(pl_orders[i].name, policy) == 0) {
+      if (pl_orders[i].cmp != NULL)
+        qsort(topo_cpus, topo_nb_cpus, sizeof(cpu_topo_t), pl_orders[i].cmp);
+      topo_placement = pl_orders[i].name;
+      return 1;
+    }
+  }
+  return 0;
+}
+
+/*
+ * CPU of the i-th application thread (-1 if threads are not placed).
+ */
+static int
+topo_thread_cpu(long i)
+{
+  if (topo_placement == NULL || topo_nb_cpus == 0 || i < 0)
+    return -1;
+  return topo_cpus[i % topo_nb_cpus].cpu;
+}
+
+/*
+ * Republish the fast-core bitmap with the first n CPUs of the order.
+ */
+static void
+fast_cores_publish(unsigned int n)
+{
+  unsigned long bits[MAX_CPUS / FC_WORD_BITS];
+  int i, cpu;
+
+  memset(bits, 0, sizeof(bits));
+  for (i = 0; i < (int)n && i < topo_nb_cpus; i++) {
+    cpu = topo_cpus[i].cpu;
+    bits[cpu / FC_WORD_BITS] |= 1UL << (cpu % FC_WORD_BITS);
+  }
+  /* Readers may briefly see a mix of the old and new sets (harmless) */
+  for (i = 0; i < MAX_CPUS / FC_WORD_BITS; i++) {
+    if (fast_cores[i] != bits[i])
+      fast_cores[i] = bits[i];
+  }
+}
+
+/*
+ * Is the CPU currently a fast core?
+ */
+static INLINE int
+fast_core(int cpu)
+{
+  return (fast_cores[cpu / FC_WORD_BITS] >> (cpu % FC_WORD_BITS)) & 1;
+}
+
+#endif /* _TOPOLOGY_H_ */
@@ -0,0 +1,97 @@
+/*
+ * File:
+ *   trace.h
+ * Description:
+ *   Binary event trace of transactions, backoff, tuner and frequency.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation, version 2
+ * of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#ifndef _TRACE_H_
+#define _TRACE_H_
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include "stm_internal.h"
+#include "trace_format.h"
+
+/*
+ * The trace file is mapped once at stm_init with the size given by
+ * TRACE_SIZE (megabytes).  Threads write records directly into the
+ * chunks they claim, so recording costs a TSC read and a few stores;
+ * events are dropped once all chunks are claimed.  Pages never touched
+ * remain holes in the file.
+ */
+
+/*
+ * Map the trace file if TRACE_FILE is set.
+ */
+static void
+trace_open(void)
+{
+  trace_header_t *h;
+  size_t size;
+  char *s;
+  void *p;
+  int fd;
+
+  if ((s = getenv(TRACE_FILE)) == NULL)
+    return;
+  size = TRACE_SIZE_DEFAULT;
+  if (getenv(TRACE_SIZE) != NULL && atol(getenv(TRACE_SIZE)) > 0)
+    size = atol(getenv(TRACE_SIZE));
+  /* The header takes the first chunk */
+  size = ((size << 20) / TRACE_CHUNK_SIZE) * TRACE_CHUNK_SIZE;
+  if (size < 2 * TRACE_CHUNK_SIZE)
+    size = 2 * TRACE_CHUNK_SIZE;
+  if ((fd = open(s, O_RDWR | O_CREAT | O_TRUNC, 0644)) < 0 || ftruncate(fd, size) != 0) {
+    perror("trace file");
+    exit(1);
+  }
+  p = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+  if (p == MAP_FAILED) {
+    perror("trace mmap");
+    exit(1);
+  }
+  h = (trace_header_t *)p;
+  h->magic = TRACE_MAGIC;
+  h->version = TRACE_VERSION;
+  h->chunk_size = TRACE_CHUNK_SIZE;
+  h->nb_chunks = size / TRACE_CHUNK_SIZE - 1;
+  h->tsc_khz = 0;
+  _tinystm.trace_size = size;
+  _tinystm.trace_next = 0;
+  _tinystm.trace_threads = 0;
+  _tinystm.trace = h;
+  PRINT_DEBUG("\tTRACE_FILE=%s (%lu chunks)\n", s, (unsigned long)h->nb_chunks);
+}
+
+/*
+ * Record the TSC frequency and flush the trace.  The mapping is kept:
+ * monitoring threads may still be running.
+ */
+static void
+trace_close(void)
+{
+  trace_header_t *h = _tinystm.trace;
+
+  if (h == NULL)
+    return;
+  h->tsc_khz = tsc_khz;
+  msync(h, _tinystm.trace_size, MS_ASYNC);
+}
+
+#endif /* _TRACE_H_ */
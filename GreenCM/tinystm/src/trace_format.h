@@ -0,0 +1,89 @@
+/*
+ * File:
+ *   trace_format.h
+ * Description:
+ *   Layout of the binary transaction trace (see trace.h), shared with
+ *   the offline analyzer (scripts/trace_analyzer.cpp).
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation, version 2
+ * of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#ifndef _TRACE_FORMAT_H_
+#define _TRACE_FORMAT_H_
+
+#include <stdint.h>
+
+/*
+ * A trace file is a header followed by fixed-size chunks.  Each thread
+ * claims chunks one at a time and fills them with records in time
+ * order; chunks of different threads are interleaved in the file.
+ * Unclaimed chunks are left as holes (magic is 0).
+ */
+
+#define TRACE_MAGIC                     0x45434152544d5453ULL /* "STMTRACE" */
+#define TRACE_VERSION                   1
+#define TRACE_CHUNK_MAGIC               0x4b4e4843U         /* "CHNK" */
+#define TRACE_CHUNK_SIZE                (64 * 1024)
+#define TRACE_CHUNK_RECS                ((TRACE_CHUNK_SIZE - 16) / 16)
+
+enum {                                  /* Record types */
+  TR_THREAD = 1,                        /* Thread registered: a8 = kind, a16 = CPU */
+  TR_BEGIN,                             /* Transaction start: a16 = attribute id */
+  TR_COMMIT,                            /* Commit: a32 = aborts before commit */
+  TR_ABORT,                             /* Abort: a32 = reason (STM_ABORT_*) */
+  TR_BACKOFF_START,                     /* Backoff wait: a8 = mode, a32 = wait (spin iterations) */
+  TR_BACKOFF_END,                       /* End of backoff wait: a8 = mode */
+  TR_ADMIT,                             /* Parked at the admission gate: a32 = TSC ticks */
+  TR_TUNER,                             /* Tuner decision: a8 = parameter (tn_params index), a32 = value */
+  TR_SCORE,                             /* Tuner score of the last period: a32 = float bits */
+  TR_FREQ,                              /* Frequency sample: a8 = C0 %, a16 = CPU, a32 = MHz */
+  TR_ESCALATE,                          /* Restart in serial irrevocable mode: a16 = attribute id, a32 = aborts */
+  TR_QUEUE                              /* Retry queued behind a conflicting thread: a16 = attribute id, a32 = votes */
+};
+
+enum {                                  /* Thread kinds (TR_THREAD) */
+  TR_KIND_TX = 0,                       /* Transactional thread */
+  TR_KIND_TUNER,                        /* Online tuner */
+  TR_KIND_FREQ                          /* Frequency monitor */
+};
+
+enum {                                  /* Backoff modes (TR_BACKOFF_*) */
+  TR_WAIT_SPIN = 0,
+  TR_WAIT_SLEEP,
+  TR_WAIT_PARK
+};
+
+typedef struct trace_header {           /* File header */
+  uint64_t magic;
+  uint32_t version;
+  uint32_t chunk_size;
+  uint64_t nb_chunks;                   /* Chunks in the file */
+  uint64_t tsc_khz;                     /* TSC frequency (0 if unknown) */
+  uint64_t padding[4];
+} trace_header_t;
+
+typedef struct trace_rec {              /* Record (16 bytes) */
+  uint64_t tsc;                         /* Time-stamp counter */
+  uint8_t type;
+  uint8_t a8;
+  uint16_t a16;
+  uint32_t a32;
+} trace_rec_t;
+
+typedef struct trace_chunk {            /* Chunk of records of a thread */
+  uint32_t magic;
+  uint32_t thread;                      /* Thread number (from 1, in order of registration) */
+  uint32_t seq;                         /* Chunk number within the thread */
+  uint32_t count;                       /* Number of valid records */
+  trace_rec_t recs[TRACE_CHUNK_RECS];
+} trace_chunk_t;
+
+#endif /* _TRACE_FORMAT_H_ */
@@ -0,0 +1,835 @@
+/*
+ * File:
+ *   tuner.h
+ * Description:
+ *   Online tuner for the Green-CM backoff parameters.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation, version 2
+ * of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#ifndef _TUNER_H_
+#define _TUNER_H_
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "stm_internal.h"
+#include "topology.h"
+#include "dvfs.h"
+#include "stats_shm.h"
+#include "x86_energy.h"
+
+/*
+ * The tuner thread samples the commits and the energy of the process
+ * once per period, scores the sample with an objective, and lets an
+ * optimizer pick the next point of the parameter space.  All
+ * parameters are explored jointly, normalized to [0,1].
+ */
+
+#define TN_MAX_DIMS                     4
+#define TN_MAX_ARMS                     64
+#define TN_MIN_COMMITS                  30                  /* Ignore samples with fewer commits */
+#define TN_PERIOD_DEFAULT               100000              /* Sampling period (microseconds) */
+#define TN_RESTART                      50                  /* Periods before re-exploring a converged point */
+#define TN_DRIFT                        0.2                 /* Relative score drop signaling a phase change */
+#define TN_DISCOUNT                     0.99                /* Bandit: weight of past rewards per period */
+#define TN_EXPLORE                      0.2                 /* Bandit: exploration bonus */
+
+typedef struct tn_param {               /* Tunable parameter */
+  const char *name;
+  void (*bounds)(long *, long *);
+  long (*get)(void);
+  void (*set)(long);
+} tn_param_t;
+
+typedef struct tn_sample {              /* Measurement over one period */
+  double commits;
+  double seconds;
+  double joules;
+  double fast_khz;                      /* Effective frequency of fast cores (0 if unknown) */
+  double slow_khz;                      /* Effective frequency of the other cores (0 if unknown) */
+} tn_sample_t;
+
+typedef struct tn_objective {           /* Score to maximize (negative: unusable sample) */
+  const char *name;
+  double (*score)(const tn_sample_t *);
+} tn_objective_t;
+
+typedef struct tuner tuner_t;
+
+typedef struct tn_optimizer {           /* Search strategy */
+  const char *name;
+  void (*init)(tuner_t *);
+  void (*next)(tuner_t *, double);      /* Score of x; sets the next x */
+} tn_optimizer_t;
+
+struct tuner {
+  int d;                                /* Number of dimensions */
+  const tn_param_t *p[TN_MAX_DIMS];
+  long min[TN_MAX_DIMS];
+  long max[TN_MAX_DIMS];
+  double x[TN_MAX_DIMS];                /* Point being measured */
+  const tn_optimizer_t *opt;
+  const tn_objective_t *obj;
+  unsigned long seed;                   /* RNG seed */
+  int started;                          /* Has the current point a score? */
+  double cur;                           /* Score of the reference point */
+  double ref[TN_MAX_DIMS];              /* Reference point (best or current) */
+  /* Hill climbing */
+  double step[TN_MAX_DIMS];
+  int dir[TN_MAX_DIMS];
+  int dim;
+  int stable;                           /* Periods since convergence */
+  /* Simulated annealing */
+  double temp;
+  /* Nelder-Mead */
+  double v[TN_MAX_DIMS + 1][TN_MAX_DIMS];
+  double f[TN_MAX_DIMS + 1];
+  double xr[TN_MAX_DIMS];
+  double fr;
+  double c[TN_MAX_DIMS];
+  int state;
+  int idx;
+  /* Bandit */
+  int levels;
+  int nb_arms;
+  int arm;
+  int pulls[TN_MAX_ARMS];
+  double n[TN_MAX_ARMS];
+  double sum[TN_MAX_ARMS];
+  double top;                           /* Largest score seen (reward scale) */
+};
+
+static tuner_t tuner;
+#ifdef TM_TRACE
+static trace_buf_t tn_trace;
+#endif /* TM_TRACE */
+
+/* ################################################################### *
+ * PARAMETERS
+ * ################################################################### */
+
+static void
+tn_ferraris_bounds(long *min, long *max)
+{
+  *min = 0;
+  *max = max_ferraris;
+}
+
+static long
+tn_ferraris_get(void)
+{
+  return ferraris;
+}
+
+static void
+tn_ferraris_set(long v)
+{
+  ferraris = v;
+  fast_cores_publish(ferraris);
+  dvfs_update();
+}
+
+static void
+tn_threshold_bounds(long *min, long *max)
+{
+  *min = min_backoff_threshold;
+  *max = max_backoff_threshold;
+}
+
+static long
+tn_threshold_get(void)
+{
+  return thresh_index;
+}
+
+/* Only the threshold moves: spintosleep (and spin_tsc_mult) stay calibrated */
+static void
+tn_threshold_set(long v)
+{
+  thresh_index = v;
+  backoff_threshold = (unsigned long)backoff_thresholds[thresh_index] * (beta + 5);
+}
+
+static void
+tn_asym_bounds(long *min, long *max)
+{
+  *min = 1;
+  *max = 256;
+}
+
+static long
+tn_asym_get(void)
+{
+  return asym_threshold;
+}
+
+static void
+tn_asym_set(long v)
+{
+  asym_threshold = v;
+}
+
+/* Tuned as a power of two, above MIN_BACKOFF */
+static void
+tn_max_backoff_bounds(long *min, long *max)
+{
+  for (*min = 0; (1UL << *min) <= MIN_BACKOFF; (*min)++)
+    ;
+  for (*max = *min; (1UL << (*max + 1)) <= MAX_BACKOFF && (1UL << (*max + 1)) != 0; (*max)++)
+    ;
+}
+
+static long
+tn_max_backoff_get(void)
+{
+  long v = 0;
+
+  while ((1UL << (v + 1)) <= max_backoff)
+    v++;
+  return v;
+}
+
+static void
+tn_max_backoff_set(long v)
+{
+  max_backoff = 1UL << v;
+}
+
+/* Tuned as a power of two (starvation guard, see bo_starving) */
+static void
+tn_starve_bounds(long *min, long *max)
+{
+  *min = 1;
+  *max = 10;
+}
+
+static long
+tn_starve_get(void)
+{
+  long v = 0;
+
+  while ((1UL << (v + 1)) <= starve_threshold)
+    v++;
+  return v;
+}
+
+static void
+tn_starve_set(long v)
+{
+  starve_threshold = 1UL << v;
+}
+
+static const tn_param_t tn_params[] = {
+  { "ferraris", tn_ferraris_bounds, tn_ferraris_get, tn_ferraris_set },
+  { "threshold", tn_threshold_bounds, tn_threshold_get, tn_threshold_set },
+  { "asym_threshold", tn_asym_bounds, tn_asym_get, tn_asym_set },
+  { "max_backoff", tn_max_backoff_bounds, tn_max_backoff_get, tn_max_backoff_set },
+  { "starve_threshold", tn_starve_bounds, tn_starve_get, tn_starve_set },
+  { NULL, NULL, NULL, NULL }
+};
+
+/* ################################################################### *
+ * OBJECTIVES
+ * ################################################################### */
+
+static double
+tn_obj_throughput(const tn_sample_t *s)
+{
+  return s->commits / s->seconds;
+}
+
+static double
+tn_obj_energy(const tn_sample_t *s)
+{
+  return (s->joules > 0 ? s->commits / s->joules : -1);
+}
+
+/* Inverse of (energy per commit) * (time per commit) */
+static double
+tn_obj_edp(const tn_sample_t *s)
+{
+  return (s->joules > 0 ? s->commits * s->commits / (s->joules * s->seconds) : -1);
+}
+
+static double
+tn_obj_eddp(const tn_sample_t *s)
+{
+  return (s->joules > 0 ? s->commits * s->commits * s->commits / (s->joules * s->seconds * s->seconds) : -1);
+}
+
+static const tn_objective_t tn_objectives[] = {
+  { "throughput", tn_obj_throughput },
+  { "energy", tn_obj_energy },
+  { "edp", tn_obj_edp },
+  { "eddp", tn_obj_eddp },
+  { NULL, NULL }
+};
+
+/* ################################################################### *
+ * OPTIMIZERS
+ * ################################################################### */
+
+/*
+ * Uniform random number in [0,1).
+ */
+static double
+tn_rand(tuner_t *t)
+{
+  t->seed ^= (t->seed << 17);
+  t->seed ^= (t->seed >> 13);
+  t->seed ^= (t->seed << 5);
+  return (t->seed & 0xFFFFFF) / (double)0x1000000;
+}
+
+static double
+tn_clamp(double x)
+{
+  return (x < 0 ? 0 : (x > 1 ? 1 : x));
+}
+
+/*
+ * Smallest normalized move that changes the value of a dimension.
+ */
+static double
+tn_unit(tuner_t *t, int i)
+{
+  return (t->max[i] > t->min[i] ? 1.0 / (t->max[i] - t->min[i]) : 1);
+}
+
+/*
+ * Hill climbing: one dimension at a time, reverse and halve the step
+ * when the score drops; re-explore once converged if the score drifts.
+ */
+static void
+tn_hill_init(tuner_t *t)
+{
+  int i;
+
+  for (i = 0; i < t->d; i++) {
+    t->step[i] = 0.25;
+    t->dir[i] = 1;
+  }
+  t->dim = 0;
+  t->stable = 0;
+}
+
+static void
+tn_hill_next(tuner_t *t, double score)
+{
+  int i, moving;
+
+  if (t->stable > 0) {
+    /* Converged: re-explore after a phase change, or from time to time */
+    if (score < t->cur * (1 - TN_DRIFT) || t->stable > TN_RESTART) {
+      tn_hill_init(t);
+      t->cur = score;
+    }
+  } else if (!t->started || score >= t->cur) {
+    t->cur = score;
+    memcpy(t->ref, t->x, sizeof(t->x));
+  } else {
+    t->dir[t->dim] = -t->dir[t->dim];
+    t->step[t->dim] /= 2;
+  }
+  t->started = 1;
+
+  /* Next dimension that can still move */
+  moving = 0;
+  for (i = 0; i < t->d && !moving; i++) {
+    t->dim = (t->dim + 1) % t->d;
+    moving = (t->step[t->dim] >= tn_unit(t, t->dim));
+  }
+  memcpy(t->x, t->ref, sizeof(t->x));
+  if (!moving) {
+    t->stable++;
+    return;
+  }
+  t->stable = 0;
+  t->x[t->dim] = tn_clamp(t->ref[t->dim] + t->dir[t->dim] * t->step[t->dim]);
+  if (t->x[t->dim] == t->ref[t->dim]) {
+    /* On the boundary: go the other way */
+    t->dir[t->dim] = -t->dir[t->dim];
+    t->x[t->dim] = tn_clamp(t->ref[t->dim] + t->dir[t->dim] * t->step[t->dim]);
+  }
+}
+
+/*
+ * Simulated annealing: random neighbor within the temperature, accept
+ * worse points with decreasing probability; once cold, re-measure the
+ * reference from time to time and reheat after a phase change.
+ */
+static void
+tn_sa_init(tuner_t *t)
+{
+  t->temp = 1.0;
+}
+
+static void
+tn_sa_next(tuner_t *t, double score)
+{
+  double delta;
+  int i;
+
+  if (!t->started) {
+    t->cur = score;
+    memcpy(t->ref, t->x, sizeof(t->x));
+    t->started = 1;
+  } else if (memcmp(t->x, t->ref, sizeof(t->x)) == 0) {
+    if (score < t->cur * (1 - TN_DRIFT))
+      t->temp = 1.0;
+    t->cur = score;
+  } else {
+    delta = (score - t->cur) / (t->cur > 0 ? t->cur : 1);
+    if (delta >= 0 || tn_rand(t) < exp(delta / (0.1 * t->temp))) {
+      t->cur = score;
+      memcpy(t->ref, t->x, sizeof(t->x));
+    }
+  }
+  if (t->temp > 0.02)
+    t->temp *= 0.95;
+  if (t->temp <= 0.02 && tn_rand(t) < 0.1) {
+    memcpy(t->x, t->ref, sizeof(t->x));
+    return;
+  }
+  for (i = 0; i < t->d; i++)
+    t->x[i] = tn_clamp(t->ref[i] + (2 * tn_rand(t) - 1) * 0.5 * t->temp);
+}
+
+/*
+ * Nelder-Mead on -score, one vertex evaluation per period; restart
+ * around the best vertex when the simplex collapses.
+ */
+#define NM_INIT                         0
+#define NM_REFLECT                      1
+#define NM_EXPAND                       2
+#define NM_CONTRACT                     3
+#define NM_SHRINK                       4
+
+static void
+tn_nm_start(tuner_t *t, const double *x)
+{
+  int i;
+
+  memcpy(t->v[0], x, sizeof(t->x));
+  for (i = 1; i <= t->d; i++) {
+    memcpy(t->v[i], x, sizeof(t->x));
+    t->v[i][i - 1] = (x[i - 1] <= 0.75 ? x[i - 1] + 0.25 : x[i - 1] - 0.25);
+  }
+  t->state = NM_INIT;
+  t->idx = 0;
+  memcpy(t->x, t->v[0], sizeof(t->x));
+}
+
+static void
+tn_nm_init(tuner_t *t)
+{
+  tn_nm_start(t, t->x);
+}
+
+/*
+ * Sort vertices by value, then propose the reflection of the worst.
+ */
+static void
+tn_nm_reflect(tuner_t *t)
+{
+  double tmp[TN_MAX_DIMS], ft, size;
+  int i, j;
+
+  for (i = 1; i <= t->d; i++) {
+    memcpy(tmp, t->v[i], sizeof(tmp));
+    ft = t->f[i];
+    for (j = i; j > 0 && t->f[j - 1] > ft; j--) {
+      memcpy(t->v[j], t->v[j - 1], sizeof(tmp));
+      t->f[j] = t->f[j - 1];
+    }
+    memcpy(t->v[j], tmp, sizeof(tmp));
+    t->f[j] = ft;
+  }
+  memcpy(t->ref, t->v[0], sizeof(t->x));
+  t->cur = -t->f[0];
+
+  size = 0;
+  for (i = 1; i <= t->d; i++)
+    for (j = 0; j < t->d; j++)
+      size = fmax(size, fabs(t->v[i][j] - t->v[0][j]) / tn_unit(t, j));
+  if (size < 1) {
+    tn_nm_start(t, t->v[0]);
+    return;
+  }
+
+  for (j = 0; j < t->d; j++) {
+    t->c[j] = 0;
+    for (i = 0; i < t->d; i++)
+      t->c[j] += t->v[i][j] / t->d;
+    t->xr[j] = tn_clamp(2 * t->c[j] - t->v[t->d][j]);
+  }
+  memcpy(t->x, t->xr, sizeof(t->x));
+  t->state = NM_REFLECT;
+}
+
+static void
+tn_nm_next(tuner_t *t, double score)
+{
+  double fx = -score;
+  int i, j;
+
+  t->started = 1;
+  switch (t->state) {
+   case NM_INIT:
+   case NM_SHRINK:
+     t->f[t->idx++] = fx;
+     if (t->idx <= t->d) {
+       memcpy(t->x, t->v[t->idx], sizeof(t->x));
+       return;
+     }
+     break;
+   case NM_REFLECT:
+     t->fr = fx;
+     if (fx < t->f[0]) {
+       /* Expand */
+       for (j = 0; j < t->d; j++)
+         t->x[j] = tn_clamp(t->c[j] + 2 * (t->xr[j] - t->c[j]));
+       t->state = NM_EXPAND;
+       return;
+     }
+     if (fx < t->f[t->d - 1]) {
+       memcpy(t->v[t->d], t->xr, sizeof(t->x));
+       t->f[t->d] = fx;
+       break;
+     }
+     /* Contract (outside if the reflection improved on the worst) */
+     for (j = 0; j < t->d; j++)
+       t->x[j] = t->c[j] + 0.5 * ((fx < t->f[t->d] ? t->xr[j] : t->v[t->d][j]) - t->c[j]);
+     t->state = NM_CONTRACT;
+     return;
+   case NM_EXPAND:
+     if (fx < t->fr) {
+       memcpy(t->v[t->d], t->x, sizeof(t->x));
+       t->f[t->d] = fx;
+     } else {
+       memcpy(t->v[t->d], t->xr, sizeof(t->x));
+       t->f[t->d] = t->fr;
+     }
+     break;
+   case NM_CONTRACT:
+     if (fx < fmin(t->fr, t->f[t->d])) {
+       memcpy(t->v[t->d], t->x, sizeof(t->x));
+       t->f[t->d] = fx;
+       break;
+     }
+     /* Shrink towards the best vertex and re-evaluate */
+     for (i = 1; i <= t->d; i++)
+       for (j = 0; j < t->d; j++)
+         t->v[i][j] = t->v[0][j] + 0.5 * (t->v[i][j] - t->v[0][j]);
+     t->state = NM_SHRINK;
+     t->idx = 1;
+     memcpy(t->x, t->v[1], sizeof(t->x));
+     return;
+  }
+  tn_nm_reflect(t);
+}
+
+/*
+ * Multi-armed bandit: discounted UCB1 over a grid of the space (the
+ * discount forgets old rewards after a phase change).
+ */
+static void
+tn_bandit_arm(tuner_t *t, int arm)
+{
+  int i;
+
+  t->arm = arm;
+  for (i = 0; i < t->d; i++) {
+    t->x[i] = (arm % t->levels) / (double)(t->levels - 1);
+    arm /= t->levels;
+  }
+}
+
+static void
+tn_bandit_init(tuner_t *t)
+{
+  int i;
+
+  t->levels = (int)floor(pow(TN_MAX_ARMS, 1.0 / t->d) + 1e-9);
+  if (t->levels < 2)
+    t->levels = 2;
+  t->nb_arms = 1;
+  for (i = 0; i < t->d; i++)
+    t->nb_arms *= t->levels;
+  for (i = 0; i < t->nb_arms; i++) {
+    t->pulls[i] = 0;
+    t->n[i] = t->sum[i] = 0;
+  }
+  t->top = 0;
+  tn_bandit_arm(t, 0);
+}
+
+static void
+tn_bandit_next(tuner_t *t, double score)
+{
+  double total, ucb, best;
+  int i, arm;
+
+  t->started = 1;
+  if (score > t->top)
+    t->top = score;
+  total = 0;
+  for (i = 0; i < t->nb_arms; i++) {
+    t->n[i] *= TN_DISCOUNT;
+    t->sum[i] *= TN_DISCOUNT;
+    total += t->n[i];
+  }
+  t->pulls[t->arm]++;
+  t->n[t->arm] += 1;
+  t->sum[t->arm] += (t->top > 0 ? score / t->top : 0);
+  total += 1;
+
+  arm = 0;
+  best = -1;
+  for (i = 0; i < t->nb_arms; i++) {
+    if (t->pulls[i] == 0) {
+      arm = i;
+      break;
+    }
+    ucb = t->sum[i] / t->n[i] + TN_EXPLORE * sqrt(log(total) / t->n[i]);
+    if (ucb > best) {
+      best = ucb;
+      arm = i;
+    }
+  }
+  tn_bandit_arm(t, arm);
+}
+
+static const tn_optimizer_t tn_optimizers[] = {
+  { "hill", tn_hill_init, tn_hill_next },
+  { "sa", tn_sa_init, tn_sa_next },
+  { "nm", tn_nm_init, tn_nm_next },
+  { "bandit", tn_bandit_init, tn_bandit_next },
+  { NULL, NULL, NULL }
+};
+
+/* ################################################################### *
+ * TUNER THREAD
+ * ################################################################### */
+
+/*
+ * Set the parameters to the current point.
+ */
+static void
+tn_apply(tuner_t *t)
+{
+  long v;
+  int i;
+
+  for (i = 0; i < t->d; i++) {
+    v = t->min[i] + lround(t->x[i] * (t->max[i] - t->min[i]));
+    if (v != t->p[i]->get())
+      t->p[i]->set(v);
+  }
+  stats_shm_publish();
+}
+
+/*
+ * Average power of all packages since the previous call.
+ */
+static double
+tn_power(void)
+{
+  double power = 0;
+  int j;
+
+  for (j = 0; j < nr_packages; j++)
+    power += source->get_power(j);
+  return power;
+}
+
+/*
+ * Average effective frequency of the fast and other cores running
+ * threads, from the last telemetry snapshot.
+ */
+static void
+tn_freq(tn_sample_t *s)
+{
+  freq_sample_t f;
+  double sum[2] = { 0, 0 };
+  int n[2] = { 0, 0 }, cpu, fast;
+
+  for (cpu = 0; cpu < MAX_CPUS; cpu++) {
+    if (thread_status[cpu] != 1 || !freq_read(cpu, &f))
+      continue;
+    fast = fast_core(cpu);
+    sum[fast] += f.khz;
+    n[fast]++;
+  }
+  s->slow_khz = (n[0] > 0 ? sum[0] / n[0] : 0);
+  s->fast_khz = (n[1] > 0 ? sum[1] / n[1] : 0);
+}
+
+static double
+tn_now(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void *
+tuner_proc(void *arg)
+{
+  tuner_t *t = (tuner_t *)arg;
+  struct timespec period;
+  stm_counters_t counters;
+  unsigned long prev;
+  double now, last, score;
+  tn_sample_t s;
+  char *e;
+  long usec;
+  int i;
+
+  usec = ((e = getenv(TUNER_PERIOD)) != NULL ? atol(e) : TN_PERIOD_DEFAULT);
+  if (usec <= 0)
+    usec = TN_PERIOD_DEFAULT;
+  period.tv_sec = usec / 1000000;
+  period.tv_nsec = (usec % 1000000) * 1000;
+
+#ifdef TM_TRACE
+  trace_thread(&tn_trace, TR_KIND_TUNER, 0xffff);
+#endif /* TM_TRACE */
+  stm_get_counters(&counters);
+  prev = counters.commits;
+  last = tn_now();
+  tn_power();
+  while (running) {
+    nanosleep(&period, NULL);
+    if (!running)
+      break;
+    stm_get_counters(&counters);
+    now = tn_now();
+    s.commits = counters.commits - prev;
+    s.seconds = now - last;
+    s.joules = tn_power() * s.seconds;
+    tn_freq(&s);
+    prev = counters.commits;
+    last = now;
+    /* Too few commits to tell points apart: measure the same point again */
+    if (s.commits < TN_MIN_COMMITS || s.seconds <= 0)
+      continue;
+    if ((score = t->obj->score(&s)) < 0)
+      continue;
+    t->opt->next(t, score);
+    tn_apply(t);
+#ifdef TM_TRACE
+    {
+      float f = (float)score;
+      uint32_t bits;
+
+      memcpy(&bits, &f, sizeof(bits));
+      trace_event(&tn_trace, TR_SCORE, 0, 0, bits);
+      for (i = 0; i < t->d; i++)
+        trace_event(&tn_trace, TR_TUNER, (int)(t->p[i] - tn_params), 0, (uint32_t)t->p[i]->get());
+    }
+#endif /* TM_TRACE */
+    PRINT_DEBUG("==> tuner: score=%f commits=%.0f power=%f fast=%.0fkHz slow=%.0fkHz", score, s.commits,
+                s.joules / s.seconds, s.fast_khz, s.slow_khz);
+    for (i = 0; i < t->d; i++) {
+      PRINT_DEBUG(" %s=%ld", t->p[i]->name, t->p[i]->get());
+    }
+    PRINT_DEBUG("\n");
+  }
+  return NULL;
+}
+
+/*
+ * Look up an entry of a table of structures starting with a name.
+ */
+static const void *
+tn_lookup(const void *table, size_t size, const char *name)
+{
+  const char *e;
+
+  for (e = (const char *)table; *(const char **)e != NULL; e += size) {
+    if (strcasecmp(*(const char **)e, name) == 0)
+      return e;
+  }
+  fprintf(stderr, "Error: unknown tuner setting %s\n", name);
+  exit(1);
+}
+
+/*
+ * Start the tuner on a comma-separated list of parameters (the
+ * environment overrides the parameters, optimizer and objective).  At
+ * most one tuner runs at a time.
+ */
+static void
+tuner_start(const char *params)
+{
+  static volatile stm_word_t started = 0;
+  tuner_t *t = &tuner;
+  const char *s;
+  char name[32];
+  pthread_t thread;
+  size_t len;
+  long v;
+  int i;
+
+  if (ATOMIC_CAS_FULL(&started, 0, 1) == 0)
+    return;
+
+  if ((s = getenv(TUNER_PARAMS)) != NULL)
+    params = s;
+  t->d = 0;
+  for (s = params; *s != '\0'; s += len) {
+    if (*s == ',')
+      s++;
+    len = strcspn(s, ",");
+    if (len == 0 || len >= sizeof(name))
+      continue;
+    memcpy(name, s, len);
+    name[len] = '\0';
+    if (t->d == TN_MAX_DIMS) {
+      fprintf(stderr, "Error: too many tuner parameters\n");
+      exit(1);
+    }
+    t->p[t->d++] = tn_lookup(tn_params, sizeof(tn_param_t), name);
+  }
+  if ((s = getenv(TUNER_OPTIMIZER)) == NULL)
+    s = "hill";
+  t->opt = tn_lookup(tn_optimizers, sizeof(tn_optimizer_t), s);
+  if ((s = getenv(TUNER_OBJECTIVE)) == NULL)
+    s = "energy";
+  t->obj = tn_lookup(tn_objectives, sizeof(tn_objective_t), s);
+  if (t->d == 0)
+    return;
+
+  /* Start from the current values */
+  for (i = 0; i < t->d; i++) {
+    t->p[i]->bounds(&t->min[i], &t->max[i]);
+    v = t->p[i]->get();
+    v = (v < t->min[i] ? t->min[i] : (v > t->max[i] ? t->max[i] : v));
+    t->x[i] = (t->max[i] > t->min[i] ? (v - t->min[i]) / (double)(t->max[i] - t->min[i]) : 0);
+  }
+  t->seed = 123456789UL;
+  t->started = 0;
+  t->cur = 0;
+  t->opt->init(t);
+  tn_apply(t);
+  PRINT_DEBUG("\tTUNER=%s/%s (%d parameters)\n", t->opt->name, t->obj->name, t->d);
+
+  pthread_create(&thread, NULL, tuner_proc, t);
+}
+
+#endif /* _TUNER_H_ */
@@ -0,0 +1,202 @@
+/*
+ * File:
+ *   validate.h
+ * Description:
+ *   Read set validation kernels and commit ring (incremental validation).
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation, version 2
+ * of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#ifndef _VALIDATE_H_
+#define _VALIDATE_H_
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__x86_64__) && defined(__GNUC__)
+# define RS_SIMD
+# include <immintrin.h>
+#endif /* defined(__x86_64__) && defined(__GNUC__) */
+
+#include "stm_internal.h"
+
+/*
+ * The validation functions of the designs skip the entries whose lock
+ * is free and still has the version read with _tinystm.rs_scan, which
+ * returns the first entry (from i) that needs a closer look.  The
+ * kernel is selected at stm_init according to the CPU (or the
+ * VALIDATE_KERNEL environment variable): the vector kernels gather the
+ * locks of 4 or 8 entries and compare them to the versions without a
+ * branch per entry.
+ */
+
+static unsigned int
+rs_scan_scalar(volatile stm_word_t **locks, const stm_word_t *versions, unsigned int i, unsigned int n)
+{
+  stm_word_t l;
+
+  for (; i < n; i++) {
+    l = ATOMIC_LOAD(locks[i]);
+    if (LOCK_GET_OWNED(l) || LOCK_GET_TIMESTAMP(l) != versions[i])
+      break;
+  }
+  return i;
+}
+
+#ifdef RS_SIMD
+__attribute__((target("avx2"))) static unsigned int
+rs_scan_avx2(volatile stm_word_t **locks, const stm_word_t *versions, unsigned int i, unsigned int n)
+{
+  const __m256i owned = _mm256_set1_epi64x(OWNED_MASK);
+  __m256i l, d;
+
+  for (; i + 4 <= n; i += 4) {
+    l = _mm256_i64gather_epi64((const long long *)0, _mm256_loadu_si256((const __m256i *)(locks + i)), 1);
+    d = _mm256_xor_si256(_mm256_srli_epi64(l, LOCK_BITS), _mm256_loadu_si256((const __m256i *)(versions + i)));
+    d = _mm256_or_si256(d, _mm256_and_si256(l, owned));
+    if (!_mm256_testz_si256(d, d))
+      break;
+  }
+  /* Remaining entries, or find the one that failed */
+  return rs_scan_scalar(locks, versions, i, n);
+}
+
+__attribute__((target("avx512f"))) static unsigned int
+rs_scan_avx512(volatile stm_word_t **locks, const stm_word_t *versions, unsigned int i, unsigned int n)
+{
+  const __m512i owned = _mm512_set1_epi64(OWNED_MASK);
+  __m512i l, d;
+
+  for (; i + 8 <= n; i += 8) {
+    l = _mm512_i64gather_epi64(_mm512_loadu_si512((const void *)(locks + i)), (const void *)0, 1);
+    d = _mm512_xor_si512(_mm512_srli_epi64(l, LOCK_BITS), _mm512_loadu_si512((const void *)(versions + i)));
+    d = _mm512_or_si512(d, _mm512_and_si512(l, owned));
+    if (_mm512_test_epi64_mask(d, d) != 0)
+      break;
+  }
+  return rs_scan_scalar(locks, versions, i, n);
+}
+#endif /* RS_SIMD */
+
+/*
+ * Select the validation kernel.
+ */
+static void
+rs_scan_init(void)
+{
+  static const char *names[] = { "scalar", "avx2", "avx512" };
+  static rs_scan_fn_t kernels[] = {
+    rs_scan_scalar,
+#ifdef RS_SIMD
+    rs_scan_avx2,
+    rs_scan_avx512
+#endif /* RS_SIMD */
+  };
+  const unsigned int nb = sizeof(kernels) / sizeof(kernels[0]);
+  char *s;
+  unsigned int k;
+
+  k = 0;
+#ifdef RS_SIMD
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx512f"))
+    k = 2;
+  else if (__builtin_cpu_supports("avx2"))
+    k = 1;
+#endif /* RS_SIMD */
+  if ((s = getenv(VALIDATE_KERNEL)) != NULL) {
+    for (k = 0; k < nb; k++) {
+      if (strcmp(s, names[k]) == 0)
+        break;
+    }
+    if (k == nb) {
+      fprintf(stderr, "Error: validation kernel %s not available\n", s);
+      exit(1);
+    }
+  }
+  _tinystm.rs_scan = kernels[k];
+  _tinystm.rs_scan_name = names[k];
+  PRINT_DEBUG("\tVALIDATE_KERNEL=%s\n", names[k]);
+}
+
+#ifdef INCREMENTAL_VALIDATION
+/*
+ * Each update transaction records the locks it wrote in the slot of
+ * its commit timestamp before releasing them.  Extending the snapshot
+ * from end to now (or committing at now + 1) needs no validation if
+ * the slots of all timestamps in (end, now] are present and none of
+ * their locks is in the read set.  A timestamp without its slot (the
+ * slot was overwritten or is being written, or the clock was advanced
+ * without a commit) leads to a full validation.
+ */
+
+/*
+ * Record the locks written with a commit timestamp.
+ */
+static INLINE void
+commit_ring_publish(stm_tx_t *tx, stm_word_t t)
+{
+  cr_record_t *c = &_tinystm.commit_ring[t & (COMMIT_RING_SIZE - 1)];
+  stm_word_t old = ATOMIC_LOAD(&c->ts);
+  unsigned int i, n;
+
+  /* Leave the slot to a concurrent or newer committer */
+  if ((old & 1) != 0 || old > 2 * t || ATOMIC_CAS_FULL(&c->ts, old, 2 * t + 1) == 0)
+    return;
+  n = tx->w_set.nb_entries;
+  if (n > COMMIT_RING_LOCKS) {
+    n = COMMIT_RING_LOCKS + 1;
+  } else {
+    for (i = 0; i < n; i++)
+      c->locks[i] = tx->w_set.entries[i].lock;
+  }
+  c->nb = n;
+  ATOMIC_STORE_REL(&c->ts, 2 * t);
+}
+
+/*
+ * Check that no commit with a timestamp in (from, to] wrote a lock of
+ * the read set.
+ */
+static INLINE int
+commit_ring_check(stm_tx_t *tx, stm_word_t from, stm_word_t to)
+{
+  volatile stm_word_t *locks[COMMIT_RING_LOCKS];
+  cr_record_t *c;
+  stm_word_t t;
+  unsigned int i, n;
+
+  /* Only worth it if there are fewer locks to look up than entries to validate */
+  if (tx->r_set.nb_entries < SET_INDEX_THRESHOLD || to - from >= COMMIT_RING_SIZE
+      || (to - from) * COMMIT_RING_LOCKS >= tx->r_set.nb_entries)
+    return 0;
+  stm_index_rs(tx);
+  for (t = from + 1; t <= to; t++) {
+    c = &_tinystm.commit_ring[t & (COMMIT_RING_SIZE - 1)];
+    if (ATOMIC_LOAD_ACQ(&c->ts) != 2 * t)
+      return 0;
+    n = c->nb;
+    for (i = 0; i < n && i < COMMIT_RING_LOCKS; i++)
+      locks[i] = c->locks[i];
+    ATOMIC_MB_READ;
+    if (ATOMIC_LOAD(&c->ts) != 2 * t || n > COMMIT_RING_LOCKS)
+      return 0;
+    for (i = 0; i < n; i++) {
+      if (set_index_find(&tx->r_set.index, (stm_word_t)locks[i]) >= 0)
+        return 0;
+    }
+  }
+  return 1;
+}
+#endif /* INCREMENTAL_VALIDATION */
+
+#endif /* _VALIDATE_H_ */
@@ -0,0 +1,279 @@
+/*
+ * File:
+ *   admission.c
+ * Description:
+ *   Regression test for the admission gate: every way out of a
+ *   transaction (commit, explicit abort, abort without retry, serial
+ *   irrevocable commit, thread exit) must give its slot back, otherwise
+ *   the threads parked at the gate never run again.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation, version 2
+ * of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#ifdef NDEBUG
+# undef NDEBUG
+#endif
+
+#include <assert.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "stm.h"
+#include "wrappers.h"
+
+#define DEFAULT_DURATION                2000
+#define DEFAULT_NB_THREADS              8
+#define DEFAULT_TARGET                  "0.001"
+
+#define NB_ACCOUNTS                     4
+#define INITIAL_BALANCE                 1000
+
+#define XSTR(s)                         STR(s)
+#define STR(s)                          #s
+
+static volatile int stop;
+
+long accounts[NB_ACCOUNTS];
+
+typedef struct thread_data {
+  unsigned long nb_commits;
+  unsigned long nb_explicit;
+  unsigned long nb_no_retry;
+  unsigned long nb_irrevocable;
+  unsigned long nb_aborts;
+  unsigned int seed;
+  int round;                            /* Stop after this round */
+  char padding[64];
+} thread_data_t;
+
+static void *test(void *v)
+{
+  int i, j, op, path;
+  volatile int tries;
+  long l;
+  sigjmp_buf *e;
+  thread_data_t *d = (thread_data_t *)v;
+
+  stm_init_thread();
+  while (stop <= d->round) {
+    op = rand_r(&d->seed) % 100;
+    i = rand_r(&d->seed) % NB_ACCOUNTS;
+    j = rand_r(&d->seed) % NB_ACCOUNTS;
+    tries = 0;
+    e = stm_start((stm_tx_attr_t)0);
+    path = sigsetjmp(*e, 0);
+    tries++;
+    if (path & STM_PATH_UNINSTRUMENTED) {
+      /* Serial irrevocable: no other transaction runs */
+      for (i = 0, l = 0; i < NB_ACCOUNTS; i++)
+        l += accounts[i];
+      assert(l == NB_ACCOUNTS * INITIAL_BALANCE);
+      stm_commit();
+      d->nb_irrevocable++;
+      continue;
+    }
+    stm_store_long(&accounts[i], stm_load_long(&accounts[i]) - 1);
+    stm_store_long(&accounts[j], stm_load_long(&accounts[j]) + 1);
+    if (op < 10 && tries == 1) {
+      /* Retried, the slot is kept across attempts */
+      d->nb_explicit++;
+      stm_abort(0);
+    }
+    if (op >= 10 && op < 20) {
+      /* Not retried, the slot must be given back */
+      stm_abort(STM_ABORT_NO_RETRY);
+      d->nb_no_retry++;
+      continue;
+    }
+    if (op >= 20 && op < 25) {
+      if (!stm_set_irrevocable(1)) {
+        fprintf(stderr, "ERROR: cannot enter irrevocable mode\n");
+        exit(1);
+      }
+    }
+    stm_commit();
+    d->nb_commits++;
+  }
+  stm_get_stats("nb_aborts", &d->nb_aborts);
+  stm_exit_thread();
+
+  return NULL;
+}
+
+static void timed_out(int sig)
+{
+  fprintf(stderr, "ERROR: threads stuck at the admission gate\n");
+  _exit(1);
+}
+
+int main(int argc, char **argv)
+{
+  struct option long_options[] = {
+    // These options don't set a flag
+    {"help",                      no_argument,       NULL, 'h'},
+    {"duration",                  required_argument, NULL, 'd'},
+    {"num-threads",               required_argument, NULL, 'n'},
+    {"target",                    required_argument, NULL, 't'},
+    {NULL, 0, NULL, 0}
+  };
+
+  int i, c;
+  long l;
+  unsigned long commits, aborts;
+  thread_data_t *td;
+  pthread_t *threads;
+  pthread_attr_t attr;
+  struct timespec timeout;
+  int duration = DEFAULT_DURATION;
+  int nb_threads = DEFAULT_NB_THREADS;
+  char *target = DEFAULT_TARGET;
+
+  while(1) {
+    i = 0;
+    c = getopt_long(argc, argv, "hd:n:t:", long_options, &i);
+
+    if(c == -1)
+      break;
+
+    if(c == 0 && long_options[i].flag == 0)
+      c = long_options[i].val;
+
+    switch(c) {
+     case 0:
+       /* Flag is automatically set */
+       break;
+     case 'h':
+       printf("admission -- admission gate regression test "
+              "\n"
+              "Usage:\n"
+              "  admission [options...]\n"
+              "\n"
+              "Options:\n"
+              "  -h, --help\n"
+              "        Print this message\n"
+              "  -d, --duration <int>\n"
+              "        Test duration in milliseconds (default=" XSTR(DEFAULT_DURATION) ")\n"
+              "  -n, --num-threads <int>\n"
+              "        Number of threads (default=" XSTR(DEFAULT_NB_THREADS) ")\n"
+              "  -t, --target <double>\n"
+              "        Target abort ratio (default=" DEFAULT_TARGET ")\n"
+         );
+       exit(0);
+     case 'd':
+       duration = atoi(optarg);
+       break;
+     case 'n':
+       nb_threads = atoi(optarg);
+       break;
+     case 't':
+       target = optarg;
+       break;
+     case '?':
+       printf("Use -h or --help for help\n");
+       exit(0);
+     default:
+       exit(1);
+    }
+  }
+
+  assert(duration > 0);
+  assert(nb_threads > 1);
+
+  printf("Duration     : %d\n", duration);
+  printf("Nb threads   : %d\n", nb_threads);
+  printf("Target       : %s\n", target);
+
+  for (i = 0; i < NB_ACCOUNTS; i++)
+    accounts[i] = INITIAL_BALANCE;
+
+  /* The gate only closes if the controller runs, and must close often */
+  setenv("ADMISSION", target, 1);
+  setenv("ADMISSION_PERIOD", "1000", 1);
+  stm_init();
+
+  /* A lost slot blocks the threads at the gate (the timeout is 1 ms) */
+  signal(SIGALRM, timed_out);
+  alarm(duration / 1000 + 30);
+
+  if ((td = (thread_data_t *)calloc(nb_threads, sizeof(thread_data_t))) == NULL) {
+    perror("malloc");
+    exit(1);
+  }
+  if ((threads = (pthread_t *)malloc(nb_threads * sizeof(pthread_t))) == NULL) {
+    perror("malloc");
+    exit(1);
+  }
+  stop = 0;
+  pthread_attr_init(&attr);
+  pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_JOINABLE);
+  for (i = 0; i < nb_threads; i++) {
+    td[i].seed = (unsigned int)time(NULL) + i;
+    /* Half of the threads leave early, while the others keep running */
+    td[i].round = i & 1;
+    if (pthread_create(&threads[i], &attr, test, (void *)(&td[i])) != 0) {
+      fprintf(stderr, "Error creating thread\n");
+      exit(1);
+    }
+  }
+  pthread_attr_destroy(&attr);
+
+  timeout.tv_sec = duration / 2000;
+  timeout.tv_nsec = (duration / 2 % 1000) * 1000000;
+  nanosleep(&timeout, NULL);
+  stop = 1;
+  for (i = 0; i < nb_threads; i += 2) {
+    if (pthread_join(threads[i], NULL) != 0) {
+      fprintf(stderr, "Error waiting for thread completion\n");
+      exit(1);
+    }
+  }
+  nanosleep(&timeout, NULL);
+  printf("STOPPING...\n");
+  stop = 2;
+  for (i = 1; i < nb_threads; i += 2) {
+    if (pthread_join(threads[i], NULL) != 0) {
+      fprintf(stderr, "Error waiting for thread completion\n");
+      exit(1);
+    }
+  }
+  alarm(0);
+
+  for (i = 0, l = 0; i < NB_ACCOUNTS; i++)
+    l += accounts[i];
+  assert(l == NB_ACCOUNTS * INITIAL_BALANCE);
+
+  commits = aborts = 0;
+  for (i = 0; i < nb_threads; i++) {
+    printf("Thread %d\n", i);
+    printf("  #commits    : %lu\n", td[i].nb_commits);
+    printf("  #explicit   : %lu\n", td[i].nb_explicit);
+    printf("  #no-retry   : %lu\n", td[i].nb_no_retry);
+    printf("  #serial     : %lu\n", td[i].nb_irrevocable);
+    printf("  #aborts     : %lu\n", td[i].nb_aborts);
+    /* Every thread got through the gate */
+    assert(td[i].nb_commits > 0);
+    commits += td[i].nb_commits;
+    aborts += td[i].nb_aborts;
+  }
+  printf("#commits      : %lu\n", commits);
+  printf("#aborts       : %lu\n", aborts);
+  printf("PASSED\n");
+
+  /* Cleanup STM */
+  stm_exit();
+
+  return 0;
+}
@@ -0,0 +1,260 @@
+/*
+ * File:
+ *   setindex.c
+ * Description:
+ *   Regression test for the read and write set indexes: transactions
+ *   whose sets are below, at and well beyond SET_INDEX_THRESHOLD (the
+ *   index then grows several times) must see their own writes and never
+ *   the writes of a previous attempt (write set index, WRITE_BACK_CTL),
+ *   and concurrent updates with large read sets must stay consistent.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation, version 2
+ * of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#ifdef NDEBUG
+# undef NDEBUG
+#endif
+
+#include <assert.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "stm.h"
+#include "wrappers.h"
+
+#define DEFAULT_DURATION                2000
+#define DEFAULT_NB_THREADS              4
+
+#define NB_ELEMENTS                     4096
+#define MAX_READS                       1024
+
+#define XSTR(s)                         STR(s)
+#define STR(s)                          #s
+
+static volatile int stop;
+
+long data[NB_ELEMENTS];
+
+/* Set sizes around the threshold (32) and the index resizes */
+static const int sizes[] = { 1, 8, 31, 32, 33, 64, 65, 127, 128, 129, 300, 1000, 2048 };
+
+/*
+ * Write n elements, overwrite every other one, then read back the
+ * written elements and the ones after them.
+ */
+static void test_own_writes(int n, long round)
+{
+  int i;
+  sigjmp_buf *e;
+
+  e = stm_start((stm_tx_attr_t)0);
+  sigsetjmp(*e, 0);
+  for (i = 0; i < n; i++)
+    stm_store_long(&data[i], round + i);
+  for (i = 0; i < n; i += 2)
+    stm_store_long(&data[i], round - i);
+  for (i = 0; i < n; i++)
+    assert(stm_load_long(&data[i]) == ((i & 1) ? round + i : round - i));
+  for (i = n; i < n + 16 && i < NB_ELEMENTS; i++)
+    assert(stm_load_long(&data[i]) == data[i]);
+  stm_commit();
+  for (i = 0; i < n; i++)
+    assert(data[i] == ((i & 1) ? round + i : round - i));
+}
+
+/*
+ * The first attempt writes n elements, the second only the odd ones:
+ * the even ones must then be read from memory, not from the index of
+ * the aborted attempt.
+ */
+static void test_retry(int n, long round)
+{
+  int i;
+  volatile int tries = 0;
+  sigjmp_buf *e;
+
+  for (i = 0; i < n; i++)
+    data[i] = -i;
+  e = stm_start((stm_tx_attr_t)0);
+  sigsetjmp(*e, 0);
+  tries++;
+  for (i = (tries == 1 ? 0 : 1); i < n; i += (tries == 1 ? 1 : 2))
+    stm_store_long(&data[i], round + i);
+  for (i = 0; i < n; i++)
+    assert(stm_load_long(&data[i]) == ((i & 1) || tries == 1 ? round + i : -i));
+  if (tries == 1)
+    stm_abort(0);
+  stm_commit();
+  assert(tries == 2);
+  for (i = 0; i < n; i++)
+    assert(data[i] == ((i & 1) ? round + i : -i));
+}
+
+/*
+ * Move one unit between two elements chosen among many read ones (the
+ * read set index is looked up when a write finds a newer version).
+ */
+static void *test(void *v)
+{
+  unsigned int seed;
+  int i, n, first, src, dst;
+  long s, d;
+  sigjmp_buf *e;
+
+  seed = (unsigned int)(unsigned long)v;
+  stm_init_thread();
+  while (stop == 0) {
+    n = 1 + rand_r(&seed) % MAX_READS;
+    first = rand_r(&seed) % (NB_ELEMENTS - n + 1);
+    src = first + rand_r(&seed) % n;
+    dst = first + rand_r(&seed) % n;
+    e = stm_start((stm_tx_attr_t)0);
+    sigsetjmp(*e, 0);
+    for (i = first; i < first + n; i++)
+      stm_load_long(&data[i]);
+    s = stm_load_long(&data[src]);
+    d = stm_load_long(&data[dst]);
+    stm_store_long(&data[src], s - 1);
+    if (dst != src)
+      stm_store_long(&data[dst], d + 1);
+    else
+      stm_store_long(&data[dst], s);
+    stm_commit();
+  }
+  stm_exit_thread();
+
+  return NULL;
+}
+
+int main(int argc, char **argv)
+{
+  struct option long_options[] = {
+    // These options don't set a flag
+    {"help",                      no_argument,       NULL, 'h'},
+    {"duration",                  required_argument, NULL, 'd'},
+    {"num-threads",               required_argument, NULL, 'n'},
+    {NULL, 0, NULL, 0}
+  };
+
+  int i, j, c;
+  long l;
+  pthread_t *threads;
+  pthread_attr_t attr;
+  struct timespec timeout;
+  int duration = DEFAULT_DURATION;
+  int nb_threads = DEFAULT_NB_THREADS;
+
+  while(1) {
+    i = 0;
+    c = getopt_long(argc, argv, "hd:n:", long_options, &i);
+
+    if(c == -1)
+      break;
+
+    if(c == 0 && long_options[i].flag == 0)
+      c = long_options[i].val;
+
+    switch(c) {
+     case 0:
+       /* Flag is automatically set */
+       break;
+     case 'h':
+       printf("setindex -- read/write set index regression test "
+              "\n"
+              "Usage:\n"
+              "  setindex [options...]\n"
+              "\n"
+              "Options:\n"
+              "  -h, --help\n"
+              "        Print this message\n"
+              "  -d, --duration <int>\n"
+              "        Duration of the concurrent test in milliseconds (default=" XSTR(DEFAULT_DURATION) ")\n"
+              "  -n, --num-threads <int>\n"
+              "        Number of threads (default=" XSTR(DEFAULT_NB_THREADS) ")\n"
+         );
+       exit(0);
+     case 'd':
+       duration = atoi(optarg);
+       break;
+     case 'n':
+       nb_threads = atoi(optarg);
+       break;
+     case '?':
+       printf("Use -h or --help for help\n");
+       exit(0);
+     default:
+       exit(1);
+    }
+  }
+
+  assert(duration >= 0);
+  assert(nb_threads > 0);
+
+  /* Init STM */
+  printf("Initializing STM\n");
+  stm_init();
+  stm_init_thread();
+
+  printf("TESTING OWN WRITES...\n");
+  for (j = 0; j < 4; j++) {
+    /* Growing, then shrinking sets reuse the index of the thread */
+    for (i = 0; i < (int)(sizeof(sizes) / sizeof(sizes[0])); i++)
+      test_own_writes((j & 1) ? sizes[sizeof(sizes) / sizeof(sizes[0]) - 1 - i] : sizes[i], j * 10000 + i);
+  }
+
+  printf("TESTING RETRIES...\n");
+  for (i = 0; i < (int)(sizeof(sizes) / sizeof(sizes[0])); i++)
+    test_retry(sizes[i], 100000 + i);
+
+  stm_exit_thread();
+
+  printf("TESTING CONCURRENT UPDATES...\n");
+  for (i = 0; i < NB_ELEMENTS; i++)
+    data[i] = 0;
+  stop = 0;
+  timeout.tv_sec = duration / 1000;
+  timeout.tv_nsec = (duration % 1000) * 1000000;
+  if ((threads = (pthread_t *)malloc(nb_threads * sizeof(pthread_t))) == NULL) {
+    perror("malloc");
+    exit(1);
+  }
+  pthread_attr_init(&attr);
+  pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_JOINABLE);
+  for (i = 0; i < nb_threads; i++) {
+    if (pthread_create(&threads[i], &attr, test, (void *)(unsigned long)(time(NULL) + i)) != 0) {
+      fprintf(stderr, "Error creating thread\n");
+      exit(1);
+    }
+  }
+  pthread_attr_destroy(&attr);
+  nanosleep(&timeout, NULL);
+  printf("STOPPING...\n");
+  stop = 1;
+  for (i = 0; i < nb_threads; i++) {
+    if (pthread_join(threads[i], NULL) != 0) {
+      fprintf(stderr, "Error waiting for thread completion\n");
+      exit(1);
+    }
+  }
+  for (i = 0, l = 0; i < NB_ELEMENTS; i++)
+    l += data[i];
+  assert(l == 0);
+
+  printf("PASSED\n");
+
+  /* Cleanup STM */
+  stm_exit();
+
+  return 0;
+}
@@ -0,0 +1,387 @@
+/*
+ * File:
+ *   slab.c
+ * Description:
+ *   Regression test for the slab allocator of the memory module
+ *   (MEM_SLABS=1): blocks of every size class must not overlap, the
+ *   blocks allocated by an aborted transaction must be given back and
+ *   the blocks it freed must be kept, and a block freed by a committed
+ *   transaction must not be reused while a transaction may still read
+ *   it (concurrent sorted list, threads leaving and joining).
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation, version 2
+ * of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#ifdef NDEBUG
+# undef NDEBUG
+#endif
+
+#include <assert.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <sched.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "stm.h"
+#include "mod_mem.h"
+#include "wrappers.h"
+
+#define DEFAULT_DURATION                2000
+#define DEFAULT_NB_THREADS              4
+#define DEFAULT_RANGE                   256
+
+#define MAX_SIZE                        2048 /* Largest slab block */
+#define NB_BLOCKS                       128 /* 4 blocks of each size */
+#define MAGIC                           0x51AB51AB51AB51ABL
+
+#define XSTR(s)                         STR(s)
+#define STR(s)                          #s
+
+typedef struct node {
+  struct node *next;                    /* First word: free list link once freed */
+  long key;
+  long magic;
+} node_t;
+
+static volatile int stop;
+
+static node_t *head;
+static long churn;
+static int range = DEFAULT_RANGE;
+
+typedef struct thread_data {
+  long nb_added;
+  long nb_removed;
+  unsigned long nb_contains;
+  unsigned int seed;
+  char padding[64];
+} thread_data_t;
+
+/*
+ * Allocate blocks of all sizes (some beyond the slabs) and check that
+ * they do not overlap.
+ */
+static void test_sizes(void)
+{
+  unsigned char *b[NB_BLOCKS];
+  size_t s[NB_BLOCKS];
+  int i, j;
+
+  stm_start((stm_tx_attr_t)0);
+  for (i = 0; i < NB_BLOCKS; i++) {
+    s[i] = 1 + (i / 4) * 73;
+    b[i] = (unsigned char *)stm_malloc(s[i]);
+    assert(((uintptr_t)b[i] & 7) == 0);
+  }
+  stm_commit();
+  for (i = 0; i < NB_BLOCKS; i++)
+    memset(b[i], i, s[i]);
+  for (i = 0; i < NB_BLOCKS; i++) {
+    for (j = 0; j < (int)s[i]; j++)
+      assert(b[i][j] == i);
+  }
+  stm_start((stm_tx_attr_t)0);
+  for (i = 0; i < NB_BLOCKS; i++)
+    stm_free(b[i], 0);
+  stm_commit();
+}
+
+/*
+ * An aborted transaction gives its blocks back and keeps the blocks it
+ * freed.
+ */
+static void test_abort(void)
+{
+  void *kept, *b[NB_BLOCKS];
+  void * volatile first;
+  volatile int tries = 0;
+  sigjmp_buf *e;
+  int i;
+
+  stm_start((stm_tx_attr_t)0);
+  kept = stm_malloc(64);
+  stm_commit();
+  memset(kept, 0xAA, 64);
+
+  first = NULL;
+  e = stm_start((stm_tx_attr_t)0);
+  sigsetjmp(*e, 0);
+  tries++;
+  b[0] = stm_malloc(64);
+  if (tries == 1) {
+    first = b[0];
+    stm_free(kept, 0);
+    stm_abort(0);
+  }
+  /* The block of the aborted attempt was put back on the free list */
+  assert(b[0] == first);
+  stm_commit();
+
+  /* Free enough for the collector to release the blocks it holds (the clock must move) */
+  for (i = 0; i < 1024; i++) {
+    stm_start((stm_tx_attr_t)0);
+    stm_free(stm_malloc(MAX_SIZE), 0);
+    stm_store_long(&churn, stm_load_long(&churn) + 1);
+    stm_commit();
+  }
+
+  /* The free of the aborted attempt was dropped */
+  stm_start((stm_tx_attr_t)0);
+  for (i = 1; i < NB_BLOCKS; i++) {
+    b[i] = stm_malloc(64);
+    assert(b[i] != kept);
+  }
+  stm_commit();
+  for (i = 0; i < 64; i++)
+    assert(((unsigned char *)kept)[i] == 0xAA);
+
+  stm_start((stm_tx_attr_t)0);
+  for (i = 0; i < NB_BLOCKS; i++)
+    stm_free(b[i], 0);
+  stm_free(kept, 0);
+  stm_commit();
+}
+
+/*
+ * Add or remove a key of a sorted list.  Freed nodes are not cleared:
+ * only the collector keeps a node from being reused (and its key
+ * changed without a new version) while a transaction traverses it.
+ */
+static void *test(void *v)
+{
+  int op, val, found, action;
+  node_t *prev, *next, *n;
+  long k, last;
+  sigjmp_buf *e;
+  thread_data_t *d = (thread_data_t *)v;
+
+  stm_init_thread();
+  while (stop == 0) {
+    op = rand_r(&d->seed) % 100;
+    val = 1 + rand_r(&d->seed) % range;
+    e = stm_start((stm_tx_attr_t)0);
+    sigsetjmp(*e, 0);
+    action = 0;
+    prev = head;
+    k = 0;
+    for (;;) {
+      assert((long)stm_load_long(&prev->magic) == MAGIC);
+      next = (node_t *)stm_load_ptr((volatile void **)&prev->next);
+      if (next == NULL)
+        break;
+      last = k;
+      k = stm_load_long(&next->key);
+      assert(k > last);
+      if (k >= val)
+        break;
+      /* Let the others remove the nodes ahead, even on one CPU */
+      if ((k & 15) == 0)
+        sched_yield();
+      prev = next;
+    }
+    found = (next != NULL && k == val);
+    if (op < 25 && !found) {
+      n = (node_t *)stm_malloc(sizeof(node_t));
+      /* Private until the commit */
+      n->key = val;
+      n->magic = MAGIC;
+      n->next = next;
+      stm_store_ptr((volatile void **)&prev->next, n);
+      action = 1;
+    } else if (op < 50 && found) {
+      stm_store_ptr((volatile void **)&prev->next, stm_load_ptr((volatile void **)&next->next));
+      stm_free(next, 0);
+      action = -1;
+    }
+    stm_commit();
+    if (action > 0)
+      d->nb_added++;
+    else if (action < 0)
+      d->nb_removed++;
+    else
+      d->nb_contains++;
+  }
+  stm_exit_thread();
+
+  return NULL;
+}
+
+static void run(thread_data_t *td, int nb_threads, int duration)
+{
+  pthread_t *threads;
+  pthread_attr_t attr;
+  struct timespec timeout;
+  int i;
+
+  if ((threads = (pthread_t *)malloc(nb_threads * sizeof(pthread_t))) == NULL) {
+    perror("malloc");
+    exit(1);
+  }
+  stop = 0;
+  timeout.tv_sec = duration / 1000;
+  timeout.tv_nsec = (duration % 1000) * 1000000;
+  pthread_attr_init(&attr);
+  pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_JOINABLE);
+  for (i = 0; i < nb_threads; i++) {
+    if (pthread_create(&threads[i], &attr, test, (void *)(&td[i])) != 0) {
+      fprintf(stderr, "Error creating thread\n");
+      exit(1);
+    }
+  }
+  pthread_attr_destroy(&attr);
+  nanosleep(&timeout, NULL);
+  stop = 1;
+  for (i = 0; i < nb_threads; i++) {
+    if (pthread_join(threads[i], NULL) != 0) {
+      fprintf(stderr, "Error waiting for thread completion\n");
+      exit(1);
+    }
+  }
+  free(threads);
+}
+
+static void timed_out(int sig)
+{
+  fprintf(stderr, "ERROR: timed out\n");
+  _exit(1);
+}
+
+int main(int argc, char **argv)
+{
+  struct option long_options[] = {
+    // These options don't set a flag
+    {"help",                      no_argument,       NULL, 'h'},
+    {"duration",                  required_argument, NULL, 'd'},
+    {"num-threads",               required_argument, NULL, 'n'},
+    {"range",                     required_argument, NULL, 'r'},
+    {NULL, 0, NULL, 0}
+  };
+
+  int i, c, size;
+  long expected;
+  node_t *n;
+  thread_data_t *td;
+  int duration = DEFAULT_DURATION;
+  int nb_threads = DEFAULT_NB_THREADS;
+
+  while(1) {
+    i = 0;
+    c = getopt_long(argc, argv, "hd:n:r:", long_options, &i);
+
+    if(c == -1)
+      break;
+
+    if(c == 0 && long_options[i].flag == 0)
+      c = long_options[i].val;
+
+    switch(c) {
+     case 0:
+       /* Flag is automatically set */
+       break;
+     case 'h':
+       printf("slab -- slab allocator regression test "
+              "\n"
+              "Usage:\n"
+              "  slab [options...]\n"
+              "\n"
+              "Options:\n"
+              "  -h, --help\n"
+              "        Print this message\n"
+              "  -d, --duration <int>\n"
+              "        Duration of the concurrent test in milliseconds (default=" XSTR(DEFAULT_DURATION) ")\n"
+              "  -n, --num-threads <int>\n"
+              "        Number of threads (default=" XSTR(DEFAULT_NB_THREADS) ")\n"
+              "  -r, --range <int>\n"
+              "        Range of the keys of the list (default=" XSTR(DEFAULT_RANGE) ")\n"
+         );
+       exit(0);
+     case 'd':
+       duration = atoi(optarg);
+       break;
+     case 'n':
+       nb_threads = atoi(optarg);
+       break;
+     case 'r':
+       range = atoi(optarg);
+       break;
+     case '?':
+       printf("Use -h or --help for help\n");
+       exit(0);
+     default:
+       exit(1);
+    }
+  }
+
+  assert(duration >= 0);
+  assert(nb_threads > 0);
+  assert(range > 0);
+
+  /* A corrupted free list can loop forever */
+  signal(SIGALRM, timed_out);
+  alarm(duration / 1000 + 60);
+
+  /* Init STM (blocks freed by committed transactions go through the collector) */
+  printf("Initializing STM\n");
+  setenv("MEM_SLABS", "1", 1);
+  stm_init();
+  mod_mem_init(1);
+  stm_init_thread();
+
+  printf("TESTING SIZES...\n");
+  test_sizes();
+  printf("TESTING ABORTS...\n");
+  test_abort();
+
+  /* Sentinel (never freed) */
+  stm_start((stm_tx_attr_t)0);
+  head = (node_t *)stm_malloc(sizeof(node_t));
+  stm_commit();
+  head->next = NULL;
+  head->key = 0;
+  head->magic = MAGIC;
+  stm_exit_thread();
+
+  printf("TESTING CONCURRENT UPDATES...\n");
+  if ((td = (thread_data_t *)calloc(2 * nb_threads, sizeof(thread_data_t))) == NULL) {
+    perror("malloc");
+    exit(1);
+  }
+  for (i = 0; i < 2 * nb_threads; i++)
+    td[i].seed = (unsigned int)time(NULL) + i;
+  /* The second threads reuse the blocks left by the first ones */
+  run(td, nb_threads, duration / 2);
+  run(td + nb_threads, nb_threads, duration / 2);
+  printf("STOPPING...\n");
+
+  expected = 0;
+  for (i = 0; i < 2 * nb_threads; i++)
+    expected += td[i].nb_added - td[i].nb_removed;
+  for (n = head->next, size = 0; n != NULL; n = n->next, size++) {
+    assert(n->magic == MAGIC);
+    assert(n->next == NULL || n->key < n->next->key);
+    assert(size < range);
+  }
+  printf("Set size     : %d (expected: %ld)\n", size, expected);
+  assert(size == expected);
+
+  printf("PASSED\n");
+
+  /* Cleanup STM */
+  stm_exit();
+
+  return 0;
+}
@@ -0,0 +1,248 @@
+/*
+ * File:
+ *   validation.c
+ * Description:
+ *   Regression test for read set validation: readers with large read
+ *   sets check an invariant inside their transactions while writers
+ *   commit small (recorded in the commit ring) and large (not recorded)
+ *   write sets, so that a snapshot extended without noticing a
+ *   conflicting write (vector kernels, incremental validation) is
+ *   caught.
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation, version 2
+ * of the License.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ */
+
+#ifdef NDEBUG
+# undef NDEBUG
+#endif
+
+#include <assert.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "stm.h"
+#include "wrappers.h"
+
+#define DEFAULT_DURATION                2000
+#define DEFAULT_NB_THREADS              4
+
+#define NB_ELEMENTS                     2048
+#define NB_PAIRS                        (NB_ELEMENTS / 2)
+#define MIN_READ_PAIRS                  32  /* Read sets beyond SET_INDEX_THRESHOLD */
+#define MAX_READ_PAIRS                  256
+#define MAX_TRANSFERS                   8   /* More locks than recorded per commit */
+
+#define XSTR(s)                         STR(s)
+#define STR(s)                          #s
+
+static volatile int stop;
+
+/* Element i and its partner i + NB_PAIRS always sum to 0 */
+long data[NB_ELEMENTS];
+
+typedef struct thread_data {
+  unsigned long nb_txs;
+  unsigned long nb_aborts;
+  unsigned int seed;
+  int reader;
+  char padding[64];
+} thread_data_t;
+
+static void *test(void *v)
+{
+  int i, k, n, first, len;
+  long l;
+  sigjmp_buf *e;
+  struct timespec pause = { 0, 1000 };
+  thread_data_t *d = (thread_data_t *)v;
+
+  stm_init_thread();
+  while (stop == 0) {
+    if (d->reader) {
+      /*
+       * Read a range of the first half, then the partners: reading a
+       * partner updated since the start extends the snapshot, which
+       * must fail if the update also wrote the range.
+       */
+      len = MIN_READ_PAIRS + rand_r(&d->seed) % (MAX_READ_PAIRS - MIN_READ_PAIRS + 1);
+      first = rand_r(&d->seed) % (NB_PAIRS - len + 1);
+      e = stm_start((stm_tx_attr_t)0);
+      sigsetjmp(*e, 0);
+      for (i = first, l = 0; i < first + len; i++)
+        l += stm_load_long(&data[i]);
+      /* Let a few writers commit in between, even on one CPU */
+      sched_yield();
+      for (i = first; i < first + len; i++)
+        l += stm_load_long(&data[i + NB_PAIRS]);
+      assert(l == 0);
+      /* An update with a large read set validates at commit time */
+      if ((rand_r(&d->seed) & 3) == 0) {
+        i = first + rand_r(&d->seed) % len;
+        stm_store_long(&data[i], stm_load_long(&data[i]) + 1);
+        stm_store_long(&data[i + NB_PAIRS], stm_load_long(&data[i + NB_PAIRS]) - 1);
+      }
+      stm_commit();
+    } else {
+      /* Small write sets are recorded in the commit ring, large ones are not */
+      n = 1 + rand_r(&d->seed) % MAX_TRANSFERS;
+      e = stm_start((stm_tx_attr_t)0);
+      sigsetjmp(*e, 0);
+      for (k = n; k > 0; k--) {
+        i = rand_r(&d->seed) % NB_PAIRS;
+        stm_store_long(&data[i], stm_load_long(&data[i]) + k);
+        stm_store_long(&data[i + NB_PAIRS], stm_load_long(&data[i + NB_PAIRS]) - k);
+      }
+      stm_commit();
+      /* Leave room for the readers, even on one CPU */
+      nanosleep(&pause, NULL);
+    }
+    d->nb_txs++;
+  }
+  stm_get_stats("nb_aborts", &d->nb_aborts);
+  stm_exit_thread();
+
+  return NULL;
+}
+
+int main(int argc, char **argv)
+{
+  struct option long_options[] = {
+    // These options don't set a flag
+    {"help",                      no_argument,       NULL, 'h'},
+    {"duration",                  required_argument, NULL, 'd'},
+    {"kernel",                    required_argument, NULL, 'k'},
+    {"num-threads",               required_argument, NULL, 'n'},
+    {NULL, 0, NULL, 0}
+  };
+
+  int i, c;
+  const char *kernel;
+  thread_data_t *td;
+  pthread_t *threads;
+  pthread_attr_t attr;
+  struct timespec timeout;
+  int duration = DEFAULT_DURATION;
+  int nb_threads = DEFAULT_NB_THREADS;
+
+  while(1) {
+    i = 0;
+    c = getopt_long(argc, argv, "hd:k:n:", long_options, &i);
+
+    if(c == -1)
+      break;
+
+    if(c == 0 && long_options[i].flag == 0)
+      c = long_options[i].val;
+
+    switch(c) {
+     case 0:
+       /* Flag is automatically set */
+       break;
+     case 'h':
+       printf("validation -- read set validation regression test "
+              "\n"
+              "Usage:\n"
+              "  validation [options...]\n"
+              "\n"
+              "Options:\n"
+              "  -h, --help\n"
+              "        Print this message\n"
+              "  -d, --duration <int>\n"
+              "        Test duration in milliseconds (default=" XSTR(DEFAULT_DURATION) ")\n"
+              "  -k, --kernel <string>\n"
+              "        Validation kernel (scalar, avx2, avx512, default=best available)\n"
+              "  -n, --num-threads <int>\n"
+              "        Number of threads, half of them readers (default=" XSTR(DEFAULT_NB_THREADS) ")\n"
+         );
+       exit(0);
+     case 'd':
+       duration = atoi(optarg);
+       break;
+     case 'k':
+       setenv("VALIDATE_KERNEL", optarg, 1);
+       break;
+     case 'n':
+       nb_threads = atoi(optarg);
+       break;
+     case '?':
+       printf("Use -h or --help for help\n");
+       exit(0);
+     default:
+       exit(1);
+    }
+  }
+
+  assert(duration >= 0);
+  assert(nb_threads > 1);
+
+  for (i = 0; i < NB_ELEMENTS; i++)
+    data[i] = 0;
+
+  /* Init STM */
+  printf("Initializing STM\n");
+  stm_init();
+  stm_get_parameter("validate_kernel", &kernel);
+
+  printf("Duration     : %d\n", duration);
+  printf("Nb threads   : %d\n", nb_threads);
+  printf("Kernel       : %s\n", kernel);
+
+  if ((td = (thread_data_t *)calloc(nb_threads, sizeof(thread_data_t))) == NULL) {
+    perror("malloc");
+    exit(1);
+  }
+  if ((threads = (pthread_t *)malloc(nb_threads * sizeof(pthread_t))) == NULL) {
+    perror("malloc");
+    exit(1);
+  }
+  stop = 0;
+  timeout.tv_sec = duration / 1000;
+  timeout.tv_nsec = (duration % 1000) * 1000000;
+  pthread_attr_init(&attr);
+  pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_JOINABLE);
+  for (i = 0; i < nb_threads; i++) {
+    td[i].seed = (unsigned int)time(NULL) + i;
+    td[i].reader = i & 1;
+    if (pthread_create(&threads[i], &attr, test, (void *)(&td[i])) != 0) {
+      fprintf(stderr, "Error creating thread\n");
+      exit(1);
+    }
+  }
+  pthread_attr_destroy(&attr);
+  nanosleep(&timeout, NULL);
+  printf("STOPPING...\n");
+  stop = 1;
+  for (i = 0; i < nb_threads; i++) {
+    if (pthread_join(threads[i], NULL) != 0) {
+      fprintf(stderr, "Error waiting for thread completion\n");
+      exit(1);
+    }
+  }
+
+  for (i = 0; i < NB_PAIRS; i++)
+    assert(data[i] + data[i + NB_PAIRS] == 0);
+
+  for (i = 0; i < nb_threads; i++) {
+    printf("Thread %d (%s)\n", i, td[i].reader ? "reader" : "writer");
+    printf("  #txs        : %lu\n", td[i].nb_txs);
+    printf("  #aborts     : %lu\n", td[i].nb_aborts);
+  }
+  printf("PASSED\n");
+
+  /* Cleanup STM */
+  stm_exit();
+
+  return 0;
+}